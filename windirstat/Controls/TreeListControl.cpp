@@ -25,6 +25,7 @@
 #include "dirstatview.h"
 #include "selectobject.h"
 #include "TreeListControl.h"
+#include <algorithm> // nth_element()
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -51,6 +52,26 @@ namespace
     const UINT HOTNODE_CY = 9;
     const UINT HOTNODE_X = 0;
 
+    // Folders with more children list only the largest ones, at first.
+    // Each expansion of the remainder item lists CHILD_LIMIT_FACTOR times more.
+    const int CHILD_LIMIT = 1000;
+    const int CHILD_LIMIT_FACTOR = 10;
+
+}
+
+CTreeListItem::VISIBLEINFO::VISIBLEINFO(int iIndent)
+    : indent(iIndent)
+    , image(-1)
+    , isExpanded(false)
+    , childLimit(CHILD_LIMIT)
+    , remainder(NULL)
+    , isChanged(false)
+{
+}
+
+CTreeListItem::VISIBLEINFO::~VISIBLEINFO()
+{
+    delete remainder;
 }
 
 CTreeListItem::CTreeListItem()
@@ -97,10 +118,30 @@ CString CTreeListItem::GetText(int /*subitem*/) const
     return _T("test");
 }
 
+ULONGLONG CTreeListItem::GetTreeListWeight() const
+{
+    return 0;
+}
+
+CTreeListItem *CTreeListItem::CreateRemainderItem() const
+{
+    return NULL;
+}
+
+void CTreeListItem::UpdateRemainderItem(CTreeListItem * /*remainder*/, CTreeListItem *const * /*listed*/, int /*listedCount*/) const
+{
+}
+
+bool CTreeListItem::IsRemainderItem() const
+{
+    return false;
+}
+
 int CTreeListItem::GetImage() const
 {
     ASSERT(IsVisible());
-    if(m_vi->image == -1)
+    // Placeholders are replaced as soon as the icon lookup has finished.
+    if(m_vi->image == -1 || GetMyImageList()->isPlaceholderImage(m_vi->image))
     {
         m_vi->image = GetImageToCache();
     }
@@ -153,13 +194,55 @@ void CTreeListItem::UncacheImage()
 void CTreeListItem::SortChildren()
 {
     ASSERT(IsVisible());
+
+    // While we are expanded, the listed children correspond to rows
+    // in the list. So if they are a selection, we must only re-sort them.
+    if(m_vi->isExpanded && m_vi->remainder != NULL)
+    {
+        const int listed = GetSortedChildrenCount() - 1;
+        ASSERT(m_vi->sortedChildren[listed] == m_vi->remainder);
+        qsort(m_vi->sortedChildren.GetData(), listed, sizeof(CTreeListItem *), &_compareProc);
+        UpdateRemainderItem(m_vi->remainder, m_vi->sortedChildren.GetData(), listed);
+        return;
+    }
+
     m_vi->sortedChildren.SetSize(GetChildrenCount());
     for(int i = 0; i < GetChildrenCount(); i++)
     {
         m_vi->sortedChildren[i]= GetTreeListChild(i);
     }
 
+    if(!m_vi->isExpanded)
+    {
+        delete m_vi->remainder;
+        m_vi->remainder = NULL;
+
+        if(GetChildrenCount() > m_vi->childLimit)
+        {
+            m_vi->remainder = CreateRemainderItem();
+        }
+
+        if(m_vi->remainder != NULL)
+        {
+            // Partial selection of the largest children. Only these have to be sorted.
+            CTreeListItem **children = m_vi->sortedChildren.GetData();
+            std::nth_element(children, children + m_vi->childLimit, children + GetChildrenCount(), &_isHeavier);
+            m_vi->sortedChildren.SetSize(m_vi->childLimit);
+        }
+    }
+
     qsort(m_vi->sortedChildren.GetData(), m_vi->sortedChildren.GetSize(), sizeof(CTreeListItem *), &_compareProc);
+
+    if(m_vi->remainder != NULL)
+    {
+        UpdateRemainderItem(m_vi->remainder, m_vi->sortedChildren.GetData(), GetSortedChildrenCount());
+        m_vi->sortedChildren.Add(m_vi->remainder);
+    }
+}
+
+bool CTreeListItem::_isHeavier(const CTreeListItem *item1, const CTreeListItem *item2)
+{
+    return item1->GetTreeListWeight() > item2->GetTreeListWeight();
 }
 
 int __cdecl CTreeListItem::_compareProc(const void *p1, const void *p2)
@@ -174,6 +257,90 @@ CTreeListItem *CTreeListItem::GetSortedChild(int i)
     return m_vi->sortedChildren[i];
 }
 
+int CTreeListItem::GetSortedChildrenCount() const
+{
+    ASSERT(IsVisible());
+    return int(m_vi->sortedChildren.GetSize());
+}
+
+bool CTreeListItem::HasHiddenChildren() const
+{
+    return IsVisible() && m_vi->remainder != NULL;
+}
+
+// True if we have more children than we list on the next expansion
+bool CTreeListItem::IsOverChildLimit() const
+{
+    return IsVisible() && GetChildrenCount() > m_vi->childLimit;
+}
+
+// Takes effect on the next expansion
+void CTreeListItem::RaiseChildLimit()
+{
+    ASSERT(IsVisible());
+    if(m_vi->childLimit > INT_MAX / CHILD_LIMIT_FACTOR)
+    {
+        m_vi->childLimit = INT_MAX;
+    }
+    else
+    {
+        m_vi->childLimit *= CHILD_LIMIT_FACTOR;
+    }
+}
+
+bool CTreeListItem::IsChanged() const
+{
+    return IsVisible() && m_vi->isChanged;
+}
+
+void CTreeListItem::SetChanged(bool changed)
+{
+    ASSERT(IsVisible());
+    m_vi->isChanged = changed;
+}
+
+void CTreeListItem::AddPendingChild(CTreeListItem *child)
+{
+    ASSERT(IsExpanded());
+    m_vi->pendingChildren.Add(child);
+}
+
+// Returns true if child was pending (i.e. is not listed yet).
+bool CTreeListItem::RemovePendingChild(CTreeListItem *child)
+{
+    ASSERT(IsVisible());
+    for(int i = 0; i < m_vi->pendingChildren.GetSize(); i++)
+    {
+        if(m_vi->pendingChildren[i] == child)
+        {
+            m_vi->pendingChildren.RemoveAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+int CTreeListItem::GetPendingChildrenCount() const
+{
+    if(!IsVisible())
+    {
+        return 0;
+    }
+    return int(m_vi->pendingChildren.GetSize());
+}
+
+CTreeListItem *CTreeListItem::GetPendingChild(int i) const
+{
+    ASSERT(IsVisible());
+    return m_vi->pendingChildren[i];
+}
+
+void CTreeListItem::ClearPendingChildren()
+{
+    ASSERT(IsVisible());
+    m_vi->pendingChildren.RemoveAll();
+}
+
 int CTreeListItem::Compare(const CSortingListItem *baseOther, int subitem) const
 {
     CTreeListItem *other = (CTreeListItem *)baseOther;
@@ -214,7 +381,7 @@ int CTreeListItem::Compare(const CSortingListItem *baseOther, int subitem) const
 
 int CTreeListItem::FindSortedChild(const CTreeListItem *child)
 {
-    for(int i = 0; i < GetChildrenCount(); i++)
+    for(int i = 0; i < GetSortedChildrenCount(); i++)
     {
         if(child == GetSortedChild(i))
         {
@@ -239,11 +406,12 @@ bool CTreeListItem::HasSiblings() const
         return false;
     }
     int i = m_parent->FindSortedChild(this);
-    return i < m_parent->GetChildrenCount() - 1;
+    return i < m_parent->GetSortedChildrenCount() - 1;
 }
 bool CTreeListItem::HasChildren() const
 {
-    return GetChildrenCount() > 0;
+    // The remainder item can be "expanded" into more children of its parent.
+    return GetChildrenCount() > 0 || IsRemainderItem();
 }
 bool CTreeListItem::IsExpanded() const
 {
@@ -254,6 +422,11 @@ void CTreeListItem::SetExpanded(bool expanded)
 {
     ASSERT(IsVisible());
     m_vi->isExpanded = expanded;
+    if(!expanded)
+    {
+        // Children, which are not listed yet, won't be listed anymore.
+        ClearPendingChildren();
+    }
 }
 bool CTreeListItem::IsVisible() const
 {
@@ -324,6 +497,7 @@ IMPLEMENT_DYNAMIC(CTreeListControl, COwnerDrawnListControl)
 CTreeListControl::CTreeListControl(CDirstatView *dirstatView, int rowHeight)
     : COwnerDrawnListControl(_T("treelist"), rowHeight)
     , m_dirstatView(dirstatView)
+    , m_changedItems(0)
 {
     ASSERT(_theTreeListControl == NULL);
     _theTreeListControl = this;
@@ -373,7 +547,10 @@ void CTreeListControl::DeselectItem(int i)
 void CTreeListControl::SelectSingleItem(int i)
 {
     GetDocument()->RemoveAllSelections();
-    GetDocument()->AddSelection((const CItem *)GetItem(i));
+    if(!GetItem(i)->IsRemainderItem())
+    {
+        GetDocument()->AddSelection((const CItem *)GetItem(i));
+    }
     GetDocument()->UpdateAllViews(NULL, HINT_SELECTIONCHANGED);
     FocusItem(i);
 }
@@ -438,7 +615,9 @@ CTreeListItem *CTreeListControl::GetItem(int i)
 
 void CTreeListControl::SetRootItem(CTreeListItem *root)
 {
+    // The old items may already be deleted.
     DeleteAllItems();
+    m_changedItems = 0;
 
     m_selectionAnchor = root;
 
@@ -542,6 +721,10 @@ void CTreeListControl::DeleteItem(int i)
         m_selectionAnchor = GetItem(0);
     }
 
+    if(GetItem(i)->IsChanged())
+    {
+        m_changedItems--;
+    }
     GetItem(i)->SetExpanded(false);
     GetItem(i)->SetVisible(false);
     COwnerDrawnListControl::DeleteItem(i);
@@ -569,8 +752,11 @@ void CTreeListControl::DrawNode(CDC *pdc, CRect& rc, CRect& rcPlusMinus, const C
     {
         rcRest.left += 3;
 
-        CDC dcmem;
-        dcmem.CreateCompatibleDC(pdc);
+        if(m_dcNodes.m_hDC == NULL)
+        {
+            VERIFY(m_dcNodes.CreateCompatibleDC(pdc));
+        }
+        CDC& dcmem = m_dcNodes;
         CSelectObject sonodes(&dcmem, (IsItemStripeColor(item) ? &m_bmNodes1 : &m_bmNodes0));
 
         int ysrc = NODE_HEIGHT / 2 - GetRowHeight() / 2;
@@ -817,7 +1003,10 @@ void CTreeListControl::UpdateDocumentSelection()
     while (pos != NULL)
     {
         int k = GetNextSelectedItem(pos);
-        GetDocument()->AddSelection((const CItem *)GetItem(k));
+        if(!GetItem(k)->IsRemainderItem())
+        {
+            GetDocument()->AddSelection((const CItem *)GetItem(k));
+        }
     }
 }
 
@@ -858,9 +1047,10 @@ void CTreeListControl::CollapseItem(int i)
         }
         todelete++;
     }
-    for(int m = 0; m < todelete; m++)
+    // Bottom-up, because a remainder item is owned by its parent's VISIBLEINFO.
+    for(int m = todelete; m > 0; m--)
     {
-        DeleteItem(i + 1);
+        DeleteItem(i + m);
     }
     item->SetExpanded(false);
     if(selectNode)
@@ -913,6 +1103,11 @@ void CTreeListControl::ExpandItem(CTreeListItem *item)
 void CTreeListControl::ExpandItem(int i, bool scroll)
 {
     CTreeListItem *item = GetItem(i);
+    if(item->IsRemainderItem())
+    {
+        ShowMoreChildren(i);
+        return;
+    }
     if(item->IsExpanded())
     {
         return;
@@ -924,7 +1119,7 @@ void CTreeListControl::ExpandItem(int i, bool scroll)
     item->SortChildren();
 
     int maxwidth = GetSubItemWidth(item, 0);
-    for(int c = 0; c < item->GetChildrenCount(); c++)
+    for(int c = 0; c < item->GetSortedChildrenCount(); c++)
     {
         CTreeListItem *child = item->GetSortedChild(c);
         InsertItem(i + 1 + c, child);
@@ -954,7 +1149,7 @@ void CTreeListControl::ExpandItem(int i, bool scroll)
 #elif 1
         // Scroll up so far, that i is still visible
         // and the first child becomes visible, if possible.
-        if(item->GetChildrenCount() > 0)
+        if(item->GetSortedChildrenCount() > 0)
         {
             EnsureVisible(i + 1, false);
         }
@@ -1030,7 +1225,7 @@ void CTreeListControl::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
         break;
 
     case VK_RIGHT:
-        if (!item->IsExpanded() && item->GetChildrenCount() > 0)
+        if (!item->IsExpanded() && item->HasChildren())
         {
             ExpandItem(i);
         }
@@ -1086,6 +1281,51 @@ void CTreeListControl::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
     }
 }
 
+// The remainder item i has been expanded: list more children of its parent.
+void CTreeListControl::ShowMoreChildren(int i)
+{
+    CTreeListItem *parent = GetItem(i)->GetParent();
+    int p = FindTreeItem(parent);
+    ASSERT(p != -1);
+
+    parent->RaiseChildLimit();
+    RelistChildren(p);
+
+    EnsureVisible(min(i, GetItemCount() - 1), false);
+}
+
+// Collapses and re-expands item i, so that the selection of listed
+// children is made anew. Expanded descendants are expanded again.
+void CTreeListControl::RelistChildren(int i)
+{
+    CTreeListItem *item = GetItem(i);
+    ASSERT(item->IsExpanded());
+
+    // Top-down, so that each one is listed when we re-expand it.
+    CArray<CTreeListItem *, CTreeListItem *> expanded;
+    for(int k = i + 1; k < GetItemCount() && GetItem(k)->GetIndent() > item->GetIndent(); k++)
+    {
+        if(GetItem(k)->IsExpanded())
+        {
+            expanded.Add(GetItem(k));
+        }
+    }
+
+    CollapseItem(i);
+    ExpandItem(i, false);
+    for(int k = 0; k < expanded.GetSize(); k++)
+    {
+        int e = FindTreeItem(expanded[k]);
+        if(e != -1)
+        {
+            ExpandItem(e, false);
+        }
+    }
+}
+
+// Called for every new item during a scan. Searching, inserting and sorting
+// here would make scanning an expanded folder quadratic, so we only log the
+// change. The view calls ApplyPendingChanges() once per update.
 void CTreeListControl::OnChildAdded(CTreeListItem *parent, CTreeListItem *child)
 {
     if(!parent->IsVisible())
@@ -1093,18 +1333,16 @@ void CTreeListControl::OnChildAdded(CTreeListItem *parent, CTreeListItem *child)
         return;
     }
 
-    int p = FindTreeItem(parent);
-    ASSERT(p != -1);
-
-    if(parent->IsExpanded())
+    // If there are hidden children, the remainder item accounts for the new child, as soon as we Sort().
+    if(parent->IsExpanded() && !parent->HasHiddenChildren())
     {
-        InsertItem(p + 1, child);
-        RedrawItems(p, p);
-        Sort();
+        parent->AddPendingChild(child);
     }
-    else
+
+    if(!parent->IsChanged())
     {
-        RedrawItems(p, p);
+        parent->SetChanged();
+        m_changedItems++;
     }
 }
 
@@ -1120,15 +1358,30 @@ void CTreeListControl::OnChildRemoved(CTreeListItem *parent, CTreeListItem *chil
 
     if(parent->IsExpanded())
     {
-        for(int i = 0; i < child->GetChildrenCount(); i++)
+        int c = parent->RemovePendingChild(child) ? -1 : FindTreeItem(child);
+        if(c != -1)
         {
-            OnChildRemoved(child, child->GetTreeListChild(i));
+            // Bottom-up, see CollapseItem()
+            int todelete = 0;
+            while(c + todelete + 1 < GetItemCount() && GetItem(c + todelete + 1)->GetIndent() > child->GetIndent())
+            {
+                todelete++;
+            }
+            for(int m = todelete; m >= 0; m--)
+            {
+                DeleteItem(c + m);
+            }
         }
 
-        int c = FindTreeItem(child);
-        ASSERT(c != -1);
-        DeleteItem(c);
-        parent->SortChildren();
+        if(c != -1 && parent->HasHiddenChildren())
+        {
+            // The child was one of the listed ones
+            RelistChildren(p);
+        }
+        else
+        {
+            parent->SortChildren();
+        }
     }
 
     RedrawItems(p, p);
@@ -1147,6 +1400,54 @@ void CTreeListControl::OnRemovingAllChildren(CTreeListItem *parent)
     CollapseItem(p);
 }
 
+// Lists the children logged by OnChildAdded() and redraws their parents.
+// One pass over the list, bottom-up, so that insertions don't shift the
+// rows still to be visited. The caller has to Sort(), if we return true.
+bool CTreeListControl::ApplyPendingChanges()
+{
+    if(m_changedItems == 0)
+    {
+        return false;
+    }
+
+    bool inserted = false;
+    SetRedraw(FALSE);
+    for(int i = GetItemCount() - 1; i >= 0 && m_changedItems > 0; i--)
+    {
+        CTreeListItem *item = GetItem(i);
+        if(!item->IsChanged())
+        {
+            continue;
+        }
+
+        if(item->GetPendingChildrenCount() > 0 && !item->HasHiddenChildren() && item->IsOverChildLimit())
+        {
+            // Expanded while it was scanned, and now too large to list
+            // all children: list the largest ones and a remainder item.
+            item->ClearPendingChildren();
+            RelistChildren(i);
+            inserted = true;
+        }
+        else
+        {
+            for(int k = 0; k < item->GetPendingChildrenCount(); k++)
+            {
+                InsertItem(i + 1, item->GetPendingChild(k));
+                inserted = true;
+            }
+            item->ClearPendingChildren();
+        }
+        item->SetChanged(false);
+        m_changedItems--;
+        RedrawItems(i, i);
+    }
+    SetRedraw(TRUE);
+
+    ASSERT(m_changedItems == 0);
+    m_changedItems = 0;
+    return inserted;
+}
+
 void CTreeListControl::Sort()
 {
     for(int i = 0; i < GetItemCount(); i++)
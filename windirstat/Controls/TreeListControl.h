@@ -52,15 +52,21 @@ class CTreeListItem: public COwnerDrawnListItem
         // children as in CItem::m_children) and is initialized as soon as
         // we are expanded. In contrast to CItem::m_children, this array is always
         // sorted depending on the current user-defined sort column and -order.
+        // If we have more than childLimit children, it only contains the
+        // childLimit largest ones, followed by the remainder item.
         CArray<CTreeListItem *, CTreeListItem *> sortedChildren;
+        int childLimit;
+        CTreeListItem *remainder;   // Stands for the children not listed; owned.
+
+        // Change log: children added while we are expanded are listed by
+        // CTreeListControl::ApplyPendingChanges(), which also redraws us.
+        CArray<CTreeListItem *, CTreeListItem *> pendingChildren;
+        bool isChanged;
 
         CPacman pacman;
 
-        VISIBLEINFO(int iIndent)
-            : indent(iIndent)
-            , image(-1)
-            , isExpanded(false)
-        {}
+        VISIBLEINFO(int iIndent);
+        ~VISIBLEINFO();
     };
 
 public:
@@ -77,11 +83,30 @@ public:
     virtual int GetChildrenCount() const =0;
     virtual int GetImageToCache() const =0;
 
+    // Large folders list only their largest children. The rest is represented
+    // by a remainder item, which can be expanded on demand.
+    // CreateRemainderItem() returns NULL if the item doesn't support this.
+    virtual ULONGLONG GetTreeListWeight() const;
+    virtual CTreeListItem *CreateRemainderItem() const;
+    virtual void UpdateRemainderItem(CTreeListItem *remainder, CTreeListItem *const *listed, int listedCount) const;
+    virtual bool IsRemainderItem() const;
+
     void DrawPacman(CDC *pdc, const CRect& rc, COLORREF bgColor) const;
     void UncacheImage();
     void SortChildren();
     CTreeListItem *GetSortedChild(int i);
+    int GetSortedChildrenCount() const;
     int FindSortedChild(const CTreeListItem *child);
+    bool HasHiddenChildren() const;
+    bool IsOverChildLimit() const;
+    void RaiseChildLimit();
+    bool IsChanged() const;
+    void SetChanged(bool changed =true);
+    void AddPendingChild(CTreeListItem *child);
+    bool RemovePendingChild(CTreeListItem *child);
+    int GetPendingChildrenCount() const;
+    CTreeListItem *GetPendingChild(int i) const;
+    void ClearPendingChildren();
     CTreeListItem *GetParent() const;
     void SetParent(CTreeListItem *parent);
     bool HasSiblings() const;
@@ -98,6 +123,7 @@ public:
 
 protected:
     static int __cdecl _compareProc(const void *p1, const void *p2);
+    static bool _isHeavier(const CTreeListItem *item1, const CTreeListItem *item2);
     static CTreeListControl *GetTreeListControl();
     void StartPacman(bool start);
     bool DrivePacman(ULONGLONG readJobs);
@@ -133,7 +159,8 @@ public:
     void OnChildAdded(CTreeListItem *parent, CTreeListItem *child);
     void OnChildRemoved(CTreeListItem *parent, CTreeListItem *childdata);
     void OnRemovingAllChildren(CTreeListItem *parent);
-    CTreeListItem *GetItem(int i);
+    bool ApplyPendingChanges();
+    virtual CTreeListItem *GetItem(int i);
     void DeselectAll();
     void ExpandPathToItem(const CTreeListItem *item);
     void DrawNode(CDC *pdc, CRect& rc, CRect& rcPlusMinus, const CTreeListItem *item, int *width);
@@ -161,6 +188,8 @@ protected:
     void DeleteItem(int i);
     void CollapseItem(int i);
     void ExpandItem(int i, bool scroll = true);
+    void ShowMoreChildren(int i);
+    void RelistChildren(int i);
     void ToggleExpansion(int i);
     void SelectItem(int i);
     void DeselectItem(int i);
@@ -178,9 +207,11 @@ protected:
     /////////////////////////////////////////////////////
 
     CDirstatView *m_dirstatView;// backpointer to the directory list
+    int m_changedItems;         // Number of visible items with IsChanged()
 
     CBitmap m_bmNodes0;         // The bitmaps needed to draw the treecontrol-like branches
     CBitmap m_bmNodes1;         // The same bitmaps with stripe-background color
+    CDC m_dcNodes;              // Memory DC for m_bmNodes0/1, kept for all rows
     CImageList *m_imageList;    // We don't use the system-supplied SetImageList(), but MySetImageList().
     int m_lButtonDownItem;      // Set in OnLButtonDown(). -1 if not item hit.
     bool m_lButtonDownOnPlusMinusRect;  // Set in OnLButtonDown(). True, if plus-minus-rect hit.
@@ -23,14 +23,177 @@
 #include "windirstat.h"
 #include "selectobject.h"
 #include "treemap.h"
+#include "options.h"
 #include "myimagelist.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
 #endif
 
+namespace
+{
+    // Time we give the lookup thread to finish at exit
+    const DWORD LOOKUP_THREAD_STOP_TIMEOUT = 3000; // ms
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+UINT CIconLookupThread::s_lookupDoneMessage = ::RegisterWindowMessage(_T("{7E9E1C0B-3A53-4C4B-9D1E-2B7F3A6A8C41}"));
+
+CIconLookupThread::CIconLookupThread(HWND notify)
+    : m_notify(notify)
+    , m_stop(false)
+{
+    // CMyImageList deletes us after Stop()
+    m_bAutoDelete = false;
+}
+
+BOOL CIconLookupThread::InitInstance()
+{
+    // Shell extensions may require COM
+    HRESULT hr = ::CoInitialize(NULL);
+
+    for(;;)
+    {
+        SRequest request;
+        {
+            CSingleLock lock(&m_cs, true);
+            if(m_stop)
+            {
+                break;
+            }
+            if(m_requests.IsEmpty())
+            {
+                lock.Unlock();
+                ::WaitForSingleObject(m_wakeUp, INFINITE);
+                continue;
+            }
+            request = m_requests.RemoveHead();
+        }
+
+        SResult result;
+        result.key = request.key;
+        result.isExtension = request.isExtension;
+        result.systemImage = -1;
+        result.perFileIcon = false;
+
+        UINT flags = SHGFI_SYSICONINDEX | SHGFI_SMALLICON | SHGFI_TYPENAME;
+        if(request.isExtension)
+        {
+            flags |= SHGFI_USEFILEATTRIBUTES;
+        }
+
+        SHFILEINFO sfi = {0};
+        if(::SHGetFileInfo(request.key, FILE_ATTRIBUTE_NORMAL, &sfi, sizeof(sfi), flags) != 0)
+        {
+            result.systemImage = sfi.iIcon;
+            result.typeName = sfi.szTypeName;
+            result.perFileIcon = request.isExtension && HasPerFileIcon(request.key);
+        }
+        else
+        {
+            VTRACE(_T("SHGetFileInfo(%s) failed"), request.key.GetString());
+        }
+
+        CSingleLock lock(&m_cs, true);
+        // Only the first result of a batch needs to be announced
+        bool notify = m_results.IsEmpty();
+        m_results.AddTail(result);
+        lock.Unlock();
+
+        if(notify)
+        {
+            ::PostMessage(m_notify, s_lookupDoneMessage, 0, 0);
+        }
+    }
+
+    if(SUCCEEDED(hr))
+    {
+        ::CoUninitialize();
+    }
+
+    return false;
+}
+
+void CIconLookupThread::AddRequest(const SRequest& request)
+{
+    CSingleLock lock(&m_cs, true);
+    m_requests.AddTail(request);
+    m_wakeUp.SetEvent();
+}
+
+bool CIconLookupThread::GetResult(SResult& result)
+{
+    CSingleLock lock(&m_cs, true);
+    if(m_results.IsEmpty())
+    {
+        return false;
+    }
+    result = m_results.RemoveHead();
+    return true;
+}
+
+bool CIconLookupThread::Stop()
+{
+    CSingleLock lock(&m_cs, true);
+    m_stop = true;
+    m_requests.RemoveAll();
+    m_wakeUp.SetEvent();
+    lock.Unlock();
+
+    // A hanging shell extension must not keep us from exiting.
+    return ::WaitForSingleObject(m_hThread, LOOKUP_THREAD_STOP_TIMEOUT) == WAIT_OBJECT_0;
+}
+
+// Types like .exe, .ico or .lnk have a distinct icon in each file.
+// Their DefaultIcon is "%1" or they have an icon handler.
+bool CIconLookupThread::HasPerFileIcon(LPCTSTR ext)
+{
+    CRegKey key;
+    if(key.Open(HKEY_CLASSES_ROOT, ext, KEY_READ) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    TCHAR progId[MAX_PATH];
+    ULONG len = _countof(progId);
+    if(key.QueryStringValue(NULL, progId, &len) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    CRegKey iconHandler;
+    if(iconHandler.Open(HKEY_CLASSES_ROOT, CString(progId) + _T("\\ShellEx\\IconHandler"), KEY_READ) == ERROR_SUCCESS)
+    {
+        return true;
+    }
+
+    CRegKey defaultIcon;
+    if(defaultIcon.Open(HKEY_CLASSES_ROOT, CString(progId) + _T("\\DefaultIcon"), KEY_READ) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    TCHAR location[MAX_PATH];
+    len = _countof(location);
+    if(defaultIcon.QueryStringValue(NULL, location, &len) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    return _tcscmp(location, _T("%1")) == 0 || _tcscmp(location, _T("\"%1\"")) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
 CMyImageList::CMyImageList()
-    : m_filesFolderImage(-1)
+    : m_systemImageList(NULL)
+    , m_lookupThread(NULL)
+    , m_synchronous(false)
+    , m_folderImage(-1)
+    , m_pendingFolderImage(-1)
+    , m_pendingFileImage(-1)
+    , m_filesFolderImage(-1)
     , m_freeSpaceImage(-1)
     , m_unknownImage(-1)
     , m_emptyImage(-1)
@@ -53,7 +216,12 @@ void CMyImageList::initialize()
 
         SHFILEINFO sfi = {0};
         HIMAGELIST hil = (HIMAGELIST)::SHGetFileInfo(s, 0, &sfi, sizeof(sfi), WDS_SHGFI_DEFAULTS);
+        if(sfi.hIcon != NULL)
+        {
+            ::DestroyIcon(sfi.hIcon);
+        }
 
+        m_systemImageList = hil;
         this->Attach(ImageList_Duplicate(hil));
 
         VTRACE(_T("System image list has %i icons"), this->GetImageCount());
@@ -63,6 +231,13 @@ void CMyImageList::initialize()
         }
 
         this->addCustomImages();
+
+        m_folderImage = getFolderImage();
+        m_pendingFolderImage = addPlaceholderImage(m_folderImage);
+        m_pendingFileImage = addPlaceholderImage(cacheIcon(_T("file"), SHGFI_USEFILEATTRIBUTES));
+
+        m_iconCache.InitHashTable(4099);
+        CPersistence::GetExtensionTypeNames(m_typeNames, m_storedExtensions);
     }
 }
 
@@ -117,23 +292,184 @@ int CMyImageList::cacheIcon(LPCTSTR path, UINT flags, CString *psTypeName)
         VTRACE(_T("SHGetFileInfo() failed"));
         return getEmptyImage();
     }
+    if(sfi.hIcon != NULL)
+    {
+        ::DestroyIcon(sfi.hIcon);
+    }
 
     if(psTypeName != NULL)
     {
         *psTypeName = sfi.szTypeName;
     }
 
+    return cacheSystemImage(sfi.iIcon);
+}
+
+// Returns our index of a system image list image
+int CMyImageList::cacheSystemImage(int systemImage)
+{
     int i;
-    if(!m_indexMap.Lookup(sfi.iIcon, i)) // part of the system image list?
+    if(!m_indexMap.Lookup(systemImage, i)) // part of the system image list?
     {
-        CImageList *sil = CImageList::FromHandle(hil); // does not have to be destroyed
-        i = this->Add(sil->ExtractIcon(sfi.iIcon));
-        m_indexMap.SetAt(sfi.iIcon, i);
+        CImageList *sil = CImageList::FromHandle(m_systemImageList); // does not have to be destroyed
+        HICON icon = sil->ExtractIcon(systemImage);
+        i = this->Add(icon);
+        ::DestroyIcon(icon);
+        m_indexMap.SetAt(systemImage, i);
     }
 
     return i;
 }
 
+// Adds a copy of image, so that placeholders can be told apart from the real images
+int CMyImageList::addPlaceholderImage(int image)
+{
+    HICON icon = this->ExtractIcon(image);
+    int i = this->Add(icon);
+    ::DestroyIcon(icon);
+    return i;
+}
+
+// Returns the cache entry of key. If there is none yet, it is
+// requested from the lookup thread and the placeholder is returned meanwhile.
+const CMyImageList::SIconCacheEntry& CMyImageList::lookupIcon(LPCTSTR key, bool isExtension, int placeholder)
+{
+    ASSERT(m_hImageList != NULL); // should have been initialize()ed.
+
+    CIconCache::CPair *pair = m_iconCache.PLookup(key);
+    if(pair != NULL)
+    {
+        return pair->value;
+    }
+
+    SIconCacheEntry entry;
+    entry.perFileIcon = false;
+    if(isExtension)
+    {
+        // The type name of the last session may be shown until the lookup has finished.
+        m_typeNames.Lookup(key, entry.typeName);
+        m_usedExtensions.Add(key);
+    }
+
+    if(startLookupThread())
+    {
+        entry.image = placeholder;
+        entry.pending = true;
+
+        CIconLookupThread::SRequest request;
+        request.key = key;
+        request.isExtension = isExtension;
+        m_lookupThread->AddRequest(request);
+    }
+    else
+    {
+        entry.image = cacheIcon(key, isExtension ? SHGFI_USEFILEATTRIBUTES : 0, &entry.typeName);
+        entry.perFileIcon = isExtension && CIconLookupThread::HasPerFileIcon(key);
+        entry.pending = false;
+    }
+
+    m_iconCache.SetAt(key, entry);
+    return m_iconCache.PLookup(key)->value;
+}
+
+bool CMyImageList::startLookupThread()
+{
+    if(m_lookupThread != NULL)
+    {
+        return true;
+    }
+    if(m_synchronous)
+    {
+        return false;
+    }
+
+    // The results are posted to the main window. As long as
+    // there is none, we look up synchronously.
+    CWnd *mainWnd = AfxGetMainWnd();
+    if(mainWnd == NULL || mainWnd->m_hWnd == NULL)
+    {
+        return false;
+    }
+
+    m_lookupThread = new CIconLookupThread(mainWnd->m_hWnd);
+    if(!m_lookupThread->CreateThread())
+    {
+        VTRACE(_T("Failed to create the icon lookup thread"));
+        delete m_lookupThread;
+        m_lookupThread = NULL;
+        m_synchronous = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool CMyImageList::processLookupResults()
+{
+    if(m_lookupThread == NULL)
+    {
+        return false;
+    }
+
+    bool changed = false;
+
+    CIconLookupThread::SResult result;
+    while(m_lookupThread->GetResult(result))
+    {
+        CIconCache::CPair *pair = m_iconCache.PLookup(result.key);
+        ASSERT(pair != NULL);
+        if(pair == NULL)
+        {
+            continue;
+        }
+
+        SIconCacheEntry& entry = pair->value;
+        entry.image = result.systemImage == -1 ? getEmptyImage() : cacheSystemImage(result.systemImage);
+        entry.perFileIcon = result.perFileIcon;
+        entry.pending = false;
+
+        if(result.isExtension && !result.typeName.IsEmpty())
+        {
+            entry.typeName = result.typeName;
+            m_typeNames.SetAt(result.key, result.typeName);
+        }
+
+        changed = true;
+    }
+
+    return changed;
+}
+
+void CMyImageList::shutdown()
+{
+    if(m_lookupThread != NULL)
+    {
+        if(m_lookupThread->Stop())
+        {
+            delete m_lookupThread;
+        }
+        // else: leave it to the end of the process.
+        m_lookupThread = NULL;
+    }
+    m_synchronous = true;
+
+    if(m_hImageList != NULL)
+    {
+        // The extensions of this session first, then those of the last
+        // sessions, which have not been used again.
+        CStringArray extensions;
+        extensions.Append(m_usedExtensions);
+        for(int i = 0; i < m_storedExtensions.GetSize(); i++)
+        {
+            if(m_iconCache.PLookup(m_storedExtensions[i]) == NULL)
+            {
+                extensions.Add(m_storedExtensions[i]);
+            }
+        }
+        CPersistence::SetExtensionTypeNames(extensions, m_typeNames);
+    }
+}
+
 int CMyImageList::getMyComputerImage()
 {
     // FIXME: see whether we can wrap this up in some nice helper function instead ...
@@ -177,9 +513,43 @@ int CMyImageList::getFileImage(LPCTSTR path)
     return cacheIcon(path, 0);
 }
 
+int CMyImageList::getDriveImage(LPCTSTR path)
+{
+    return lookupIcon(path, false, m_pendingFolderImage).image;
+}
+
+int CMyImageList::getDirectoryImage(LPCTSTR path, DWORD attributes)
+{
+    // Only read-only or system folders can be customized by a desktop.ini.
+    if(attributes == INVALID_FILE_ATTRIBUTES || (attributes & (FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_SYSTEM)) == 0)
+    {
+        return m_folderImage;
+    }
+
+    return lookupIcon(path, false, m_pendingFolderImage).image;
+}
+
+int CMyImageList::getFileItemImage(LPCTSTR path, LPCTSTR ext)
+{
+    const SIconCacheEntry& entry = lookupIcon(ext, true, m_pendingFileImage);
+    if(entry.pending || !entry.perFileIcon)
+    {
+        return entry.image;
+    }
+
+    return lookupIcon(path, false, m_pendingFileImage).image;
+}
+
 int CMyImageList::getExtImageAndDescription(LPCTSTR ext, CString& description)
 {
-    return cacheIcon(ext, SHGFI_USEFILEATTRIBUTES, &description);
+    const SIconCacheEntry& entry = lookupIcon(ext, true, m_pendingFileImage);
+    description = entry.typeName;
+    return entry.image;
+}
+
+bool CMyImageList::isPlaceholderImage(int image)
+{
+    return image == m_pendingFileImage || image == m_pendingFolderImage;
 }
 
 int CMyImageList::getFilesFolderImage()
@@ -25,12 +25,63 @@
 
 #include <common/wds_constants.h>
 
+//
+// CIconLookupThread. Calls SHGetFileInfo() for CMyImageList in the
+// background, because slow shell extensions and network paths would
+// otherwise stall the GUI thread. Each finished batch is announced by
+// posting s_lookupDoneMessage to the notification window.
+//
+class CIconLookupThread: public CWinThread
+{
+public:
+    static UINT s_lookupDoneMessage;
+
+    struct SRequest
+    {
+        CString key;        // Extension like ".txt" or full path
+        bool isExtension;   // Look up with SHGFI_USEFILEATTRIBUTES
+    };
+
+    struct SResult
+    {
+        CString key;
+        bool isExtension;
+        int systemImage;    // Index into the system image list, -1 on failure
+        CString typeName;
+        bool perFileIcon;   // Extension whose files carry their own icons (.exe, .ico, ...)
+    };
+
+    CIconLookupThread(HWND notify);
+    virtual BOOL InitInstance();
+
+    void AddRequest(const SRequest& request);
+    bool GetResult(SResult& result);
+    bool Stop(); // false, if the thread didn't terminate in time
+
+    static bool HasPerFileIcon(LPCTSTR ext);
+
+private:
+    const HWND m_notify;
+
+    CCriticalSection m_cs;  // for the members below
+    CList<SRequest, const SRequest&> m_requests;
+    CList<SResult, const SResult&> m_results;
+    bool m_stop;
+
+    CEvent m_wakeUp;        // auto-reset, signaled on new requests and on Stop()
+};
+
 //
 // CMyImageList. Both CDirstatView and CTypeView use this central
 // image list. It caches the system image list images as needed,
 // and adds a few special images at initialization.
 // This is because I don't want to deal with two images lists.
 //
+// Item and extension images are cached by extension (or by path, for
+// customized folders and files like .exe which have their own icons)
+// and looked up by a CIconLookupThread. Until the result arrives, the
+// placeholder images are returned.
+//
 class CMyImageList: public CImageList
 {
     static const UINT WDS_SHGFI_DEFAULTS = SHGFI_SYSICONINDEX | SHGFI_SMALLICON | SHGFI_ICON;
@@ -49,19 +100,55 @@ public:
     int getJunctionImage();
     int getFolderImage();
     int getFileImage(LPCTSTR path);
+
+    // Cached and looked up in the background
+    int getDriveImage(LPCTSTR path);
+    int getDirectoryImage(LPCTSTR path, DWORD attributes);
+    int getFileItemImage(LPCTSTR path, LPCTSTR ext);
     int getExtImageAndDescription(LPCTSTR ext, CString& description);
+    bool isPlaceholderImage(int image);
 
     int getFilesFolderImage();
     int getFreeSpaceImage();
     int getUnknownImage();
     int getEmptyImage();
 
+    // Called when s_lookupDoneMessage arrives. Returns true if any image has changed.
+    bool processLookupResults();
+    // Stops the lookup thread and saves the type names.
+    void shutdown();
+
 protected:
+    struct SIconCacheEntry
+    {
+        int image;          // Our index; a placeholder image while pending
+        CString typeName;
+        bool perFileIcon;
+        bool pending;
+    };
+    typedef CMap<CString, LPCTSTR, SIconCacheEntry, const SIconCacheEntry&> CIconCache;
+
     int cacheIcon(LPCTSTR path, UINT flags, CString *psTypeName = NULL);
+    int cacheSystemImage(int systemImage);
+    int addPlaceholderImage(int image);
+    const SIconCacheEntry& lookupIcon(LPCTSTR key, bool isExtension, int placeholder);
+    bool startLookupThread();
     CString getADriveSpec();
     void addCustomImages();
 
     CMap<int, int, int, int> m_indexMap;    // system image list index -> our index
+    HIMAGELIST m_systemImageList;
+
+    CIconCache m_iconCache;                 // ".txt" or path -> entry
+    CMapStringToString m_typeNames;         // ".txt" -> "Text Document", persistent
+    CStringArray m_storedExtensions;        // Of m_typeNames, as stored by the last session
+    CStringArray m_usedExtensions;          // Looked up in this session
+    CIconLookupThread *m_lookupThread;
+    bool m_synchronous;                     // No lookup thread (failed or shut down)
+
+    int m_folderImage;
+    int m_pendingFolderImage;   // Placeholders, look like the generic folder/file image
+    int m_pendingFileImage;
 
     int m_filesFolderImage; // <Files>
     int m_freeSpaceImage;   // <Free Space>
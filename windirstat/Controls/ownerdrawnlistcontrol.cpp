@@ -37,6 +37,8 @@ namespace
     const UINT LABEL_Y_MARGIN = 2;
 
     const UINT GENERAL_INDENT = 5;
+
+    const COLORREF GRID_COLOR = RGB(212,208,200);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -213,6 +215,13 @@ COwnerDrawnListControl::COwnerDrawnListControl(LPCTSTR name, int rowHeight)
     , m_yFirstItem(-1)
     , m_windowColor(CLR_NONE)
     , m_stripeColor(CLR_NONE)
+    , m_rowBitmapSize(0, 0)
+    , m_rowDCOldBitmap(NULL)
+    , m_rowDCOldFont(NULL)
+    , m_frameCacheValid(false)
+    , m_drawingIndex(-1)
+    , m_drawingItem(NULL)
+    , m_frameRows(0)
 {
     ASSERT(rowHeight > 0);
     InitializeColors();
@@ -220,6 +229,16 @@ COwnerDrawnListControl::COwnerDrawnListControl(LPCTSTR name, int rowHeight)
 
 COwnerDrawnListControl::~COwnerDrawnListControl()
 {
+    ReleaseRowDC();
+}
+
+double COwnerDrawnListControl::_lastFrameTime = 0;
+int COwnerDrawnListControl::_lastFrameRows = 0;
+
+void COwnerDrawnListControl::GetLastFrameStatistics(double& milliseconds, int& rows)
+{
+    milliseconds = _lastFrameTime;
+    rows = _lastFrameRows;
 }
 
 // This method MUST be called before the Control is shown.
@@ -235,6 +254,15 @@ void COwnerDrawnListControl::OnColumnsInserted()
         GetItemRect(0, rc, LVIR_BOUNDS);
         m_yFirstItem = rc.top;
     }
+    else if((GetStyle() & LVS_OWNERDATA) != 0)
+    {
+        // Virtual lists can't InsertItem(), so we pretend to have one item.
+        SetItemCountEx(1, LVSICF_NOSCROLL);
+        CRect rc;
+        GetItemRect(0, rc, LVIR_BOUNDS);
+        SetItemCountEx(0, LVSICF_NOSCROLL);
+        m_yFirstItem = rc.top;
+    }
     else
     {
         InsertItem(0, _T("_tmp"), 0);
@@ -250,6 +278,7 @@ void COwnerDrawnListControl::OnColumnsInserted()
 void COwnerDrawnListControl::SysColorChanged()
 {
     InitializeColors();
+    ReleaseRowDC();
 }
 
 int COwnerDrawnListControl::GetRowHeight()
@@ -344,7 +373,7 @@ bool COwnerDrawnListControl::IsItemStripeColor(int i)
 
 bool COwnerDrawnListControl::IsItemStripeColor(const COwnerDrawnListItem *item)
 {
-    return IsItemStripeColor(FindListItem(item));
+    return IsItemStripeColor(GetItemIndex(item));
 }
 
 COLORREF COwnerDrawnListControl::GetItemBackgroundColor(int i)
@@ -354,7 +383,7 @@ COLORREF COwnerDrawnListControl::GetItemBackgroundColor(int i)
 
 COLORREF COwnerDrawnListControl::GetItemBackgroundColor(const COwnerDrawnListItem *item)
 {
-    return GetItemBackgroundColor(FindListItem(item));
+    return GetItemBackgroundColor(GetItemIndex(item));
 }
 
 COLORREF COwnerDrawnListControl::GetItemSelectionBackgroundColor(int i)
@@ -372,7 +401,7 @@ COLORREF COwnerDrawnListControl::GetItemSelectionBackgroundColor(int i)
 
 COLORREF COwnerDrawnListControl::GetItemSelectionBackgroundColor(const COwnerDrawnListItem *item)
 {
-    return GetItemSelectionBackgroundColor(FindListItem(item));
+    return GetItemSelectionBackgroundColor(GetItemIndex(item));
 }
 
 COLORREF COwnerDrawnListControl::GetItemSelectionTextColor(int i)
@@ -416,6 +445,17 @@ int COwnerDrawnListControl::FindListItem(const COwnerDrawnListItem *item)
     return i;
 }
 
+// While a row is drawn, its item asks for its own index several times
+// (stripe and selection colors). FindListItem() is a linear search.
+int COwnerDrawnListControl::GetItemIndex(const COwnerDrawnListItem *item)
+{
+    if(item == m_drawingItem)
+    {
+        return m_drawingIndex;
+    }
+    return FindListItem(item);
+}
+
 void COwnerDrawnListControl::InitializeColors()
 {
     // I try to find a good contrast to COLOR_WINDOW (usually white or light grey).
@@ -446,86 +486,171 @@ void COwnerDrawnListControl::InitializeColors()
 
 void COwnerDrawnListControl::DrawItem(LPDRAWITEMSTRUCT pdis)
 {
-    COwnerDrawnListItem *item = (COwnerDrawnListItem *)(pdis->itemData);
+    // For virtual (LVS_OWNERDATA) lists itemData is always 0.
+    COwnerDrawnListItem *item = (pdis->itemData != 0)
+        ? (COwnerDrawnListItem *)(pdis->itemData)
+        : GetItem(pdis->itemID);
     CDC *pdc = CDC::FromHandle(pdis->hDC);
-    CRect rcItem(pdis->rcItem);
+    CRect rcRow(pdis->rcItem);
+    CRect rcItem = rcRow;
     if(m_showGrid)
     {
         rcItem.bottom--;
         rcItem.right--;
     }
 
-    CDC dcmem;
+    PrepareFrameCache();
+    CDC *pdcmem = GetRowDC(pdc, rcRow.Size());
 
-    dcmem.CreateCompatibleDC(pdc);
-    CBitmap bm;
-    bm.CreateCompatibleBitmap(pdc, rcItem.Width(), rcItem.Height());
-    CSelectObject sobm(&dcmem, &bm);
+    m_drawingIndex = pdis->itemID;
+    m_drawingItem = item;
+    m_frameRows++;
 
-    dcmem.FillSolidRect(rcItem - rcItem.TopLeft(), GetItemBackgroundColor(pdis->itemID));
+    // The whole row is drawn into the memory DC, including the grid lines,
+    // which OnEraseBkgnd() has drawn on the screen.
+    const COLORREF bgcolor = GetItemBackgroundColor(pdis->itemID);
+    pdcmem->FillSolidRect(rcRow - rcRow.TopLeft(), m_showGrid ? GRID_COLOR : bgcolor);
 
     bool drawFocus = (pdis->itemState & ODS_FOCUS) != 0 && HasFocus() && IsFullRowSelection();
+    bool selected = (pdis->itemState & ODS_SELECTED) && (HasFocus() || IsShowSelectionAlways()) && (IsFullRowSelection());
 
-    CArray<int, int> order;
-    order.SetSize(GetHeaderCtrl()->GetItemCount());
-    GetHeaderCtrl()->GetOrderArray(order.GetData(), int(order.GetSize()));
-
-    CRect rcFocus = rcItem;
+    CRect rcFocus = rcItem - rcRow.TopLeft();
     rcFocus.DeflateRect(0, LABEL_Y_MARGIN - 1);
 
-    for(int i = 0; i < order.GetSize(); i++)
+    CSetBkMode bk(pdcmem, TRANSPARENT);
+
+    for(int i = 0; i < m_columnOrder.GetSize(); i++)
     {
-        int subitem = order[i];
+        int subitem = m_columnOrder[i];
 
         CRect rc = GetWholeSubitemRect(pdis->itemID, subitem);
 
-        CRect rcDraw = rc - rcItem.TopLeft();
+        CRect rcDraw = rc - rcRow.TopLeft();
+        if(m_showGrid)
+        {
+            pdcmem->FillSolidRect(rcDraw, bgcolor);
+        }
 
         int focusLeft = rcDraw.left;
-        if(!item->DrawSubitem(subitem, &dcmem, rcDraw, pdis->itemState, NULL, &focusLeft))
+        if(!item->DrawSubitem(subitem, pdcmem, rcDraw, pdis->itemState, NULL, &focusLeft))
         {
-            item->DrawSelection(this, &dcmem, rcDraw, pdis->itemState);
+            item->DrawSelection(this, pdcmem, rcDraw, pdis->itemState);
 
             CRect rcText = rcDraw;
             rcText.DeflateRect(TEXT_X_MARGIN, 0);
-            CSetBkMode bk(&dcmem, TRANSPARENT);
-            CSelectObject sofont(&dcmem, GetFont());
             CString s = item->GetText(subitem);
-            UINT align = IsColumnRightAligned(subitem) ? DT_RIGHT : DT_LEFT;
+            UINT align = m_columnRightAligned[subitem] ? DT_RIGHT : DT_LEFT;
 
             // Get the correct color in case of compressed or encrypted items
             COLORREF textColor = item->GetItemTextColor();
 
             // Except if the item is selected - in this case just use standard colors
-            if((pdis->itemState & ODS_SELECTED) && (HasFocus() || IsShowSelectionAlways()) && (IsFullRowSelection()))
+            if(selected)
             {
                 textColor = GetItemSelectionTextColor(pdis->itemID);
             }
 
             // Set the text color
-            CSetTextColor tc(&dcmem, textColor);
+            CSetTextColor tc(pdcmem, textColor);
             // Draw the (sub)item text
-            dcmem.DrawText(s, rcText, DT_SINGLELINE | DT_VCENTER | DT_WORD_ELLIPSIS | DT_NOPREFIX | align);
-            // Test: dcmem.FillSolidRect(rcDraw, 0);
+            pdcmem->DrawText(s, rcText, DT_SINGLELINE | DT_VCENTER | DT_WORD_ELLIPSIS | DT_NOPREFIX | align);
         }
 
         if(focusLeft > rcDraw.left)
         {
             if(drawFocus && i > 0)
             {
-                pdc->DrawFocusRect(rcFocus);
+                pdcmem->DrawFocusRect(rcFocus);
             }
             rcFocus.left = focusLeft;
         }
         rcFocus.right = rcDraw.right;
-
-        pdc->BitBlt(rcItem.left + rcDraw.left, rcItem.top + rcDraw.top, rcDraw.Width(), rcDraw.Height(), &dcmem, rcDraw.left, rcDraw.top, SRCCOPY);
     }
 
     if(drawFocus)
     {
-        pdc->DrawFocusRect(rcFocus);
+        pdcmem->DrawFocusRect(rcFocus);
+    }
+
+    pdc->BitBlt(rcRow.left, rcRow.top, rcRow.Width(), rcRow.Height(), pdcmem, 0, 0, SRCCOPY);
+
+    m_drawingIndex = -1;
+    m_drawingItem = NULL;
+}
+
+// Reads the header information needed by DrawItem() once per frame.
+void COwnerDrawnListControl::PrepareFrameCache()
+{
+    if(m_frameCacheValid)
+    {
+        return;
+    }
+
+    const int count = GetHeaderCtrl()->GetItemCount();
+    m_columnOrder.SetSize(count);
+    GetHeaderCtrl()->GetOrderArray(m_columnOrder.GetData(), count);
+
+    m_columnRightAligned.SetSize(count);
+    for(int i = 0; i < count; i++)
+    {
+        m_columnRightAligned[i] = IsColumnRightAligned(i);
     }
+
+    m_frameCacheValid = true;
+}
+
+// Returns the memory DC for a row of the given size, with our font selected.
+// The bitmap is only re-created if it has to grow.
+CDC *COwnerDrawnListControl::GetRowDC(CDC *pdc, CSize size)
+{
+    if(m_rowDC.m_hDC == NULL)
+    {
+        VERIFY(m_rowDC.CreateCompatibleDC(pdc));
+    }
+
+    if(size.cx > m_rowBitmapSize.cx || size.cy > m_rowBitmapSize.cy)
+    {
+        if(m_rowDCOldBitmap != NULL)
+        {
+            ::SelectObject(m_rowDC, m_rowDCOldBitmap);
+        }
+        m_rowBitmap.DeleteObject();
+
+        m_rowBitmapSize.cx = max(size.cx, m_rowBitmapSize.cx);
+        m_rowBitmapSize.cy = max(size.cy, m_rowBitmapSize.cy);
+        VERIFY(m_rowBitmap.CreateCompatibleBitmap(pdc, m_rowBitmapSize.cx, m_rowBitmapSize.cy));
+
+        m_rowDCOldBitmap = ::SelectObject(m_rowDC, m_rowBitmap);
+    }
+
+    HGDIOBJ oldFont = ::SelectObject(m_rowDC, GetFont()->GetSafeHandle());
+    if(m_rowDCOldFont == NULL)
+    {
+        m_rowDCOldFont = oldFont;
+    }
+
+    return &m_rowDC;
+}
+
+void COwnerDrawnListControl::ReleaseRowDC()
+{
+    if(m_rowDC.m_hDC == NULL)
+    {
+        return;
+    }
+    if(m_rowDCOldBitmap != NULL)
+    {
+        ::SelectObject(m_rowDC, m_rowDCOldBitmap);
+        m_rowDCOldBitmap = NULL;
+    }
+    if(m_rowDCOldFont != NULL)
+    {
+        ::SelectObject(m_rowDC, m_rowDCOldFont);
+        m_rowDCOldFont = NULL;
+    }
+    m_rowBitmap.DeleteObject();
+    m_rowBitmapSize = CSize(0, 0);
+    m_rowDC.DeleteDC();
 }
 
 bool COwnerDrawnListControl::IsColumnRightAligned(int col)
@@ -608,6 +733,7 @@ int COwnerDrawnListControl::GetSubItemWidth(COwnerDrawnListItem *item, int subit
 
 
 BEGIN_MESSAGE_MAP(COwnerDrawnListControl, CSortingListControl)
+    ON_WM_PAINT()
     ON_WM_ERASEBKGND()
 #pragma warning(suppress: 26454)
     ON_NOTIFY(HDN_DIVIDERDBLCLICKA, 0, OnHdnDividerdblclick)
@@ -621,6 +747,31 @@ BEGIN_MESSAGE_MAP(COwnerDrawnListControl, CSortingListControl)
     ON_WM_SHOWWINDOW()
 END_MESSAGE_MAP()
 
+// The list control paints itself (calling DrawItem() for each row). We only
+// start a new frame for the paint cache and measure the time it takes.
+void COwnerDrawnListControl::OnPaint()
+{
+    static LARGE_INTEGER frequency;
+    if(frequency.QuadPart == 0)
+    {
+        ::QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER start;
+    ::QueryPerformanceCounter(&start);
+
+    m_frameCacheValid = false;
+    m_frameRows = 0;
+
+    Default();
+
+    LARGE_INTEGER end;
+    ::QueryPerformanceCounter(&end);
+
+    _lastFrameTime = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+    _lastFrameRows = m_frameRows;
+}
+
 BOOL COwnerDrawnListControl::OnEraseBkgnd(CDC* pDC)
 {
     int i = 0;
@@ -637,8 +788,6 @@ BOOL COwnerDrawnListControl::OnEraseBkgnd(CDC* pDC)
     // else: if we did the same thing as in OnColumnsCreated(), we get
     // repaint problems.
 
-    const COLORREF gridColor = RGB(212,208,200);
-
     CRect rcClient;
     GetClientRect(rcClient);
 
@@ -649,7 +798,7 @@ BOOL COwnerDrawnListControl::OnEraseBkgnd(CDC* pDC)
     CRect rcBetween = rcClient; // between header and first item
     rcBetween.top = rcHeader.bottom;
     rcBetween.bottom = m_yFirstItem;
-    pDC->FillSolidRect(rcBetween, gridColor);
+    pDC->FillSolidRect(rcBetween, GRID_COLOR);
 
     CArray<int, int> columnOrder;
     columnOrder.SetSize(GetHeaderCtrl()->GetItemCount());
@@ -671,7 +820,7 @@ BOOL COwnerDrawnListControl::OnEraseBkgnd(CDC* pDC)
 
     if(m_showGrid)
     {
-        CPen pen(PS_SOLID, 1, gridColor);
+        CPen pen(PS_SOLID, 1, GRID_COLOR);
         CSelectObject sopen(pDC, &pen);
 
         for(int y = m_yFirstItem + GetRowHeight() - 1; y < rcClient.bottom; y += GetRowHeight())
@@ -779,6 +928,7 @@ void COwnerDrawnListControl::OnHdnItemchanging(NMHDR * /*pNMHDR*/, LRESULT *pRes
 {
     // Unused: LPNMHEADER phdr = reinterpret_cast<LPNMHEADER>(pNMHDR);
     Default();
+    m_frameCacheValid = false;
     InvalidateRect(NULL);
 
     *pResult = 0;
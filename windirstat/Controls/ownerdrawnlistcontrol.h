@@ -64,6 +64,8 @@ protected:
 //
 // COwnerDrawnListControl. Must be report view. Deals with COwnerDrawnListItems.
 // Can have a grid or not (own implementation, don't set LVS_EX_GRIDLINES). Flicker-free.
+// Each row is drawn into a memory DC, which is kept for all rows of all frames,
+// and copied to the screen with a single BitBlt().
 //
 class COwnerDrawnListControl: public CSortingListControl
 {
@@ -95,8 +97,8 @@ public:
     COLORREF GetItemSelectionBackgroundColor(const COwnerDrawnListItem *item);
     COLORREF GetItemSelectionTextColor(int i);
 
-    COwnerDrawnListItem *GetItem(int i);
-    int FindListItem(const COwnerDrawnListItem *item);
+    virtual COwnerDrawnListItem *GetItem(int i);
+    virtual int FindListItem(const COwnerDrawnListItem *item);
     int GetTextXMargin();
     int GetGeneralLeftIndent();
     void AdjustColumnWidth(int col);
@@ -105,11 +107,18 @@ public:
     bool HasFocus();
     bool IsShowSelectionAlways();
 
+    // Duration and number of rows of the last WM_PAINT of any list
+    static void GetLastFrameStatistics(double& milliseconds, int& rows);
+
 protected:
     void InitializeColors();
     virtual void DrawItem(LPDRAWITEMSTRUCT pdis);
     int GetSubItemWidth(COwnerDrawnListItem *item, int subitem);
     bool IsColumnRightAligned(int col);
+    int GetItemIndex(const COwnerDrawnListItem *item);
+    CDC *GetRowDC(CDC *pdc, CSize size);
+    void PrepareFrameCache();
+    void ReleaseRowDC();
 
     int m_rowHeight;                // Height of an item
     bool m_showGrid;                // Whether to draw a grid
@@ -119,7 +128,24 @@ protected:
     COLORREF m_windowColor;         // The default background color if !m_showStripes
     COLORREF m_stripeColor;         // The stripe color, used for every other item if m_showStripes
 
+    // GDI objects and header information cached while painting
+    CDC m_rowDC;                    // Memory DC the rows are drawn into
+    CBitmap m_rowBitmap;            // Selected into m_rowDC, only grows
+    CSize m_rowBitmapSize;          // Size of m_rowBitmap
+    HGDIOBJ m_rowDCOldBitmap;       // To be restored before m_rowBitmap is deleted
+    HGDIOBJ m_rowDCOldFont;         // dto. for the font
+    bool m_frameCacheValid;         // false: m_columnOrder etc. have to be re-read for this frame
+    CArray<int, int> m_columnOrder; // Header order of the columns
+    CArray<bool, bool> m_columnRightAligned;
+    int m_drawingIndex;             // Index of the row currently drawn, or -1
+    const COwnerDrawnListItem *m_drawingItem; // Item of that row (saves FindListItem())
+    int m_frameRows;                // Rows drawn in the current frame
+
+    static double _lastFrameTime;   // Milliseconds of the last WM_PAINT
+    static int _lastFrameRows;      // Rows drawn in the last WM_PAINT
+
     DECLARE_MESSAGE_MAP()
+    afx_msg void OnPaint();
     afx_msg BOOL OnEraseBkgnd(CDC* pDC);
     afx_msg void OnHdnDividerdblclick(NMHDR *pNMHDR, LRESULT *pResult);
     afx_msg void OnVScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar);
@@ -114,8 +114,7 @@ void CPacman::Draw(CDC *pdc, const CRect& rect)
     rc.left = left;
     rc.right = left + diameter;
 
-    CPen pen(PS_SOLID, 1, RGB(0,0,0));
-    CSelectObject sopen(pdc, &pen);
+    CSelectStockObject sopen(pdc, BLACK_PEN);
 
     CBrush brush(CalculateColor());
     CSelectObject sobrush(pdc, &brush);
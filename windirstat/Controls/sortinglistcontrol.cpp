@@ -205,6 +205,13 @@ void CSortingListControl::SortItems()
 {
     VERIFY(CListCtrl::SortItems(&_CompareFunc, (DWORD_PTR)&m_sorting));
 
+    IndicateSorting();
+}
+
+// Adds the "< " or "> " to the header item of the current sort column
+// and removes it from the previously indicated one.
+void CSortingListControl::IndicateSorting()
+{
     HDITEM hditem;
     ZeroMemory(&hditem, sizeof(hditem));
 
@@ -279,7 +286,11 @@ void CSortingListControl::OnLvnGetdispinfo(NMHDR *pNMHDR, LRESULT *pResult)
     NMLVDISPINFO *di = reinterpret_cast<NMLVDISPINFO*>(pNMHDR);
     *pResult = 0;
 
-    CSortingListItem *item = (CSortingListItem *)(di->item.lParam);
+    // Virtual (LVS_OWNERDATA) lists don't store any lParam,
+    // so we have to ask the derived class for the item.
+    CSortingListItem *item = (GetStyle() & LVS_OWNERDATA) != 0
+        ? GetSortingListItem(di->item.iItem)
+        : (CSortingListItem *)(di->item.lParam);
 
     if((di->item.mask & LVIF_TEXT) != 0)
     {
@@ -129,9 +129,15 @@ CString CExtensionListControl::CListItem::GetExtension() const
     return m_extension;
 }
 
+// Updates the statistics. Image and description stay cached.
+void CExtensionListControl::CListItem::SetRecord(const SExtensionRecord& r)
+{
+    m_record = r;
+}
+
 int CExtensionListControl::CListItem::GetImage() const
 {
-    if(m_image == -1)
+    if(m_image == -1 || GetMyImageList()->isPlaceholderImage(m_image))
     {
         m_image = GetMyImageList()->getExtImageAndDescription(m_extension, m_description);
     }
@@ -218,7 +224,7 @@ BEGIN_MESSAGE_MAP(CExtensionListControl, COwnerDrawnListControl)
     ON_WM_MEASUREITEM_REFLECT()
     ON_WM_DESTROY()
 #pragma warning(suppress: 26454)
-    ON_NOTIFY_REFLECT(LVN_DELETEITEM, OnLvnDeleteitem)
+    ON_NOTIFY_REFLECT(LVN_ODFINDITEM, OnLvnOdfinditem)
     ON_WM_SETFOCUS()
 #pragma warning(suppress: 26454)
     ON_NOTIFY_REFLECT(LVN_ITEMCHANGED, OnLvnItemchanged)
@@ -232,6 +238,11 @@ CExtensionListControl::CExtensionListControl(CTypeView *typeView)
     m_rootSize = 0;
 }
 
+CExtensionListControl::~CExtensionListControl()
+{
+    DeleteListItems();
+}
+
 bool CExtensionListControl::GetAscendingDefault(int column)
 {
     switch (column)
@@ -278,14 +289,65 @@ void CExtensionListControl::Initialize()
 
 void CExtensionListControl::OnDestroy()
 {
+    RemoveAllListItems();
     COwnerDrawnListControl::OnDestroy();
 }
 
+CSortingListItem *CExtensionListControl::GetSortingListItem(int i)
+{
+    return GetListItem(i);
+}
+
+COwnerDrawnListItem *CExtensionListControl::GetItem(int i)
+{
+    return GetListItem(i);
+}
+
+int CExtensionListControl::FindListItem(const COwnerDrawnListItem *item)
+{
+    for(int i = 0; i < m_items.GetSize(); i++)
+    {
+        if(m_items[i] == item)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// We sort our index array instead of the list control's items.
+void CExtensionListControl::SortItems()
+{
+    // The control keeps the selection by index, so we have to restore it.
+    CString selected = GetSelectedExtension();
+
+    SortListItems();
+    SelectExtension(selected);
+}
+
+void CExtensionListControl::SortListItems()
+{
+    _pqsortSorting = &GetSorting();
+    qsort(m_items.GetData(), m_items.GetSize(), sizeof(CListItem *), &_compareListItems);
+    _pqsortSorting = NULL;
+
+    IndicateSorting();
+    InvalidateRect(NULL);
+}
+
+// Updates the list with new extension statistics.
+// Items which already exist are updated in place, so their cached
+// image and description survive. Only new extensions allocate an item.
 void CExtensionListControl::SetExtensionData(const CExtensionData *ed)
 {
-    DeleteAllItems();
+    CString selected = GetSelectedExtension();
+
+    if(m_itemsByExtension.IsEmpty())
+    {
+        // Roughly 1.2 times the number of extensions
+        m_itemsByExtension.InitHashTable(UINT(ed->GetCount() * 6 / 5) + 17);
+    }
 
-    int i = 0;
     POSITION pos = ed->GetStartPosition();
     while(pos != NULL)
     {
@@ -293,11 +355,74 @@ void CExtensionListControl::SetExtensionData(const CExtensionData *ed)
         SExtensionRecord r;
         ed->GetNextAssoc(pos, ext, r);
 
-        CListItem *item = new CListItem(this, ext, r);
-        InsertListItem(i++, item);
+        CListItem *item;
+        if(m_itemsByExtension.Lookup(ext, item))
+        {
+            item->SetRecord(r);
+        }
+        else
+        {
+            m_itemsByExtension.SetAt(ext, new CListItem(this, ext, r));
+        }
+    }
+
+    // Remove the items whose extensions have vanished
+    if(m_itemsByExtension.GetCount() > ed->GetCount())
+    {
+        CStringArray vanished;
+        pos = m_itemsByExtension.GetStartPosition();
+        while(pos != NULL)
+        {
+            CString ext;
+            CListItem *item;
+            m_itemsByExtension.GetNextAssoc(pos, ext, item);
+
+            SExtensionRecord r;
+            if(!ed->Lookup(ext, r))
+            {
+                vanished.Add(ext);
+                delete item;
+            }
+        }
+        for(int i = 0; i < vanished.GetSize(); i++)
+        {
+            m_itemsByExtension.RemoveKey(vanished[i]);
+        }
     }
 
-    SortItems();
+    // Rebuild the index array
+    m_items.SetSize(m_itemsByExtension.GetCount());
+    int i = 0;
+    pos = m_itemsByExtension.GetStartPosition();
+    while(pos != NULL)
+    {
+        CString ext;
+        m_itemsByExtension.GetNextAssoc(pos, ext, m_items[i++]);
+    }
+
+    SetItemState(-1, 0, LVIS_SELECTED);
+    SetItemCountEx(int(m_items.GetSize()), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+    SortListItems();
+    SelectExtension(selected);
+}
+
+void CExtensionListControl::RemoveAllListItems()
+{
+    if(::IsWindow(m_hWnd))
+    {
+        SetItemCount(0);
+    }
+    DeleteListItems();
+}
+
+void CExtensionListControl::DeleteListItems()
+{
+    for(int i = 0; i < m_items.GetSize(); i++)
+    {
+        delete m_items[i];
+    }
+    m_items.RemoveAll();
+    m_itemsByExtension.RemoveAll();
 }
 
 void CExtensionListControl::SetRootSize(ULONGLONG totalBytes)
@@ -312,6 +437,11 @@ ULONGLONG CExtensionListControl::GetRootSize()
 
 void CExtensionListControl::SelectExtension(LPCTSTR ext)
 {
+    if(ext[0] == _T('\0'))
+    {
+        return;
+    }
+
     int i = 0;
     for(i = 0; i < GetItemCount(); i++)
     {
@@ -344,14 +474,57 @@ CString CExtensionListControl::GetSelectedExtension()
 
 CExtensionListControl::CListItem *CExtensionListControl::GetListItem(int i)
 {
-    return (CListItem *)GetItemData(i);
+    ASSERT(i >= 0 && i < m_items.GetSize());
+    return m_items[i];
 }
 
-void CExtensionListControl::OnLvnDeleteitem(NMHDR *pNMHDR, LRESULT *pResult)
+const SSorting *CExtensionListControl::_pqsortSorting;
+
+int __cdecl CExtensionListControl::_compareListItems(const void *p1, const void *p2)
 {
-    LPNMLISTVIEW lv = reinterpret_cast<LPNMLISTVIEW>(pNMHDR);
-    delete (CListItem *)(lv->lParam);
-    *pResult = 0;
+    const CListItem *item1 = *(const CListItem **)p1;
+    const CListItem *item2 = *(const CListItem **)p2;
+    return item1->CompareS(item2, *_pqsortSorting);
+}
+
+// Keyboard search in the virtual list: find the next extension beginning with the typed text.
+void CExtensionListControl::OnLvnOdfinditem(NMHDR *pNMHDR, LRESULT *pResult)
+{
+    LPNMLVFINDITEM pFindInfo = reinterpret_cast<LPNMLVFINDITEM>(pNMHDR);
+    *pResult = -1;
+
+    if((pFindInfo->lvfi.flags & LVFI_STRING) == 0 || m_items.GetSize() == 0)
+    {
+        return;
+    }
+
+    const CString search = pFindInfo->lvfi.psz;
+    const int count = int(m_items.GetSize());
+    const int start = (pFindInfo->iStart >= 0 && pFindInfo->iStart < count) ? pFindInfo->iStart : 0;
+
+    for(int n = 0; n < count; n++)
+    {
+        int i = start + n;
+        if(i >= count)
+        {
+            if((pFindInfo->lvfi.flags & LVFI_WRAP) == 0)
+            {
+                break;
+            }
+            i -= count;
+        }
+
+        CString ext = m_items[i]->GetExtension();
+        if((pFindInfo->lvfi.flags & (LVFI_PARTIAL | LVFI_SUBSTRING)) != 0)
+        {
+            ext = ext.Left(search.GetLength());
+        }
+        if(ext.CompareNoCase(search) == 0)
+        {
+            *pResult = i;
+            return;
+        }
+    }
 }
 
 void CExtensionListControl::MeasureItem(LPMEASUREITEMSTRUCT mis)
@@ -451,7 +624,7 @@ int CTypeView::OnCreate(LPCREATESTRUCT lpCreateStruct)
     }
 
     RECT rect = { 0, 0, 0, 0 };
-    VERIFY(m_extensionListControl.Create(LVS_SINGLESEL | LVS_OWNERDRAWFIXED | LVS_SHOWSELALWAYS | WS_CHILD | WS_VISIBLE | LVS_REPORT, rect, this, _nIdExtensionListControl));
+    VERIFY(m_extensionListControl.Create(LVS_SINGLESEL | LVS_OWNERDRAWFIXED | LVS_OWNERDATA | LVS_SHOWSELALWAYS | WS_CHILD | WS_VISIBLE | LVS_REPORT, rect, this, _nIdExtensionListControl));
     m_extensionListControl.SetExtendedStyle(m_extensionListControl.GetExtendedStyle() | LVS_EX_HEADERDRAGDROP);
 
     m_extensionListControl.ShowGrid(GetOptions()->IsListGrid());
@@ -484,7 +657,7 @@ void CTypeView::OnUpdate(CView * /*pSender*/, LPARAM lHint, CObject *)
         }
         else
         {
-            m_extensionListControl.DeleteAllItems();
+            m_extensionListControl.RemoveAllListItems();
         }
 
         // fall through
@@ -506,6 +679,12 @@ void CTypeView::OnUpdate(CView * /*pSender*/, LPARAM lHint, CObject *)
         }
         break;
 
+    case HINT_ICONSCHANGED:
+        {
+            m_extensionListControl.InvalidateRect(NULL);
+        }
+        break;
+
     case HINT_TREEMAPSTYLECHANGED:
         {
             InvalidateRect(NULL);
@@ -54,6 +54,7 @@ protected:
         virtual CString GetText(int subitem) const;
 
         CString GetExtension() const;
+        void SetRecord(const SExtensionRecord& r);
         int GetImage() const;
         int Compare(const CSortingListItem *other, int subitem) const;
 
@@ -74,9 +75,15 @@ protected:
 
 public:
     CExtensionListControl(CTypeView *typeView);
+    virtual ~CExtensionListControl();
     virtual bool GetAscendingDefault(int column);
+    virtual CSortingListItem *GetSortingListItem(int i);
+    virtual COwnerDrawnListItem *GetItem(int i);
+    virtual int FindListItem(const COwnerDrawnListItem *item);
+    virtual void SortItems();
     void Initialize();
     void SetExtensionData(const CExtensionData *ed);
+    void RemoveAllListItems();
     void SetRootSize(ULONGLONG totalBytes);
     ULONGLONG GetRootSize();
     void SelectExtension(LPCTSTR ext);
@@ -84,13 +91,24 @@ public:
 
 protected:
     CListItem *GetListItem(int i);
+    void SortListItems();
+    void DeleteListItems();
+    static const SSorting *_pqsortSorting;
+    static int __cdecl _compareListItems(const void *p1, const void *p2);
 
     CTypeView *m_typeView;
     ULONGLONG m_rootSize;
 
+    // This is a virtual (LVS_OWNERDATA) list. The control only knows the item count,
+    // m_items is the sorted index array which maps list indices to items.
+    CArray<CListItem *, CListItem *> m_items;
+    // The same items keyed by extension, so that SetExtensionData()
+    // can update them in place (keeping cached icons and descriptions).
+    CMap<CString, LPCTSTR, CListItem *, CListItem *> m_itemsByExtension;
+
     DECLARE_MESSAGE_MAP()
     afx_msg void OnDestroy();
-    afx_msg void OnLvnDeleteitem(NMHDR *pNMHDR, LRESULT *pResult);
+    afx_msg void OnLvnOdfinditem(NMHDR *pNMHDR, LRESULT *pResult);
     afx_msg void MeasureItem(LPMEASUREITEMSTRUCT mis);
     afx_msg void OnSetFocus(CWnd* pOldWnd);
     afx_msg void OnLvnItemchanged(NMHDR *pNMHDR, LRESULT *pResult);
@@ -0,0 +1,180 @@
+// CleanupProgressDlg.cpp - Implementation of CCleanupProgressDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "dirstatdoc.h"
+#include <common/mdexceptions.h>
+#include <common/commonhelpers.h>
+#include "CleanupProgressDlg.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const UINT_PTR TIMER_ID = 1;
+    const UINT POLL_INTERVAL = 200; // ms
+}
+
+IMPLEMENT_DYNAMIC(CCleanupProgressDlg, CDialog)
+
+CCleanupProgressDlg::CCleanupProgressDlg(LPCTSTR title, REFRESHPOLICY refreshPolicy, LPCTSTR refreshPath)
+    : CDialog(CCleanupProgressDlg::IDD, NULL)
+    , m_title(title)
+    , m_refreshPolicy(refreshPolicy)
+    , m_refreshPath(refreshPath)
+    , m_failuresShown(0)
+    , m_done(false)
+{
+}
+
+CCleanupProgressDlg::~CCleanupProgressDlg()
+{
+}
+
+CCleanupExecutor *CCleanupProgressDlg::GetExecutor()
+{
+    return &m_executor;
+}
+
+void CCleanupProgressDlg::Run(int concurrency)
+{
+    VERIFY(Create(IDD, AfxGetMainWnd()));
+
+    m_executor.Start(concurrency);
+    SetTimer(TIMER_ID, POLL_INTERVAL, NULL);
+
+    ShowWindow(SW_SHOW);
+}
+
+void CCleanupProgressDlg::DoDataExchange(CDataExchange* pDX)
+{
+    CDialog::DoDataExchange(pDX);
+    DDX_Control(pDX, IDC_CLEANUPPROGRESS, m_progress);
+    DDX_Control(pDX, IDC_FAILURES, m_failures);
+}
+
+
+BEGIN_MESSAGE_MAP(CCleanupProgressDlg, CDialog)
+    ON_WM_TIMER()
+END_MESSAGE_MAP()
+
+
+BOOL CCleanupProgressDlg::OnInitDialog()
+{
+    CDialog::OnInitDialog();
+
+    SetWindowText(m_title);
+    m_progress.SetRange32(0, m_executor.GetJobCount());
+
+    return TRUE;
+}
+
+void CCleanupProgressDlg::OnOK()
+{
+    // No default button. Don't close on Return.
+}
+
+void CCleanupProgressDlg::OnCancel()
+{
+    if(m_done)
+    {
+        DestroyWindow();
+    }
+    else
+    {
+        // Update() will notice.
+        m_executor.Cancel();
+    }
+}
+
+void CCleanupProgressDlg::PostNcDestroy()
+{
+    // The destructor of m_executor waits for the worker thread.
+    delete this;
+}
+
+void CCleanupProgressDlg::OnTimer(UINT_PTR /*nIDEvent*/)
+{
+    Update();
+}
+
+void CCleanupProgressDlg::Update()
+{
+    if(m_done)
+    {
+        return;
+    }
+
+    // Query this first, so that the progress below is final.
+    const bool done = m_executor.IsDone();
+
+    int finished, running, failed, cancelled;
+    m_executor.GetProgress(finished, running, failed, cancelled);
+
+    m_progress.SetPos(finished + cancelled);
+
+    for(; m_failuresShown < failed; m_failuresShown++)
+    {
+        int i = m_executor.GetFailure(m_failuresShown);
+
+        DWORD result;
+        CCleanupExecutor::JOBSTATE state = m_executor.GetJobState(i, result);
+
+        CString s;
+        if(state == CCleanupExecutor::JS_FAILED)
+        {
+            s.FormatMessage(IDS_COULDNOTSTARTINss, m_executor.GetJobDirectory(i).GetString(), MdGetWinErrorText(result).GetString());
+        }
+        else
+        {
+            s.FormatMessage(IDS_EXITCODEdINs, (int)result, m_executor.GetJobDirectory(i).GetString());
+        }
+        m_failures.AddString(s);
+    }
+
+    const int total = m_executor.GetJobCount();
+    CString status;
+
+    if(!done)
+    {
+        status.FormatMessage(IDS_CLEANUPPROGRESSddd, finished, total, running);
+        SetDlgItemText(IDC_CLEANUPSTATUS, status);
+        return;
+    }
+
+    m_done = true;
+    KillTimer(TIMER_ID);
+
+    status.FormatMessage(cancelled > 0 ? IDS_CLEANUPCANCELLEDddd : IDS_CLEANUPDONEddd, finished, total, failed);
+    SetDlgItemText(IDC_CLEANUPSTATUS, status);
+    SetDlgItemText(IDCANCEL, LoadString(IDS_CLOSE));
+
+    // The tree may have changed meanwhile, so the item is looked up by its path.
+    GetDocument()->RefreshAfterUserDefinedCleanup(m_refreshPolicy, m_refreshPath);
+
+    if(failed == 0 && cancelled == 0)
+    {
+        DestroyWindow();
+    }
+}
@@ -0,0 +1,70 @@
+// CleanupProgressDlg.h - Declaration of CCleanupProgressDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include "cleanupexecutor.h"
+#include "options.h"
+
+//
+// CCleanupProgressDlg. Modeless dialog, which runs a user defined cleanup
+// with a CCleanupExecutor in the background, shows its progress and the
+// failed commands, and refreshes the tree when it has finished.
+// Closes itself, if all commands succeeded. Deletes itself.
+//
+class CCleanupProgressDlg : public CDialog
+{
+    DECLARE_DYNAMIC(CCleanupProgressDlg)
+    enum { IDD = IDD_CLEANUPPROGRESS };
+
+public:
+    // refreshPath is the lower case path of the item the cleanup was called for.
+    CCleanupProgressDlg(LPCTSTR title, REFRESHPOLICY refreshPolicy, LPCTSTR refreshPath);
+    virtual ~CCleanupProgressDlg();
+
+    // For adding the jobs before Run()
+    CCleanupExecutor *GetExecutor();
+
+    // Creates the dialog and starts the executor.
+    void Run(int concurrency);
+
+protected:
+    virtual void DoDataExchange(CDataExchange* pDX);
+    virtual BOOL OnInitDialog();
+    virtual void OnOK();
+    virtual void OnCancel();
+    virtual void PostNcDestroy();
+    void Update();
+
+    const CString m_title;
+    const REFRESHPOLICY m_refreshPolicy;
+    const CString m_refreshPath;
+
+    CCleanupExecutor m_executor;
+    int m_failuresShown;    // Failures already in m_failures
+    bool m_done;
+
+    CProgressCtrl m_progress;
+    CListBox m_failures;
+
+    DECLARE_MESSAGE_MAP()
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
+};
@@ -0,0 +1,183 @@
+// DeleteProgressDlg.cpp - Implementation of CDeleteProgressDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "dirstatdoc.h"
+#include "globalhelpers.h"
+#include <common/mdexceptions.h>
+#include <common/commonhelpers.h>
+#include "DeleteProgressDlg.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const UINT_PTR TIMER_ID = 1;
+    const UINT POLL_INTERVAL = 200; // ms
+}
+
+IMPLEMENT_DYNAMIC(CDeleteProgressDlg, CDialog)
+
+CDeleteProgressDlg::CDeleteProgressDlg(ULONGLONG items)
+    : CDialog(CDeleteProgressDlg::IDD, NULL)
+    , m_items(items)
+    , m_rootsRefreshed(0)
+    , m_errorsShown(0)
+    , m_done(false)
+{
+}
+
+CDeleteProgressDlg::~CDeleteProgressDlg()
+{
+}
+
+CDeletionEngine *CDeleteProgressDlg::GetEngine()
+{
+    return &m_engine;
+}
+
+void CDeleteProgressDlg::Run(int threads)
+{
+    VERIFY(Create(IDD, AfxGetMainWnd()));
+
+    m_engine.Start(threads);
+    SetTimer(TIMER_ID, POLL_INTERVAL, NULL);
+
+    ShowWindow(SW_SHOW);
+}
+
+void CDeleteProgressDlg::DoDataExchange(CDataExchange* pDX)
+{
+    CDialog::DoDataExchange(pDX);
+    DDX_Control(pDX, IDC_CLEANUPPROGRESS, m_progress);
+    DDX_Control(pDX, IDC_FAILURES, m_failures);
+}
+
+
+BEGIN_MESSAGE_MAP(CDeleteProgressDlg, CDialog)
+    ON_WM_TIMER()
+END_MESSAGE_MAP()
+
+
+BOOL CDeleteProgressDlg::OnInitDialog()
+{
+    CDialog::OnInitDialog();
+
+    m_progress.SetRange32(0, (int)min(m_items, (ULONGLONG)INT_MAX));
+
+    return TRUE;
+}
+
+void CDeleteProgressDlg::OnOK()
+{
+    // No default button. Don't close on Return.
+}
+
+void CDeleteProgressDlg::OnCancel()
+{
+    if(m_done)
+    {
+        DestroyWindow();
+    }
+    else
+    {
+        // Update() will notice.
+        m_engine.Cancel();
+    }
+}
+
+void CDeleteProgressDlg::PostNcDestroy()
+{
+    // The destructor of m_engine waits for the worker threads.
+    delete this;
+}
+
+void CDeleteProgressDlg::OnTimer(UINT_PTR /*nIDEvent*/)
+{
+    Update();
+}
+
+void CDeleteProgressDlg::Update()
+{
+    if(m_done)
+    {
+        return;
+    }
+
+    // Query this first, so that the progress below is final.
+    const bool done = m_engine.IsDone();
+
+    CDeletionEngine::PROGRESS progress;
+    m_engine.GetProgress(progress);
+
+    const ULONGLONG deleted = progress.files + progress.directories;
+    m_progress.SetPos((int)min(deleted, (ULONGLONG)INT_MAX));
+
+    for(; (ULONGLONG)m_errorsShown < progress.errors; m_errorsShown++)
+    {
+        CString path;
+        DWORD error;
+        m_engine.GetError(m_errorsShown, path, error);
+
+        CString s;
+        s.FormatMessage(IDS_COULDNOTDELETEss, path.GetString(), MdGetWinErrorText(error).GetString());
+        m_failures.AddString(s);
+    }
+
+    // The tree may have changed meanwhile, so the items are looked up by their paths.
+    const int finished = m_engine.GetFinishedRootCount();
+    for(; m_rootsRefreshed < finished; m_rootsRefreshed++)
+    {
+        CString path = m_engine.GetRootPath(m_engine.GetFinishedRoot(m_rootsRefreshed));
+        path.MakeLower();
+        GetDocument()->RefreshAfterUserDefinedCleanup(RP_ASSUME_ENTRY_HAS_BEEN_DELETED, path);
+    }
+
+    const ULONGLONG perSecond = deleted * 1000 / max(progress.milliseconds, (DWORD)1);
+
+    UINT format = IDS_DELETINGssss;
+    if(done)
+    {
+        format = m_engine.IsCancelled() ? IDS_DELETECANCELLEDssss : IDS_DELETEDssss;
+    }
+
+    CString status;
+    status.FormatMessage(format, FormatCount(progress.files).GetString(), FormatCount(progress.directories).GetString(), FormatBytes(progress.bytes).GetString(), FormatCount(perSecond).GetString());
+    SetDlgItemText(IDC_CLEANUPSTATUS, status);
+
+    if(!done)
+    {
+        return;
+    }
+
+    m_done = true;
+    KillTimer(TIMER_ID);
+
+    SetDlgItemText(IDCANCEL, LoadString(IDS_CLOSE));
+
+    if(progress.errors == 0 && format == IDS_DELETEDssss)
+    {
+        DestroyWindow();
+    }
+}
@@ -0,0 +1,69 @@
+// DeleteProgressDlg.h - Declaration of CDeleteProgressDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include "deletionengine.h"
+
+//
+// CDeleteProgressDlg. Modeless dialog, which permanently deletes the
+// selected items with a CDeletionEngine in the background, shows the
+// progress and throughput and the entries which could not be deleted.
+// Removes each item from the tree as soon as it is gone.
+// Closes itself, if there were no errors. Deletes itself.
+//
+class CDeleteProgressDlg : public CDialog
+{
+    DECLARE_DYNAMIC(CDeleteProgressDlg)
+    enum { IDD = IDD_DELETEPROGRESS };
+
+public:
+    // items is the number of files and directories to be deleted, for the progress bar.
+    CDeleteProgressDlg(ULONGLONG items);
+    virtual ~CDeleteProgressDlg();
+
+    // For adding the roots before Run()
+    CDeletionEngine *GetEngine();
+
+    // Creates the dialog and starts the engine.
+    void Run(int threads);
+
+protected:
+    virtual void DoDataExchange(CDataExchange* pDX);
+    virtual BOOL OnInitDialog();
+    virtual void OnOK();
+    virtual void OnCancel();
+    virtual void PostNcDestroy();
+    void Update();
+
+    const ULONGLONG m_items;
+
+    CDeletionEngine m_engine;
+    int m_rootsRefreshed;   // Finished roots already removed from the tree
+    int m_errorsShown;      // Errors already in m_failures
+    bool m_done;
+
+    CProgressCtrl m_progress;
+    CListBox m_failures;
+
+    DECLARE_MESSAGE_MAP()
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
+};
@@ -0,0 +1,99 @@
+// ScanStatisticsDlg.cpp - Implementation of CScanStatisticsDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "scanstats.h"
+#include <common/commonhelpers.h>
+#include "ScanStatisticsDlg.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+IMPLEMENT_DYNAMIC(CScanStatisticsDlg, CDialog)
+
+CScanStatisticsDlg::CScanStatisticsDlg(CWnd* pParent /*=NULL*/)
+    : CDialog(CScanStatisticsDlg::IDD, pParent)
+{
+}
+
+CScanStatisticsDlg::~CScanStatisticsDlg()
+{
+}
+
+void CScanStatisticsDlg::DoDataExchange(CDataExchange* pDX)
+{
+    CDialog::DoDataExchange(pDX);
+    DDX_Text(pDX, IDC_STATISTICS, m_report);
+}
+
+
+BEGIN_MESSAGE_MAP(CScanStatisticsDlg, CDialog)
+    ON_BN_CLICKED(IDC_SAVEJSON, OnBnClickedSaveJson)
+END_MESSAGE_MAP()
+
+
+BOOL CScanStatisticsDlg::OnInitDialog()
+{
+    CDialog::OnInitDialog();
+
+    // The report is aligned in columns
+    GetDlgItem(IDC_STATISTICS)->SetFont(CFont::FromHandle((HFONT)::GetStockObject(ANSI_FIXED_FONT)));
+
+    m_report = GetScanStatistics()->FormatReport();
+    UpdateData(false);
+
+    return TRUE;
+}
+
+void CScanStatisticsDlg::OnBnClickedSaveJson()
+{
+    CFileDialog dlg(false, _T("json"), _T("windirstat-scan.json"), OFN_OVERWRITEPROMPT | OFN_HIDEREADONLY | OFN_NOCHANGEDIR, LoadString(IDS_JSONFILTER), this);
+    if(IDOK != dlg.DoModal())
+    {
+        return;
+    }
+
+    const CString json = GetScanStatistics()->ToJson();
+
+    try
+    {
+        // UTF-8, as JSON wants it
+        const int length = ::WideCharToMultiByte(CP_UTF8, 0, json, json.GetLength(), NULL, 0, NULL, NULL);
+        CArray<char, char> utf8;
+        utf8.SetSize(length);
+        if(length > 0)
+        {
+            ::WideCharToMultiByte(CP_UTF8, 0, json, json.GetLength(), utf8.GetData(), length, NULL, NULL);
+        }
+
+        CFile file(dlg.GetPathName(), CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite);
+        file.Write(utf8.GetData(), length);
+        file.Close();
+    }
+    catch (CException *pe)
+    {
+        pe->ReportError();
+        pe->Delete();
+    }
+}
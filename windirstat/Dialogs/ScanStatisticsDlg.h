@@ -0,0 +1,45 @@
+// ScanStatisticsDlg.h - Declaration of CScanStatisticsDlg
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+//
+// CScanStatisticsDlg. Shows the throughput statistics of the current
+// (or last) scan, see CScanStatistics, and lets the user save them as JSON.
+//
+class CScanStatisticsDlg : public CDialog
+{
+    DECLARE_DYNAMIC(CScanStatisticsDlg)
+    enum { IDD = IDD_SCANSTATISTICS };
+
+public:
+    CScanStatisticsDlg(CWnd* pParent = NULL);
+    virtual ~CScanStatisticsDlg();
+
+protected:
+    virtual void DoDataExchange(CDataExchange* pDX);
+    virtual BOOL OnInitDialog();
+
+    CString m_report;
+
+    DECLARE_MESSAGE_MAP()
+    afx_msg void OnBnClickedSaveJson();
+};
@@ -45,6 +45,9 @@ namespace
 
     const UINT WMU_OK = WM_USER + 100;
 
+    const UINT_PTR TIMER_ID = 1;
+    const UINT TIMEOUT_CHECK_INTERVAL = 500; // ms
+
     static UINT WMU_THREADFINISHED = ::RegisterWindowMessage(_T("{F03D3293-86E0-4c87-B559-5FD103F5AF58}"));
 
     // Return: false, if drive not accessible
@@ -103,17 +106,26 @@ CDriveItem::CDriveItem(CDrivesList *list, LPCTSTR pszPath)
     */
 }
 
-void CDriveItem::StartQuery(HWND dialog, UINT serial)
+// Return: false, if the cached information is fresh (no query pending).
+//
+bool CDriveItem::StartQuery(HWND dialog, UINT serial)
 {
     ASSERT(dialog != NULL);
 
     ASSERT(m_querying); // The synchronous query in the constructor is commented out.
 
-    if(m_querying)
+    bool success;
+    CString name;
+    ULONGLONG total;
+    ULONGLONG free;
+
+    if(CDriveInformationPool::GetCachedInformation(m_path, success, name, total, free))
     {
-        new CDriveInformationThread(m_path, (LPARAM)this, dialog, serial);
-        // (will delete itself when finished.)
+        // Shown at once. Stale information is refreshed in the background.
+        SetDriveInformation(success, name, total, free);
     }
+
+    return CDriveInformationPool::Query(m_path, (LPARAM)this, dialog, serial);
 }
 
 void CDriveItem::SetDriveInformation(bool success, LPCTSTR name, ULONGLONG total, ULONGLONG free)
@@ -295,112 +307,248 @@ CString CDriveItem::GetDrive() const
 
 /////////////////////////////////////////////////////////////////////////////
 
-CSet<CDriveInformationThread *, CDriveInformationThread *> CDriveInformationThread::_runningThreads;
-CCriticalSection CDriveInformationThread::_csRunningThreads;
+CCriticalSection CDriveInformationPool::_cs;
+CMap<CString, LPCTSTR, CDriveInformationPool::DRIVEINFO, CDriveInformationPool::DRIVEINFO&> CDriveInformationPool::_cache;
+CList<CString, LPCTSTR> CDriveInformationPool::_queue;
+CList<CDriveInformationPool::REQUEST, CDriveInformationPool::REQUEST&> CDriveInformationPool::_requests;
+int CDriveInformationPool::_workers;
+int CDriveInformationPool::_idleWorkers;
+CSemaphore CDriveInformationPool::_queued(0, LONG_MAX);
 
-void CDriveInformationThread::AddRunningThread()
+bool CDriveInformationPool::GetCachedInformation(LPCTSTR path, bool& success, CString& name, ULONGLONG& total, ULONGLONG& free)
 {
-    CSingleLock lock(&_csRunningThreads, true);
-    _runningThreads.SetKey(this);
+    CSingleLock lock(&_cs, true);
+
+    DRIVEINFO info;
+    if(!_cache.Lookup(GetKey(path), info) || !info.valid)
+    {
+        return false;
+    }
+
+    success = info.success;
+    name = info.name;
+    total = info.total;
+    free = info.free;
+    return true;
 }
 
-void CDriveInformationThread::RemoveRunningThread()
+bool CDriveInformationPool::Query(LPCTSTR path, LPARAM driveItem, HWND dialog, UINT serial)
 {
-    CSingleLock lock(&_csRunningThreads, true);
-    _runningThreads.RemoveKey(this);
-}
+    CSingleLock lock(&_cs, true);
 
+    const CString key = GetKey(path);
+    const DWORD now = ::GetTickCount();
 
-// This static method is called by the dialog when the dialog gets closed.
-// We set the m_dialog members of all running threads to null, so that
-// they don't send messages around to a no-more-existing window.
-//
-void CDriveInformationThread::InvalidateDialogHandle()
-{
-    CSingleLock lock(&_csRunningThreads, true);
+    DRIVEINFO info;
+    if(!_cache.Lookup(key, info))
+    {
+        info.success = false;
+        info.total = 0;
+        info.free = 0;
+        info.valid = false;
+        info.retrieved = 0;
+        info.probing = false;
+        info.timedOut = false;
+        info.probeStarted = 0;
+    }
 
-    POSITION pos = _runningThreads.GetStartPosition();
-    while(pos != NULL)
+    if(info.valid && !info.probing && now - info.retrieved < CACHE_TTL)
+    {
+        return false;
+    }
+
+    if(info.probing && info.timedOut)
+    {
+        // Still hung. The result "not accessible" is cached.
+        return false;
+    }
+
+    REQUEST request;
+    request.path = key;
+    request.driveItem = driveItem;
+    request.dialog = dialog;
+    request.serial = serial;
+    _requests.AddTail(request);
+
+    if(!info.probing)
     {
-        CDriveInformationThread *thread;
-        _runningThreads.GetNextAssoc(pos, thread);
+        info.probing = true;
+        info.probeStarted = now;
+        _cache.SetAt(key, info);
 
-        CSingleLock lockObj(&thread->m_cs, true);
-        thread->m_dialog = NULL;
+        _queue.AddTail(key);
+        _queued.Unlock(1, NULL);
+
+        StartWorkers();
     }
+
+    return true;
 }
 
-void CDriveInformationThread::OnAppExit()
+bool CDriveInformationPool::CheckTimeouts(HWND dialog)
 {
-    // We need not do anything here.
+    CSingleLock lock(&_cs, true);
+
+    const DWORD now = ::GetTickCount();
+
+    POSITION pos = _cache.GetStartPosition();
+    while(pos != NULL)
+    {
+        CString key;
+        DRIVEINFO info;
+        _cache.GetNextAssoc(pos, key, info);
+
+        if(info.probing && !info.timedOut && now - info.probeStarted >= PROBE_TIMEOUT)
+        {
+            info.timedOut = true;
+            info.valid = true;
+            info.success = false;
+            info.retrieved = now;
+            _cache.SetAt(key, info);
+
+            // The requests stay, so that a late result is shown, too.
+            Notify(key, false);
+        }
+    }
+
+    // The given up probes may have occupied all workers.
+    StartWorkers();
+
+    pos = _requests.GetHeadPosition();
+    while(pos != NULL)
+    {
+        const REQUEST& request = _requests.GetNext(pos);
+
+        DRIVEINFO info;
+        if(request.dialog == dialog && _cache.Lookup(request.path, info) && !info.timedOut)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
-// The constructor starts the thread.
-//
-CDriveInformationThread::CDriveInformationThread(LPCTSTR path, LPARAM driveItem, HWND dialog, UINT serial)
-    : m_path(path)
-    , m_driveItem(driveItem)
-    , m_serial(serial)
-    , m_dialog(dialog)
-    , m_totalBytes(0)
-    , m_freeBytes(0)
-    , m_success(false)
+void CDriveInformationPool::InvalidateDialogHandle(HWND dialog)
 {
-    ASSERT(m_bAutoDelete);
+    CSingleLock lock(&_cs, true);
 
-    AddRunningThread();
-
-    VERIFY(CreateThread());
+    POSITION pos = _requests.GetHeadPosition();
+    while(pos != NULL)
+    {
+        POSITION current = pos;
+        if(_requests.GetNext(pos).dialog == dialog)
+        {
+            _requests.RemoveAt(current);
+        }
+    }
 }
 
-BOOL CDriveInformationThread::InitInstance()
+UINT CDriveInformationPool::_WorkerProc(LPVOID)
 {
-    m_success = RetrieveDriveInformation(m_path, m_name, m_totalBytes, m_freeBytes);
+    for(;;)
+    {
+        ::WaitForSingleObject(_queued, INFINITE);
+
+        CString path;
+        {
+            CSingleLock lock(&_cs, true);
+            _idleWorkers--;
+            path = _queue.RemoveHead();
+        }
+
+        CString name;
+        ULONGLONG total = 0;
+        ULONGLONG free = 0;
+        bool success = RetrieveDriveInformation(path, name, total, free);
 
 #ifdef TESTTHREADS
-    srand(::GetTickCount());
-    ::Sleep((rand() & 0x07) * 1000);
+        srand(::GetTickCount());
+        ::Sleep((rand() & 0x07) * 1000);
 #endif
 
-    HWND dialog = NULL;
+        CSingleLock lock(&_cs, true);
 
-    {
-        CSingleLock lock(&m_cs, true);
-        dialog = m_dialog;
-        // Of course, we must release m_cs here to avoid deadlocks.
+        DRIVEINFO info;
+        VERIFY(_cache.Lookup(path, info));
+        info.success = success;
+        info.name = name;
+        info.total = total;
+        info.free = free;
+        info.valid = true;
+        info.retrieved = ::GetTickCount();
+        info.probing = false;
+        info.timedOut = false;
+        _cache.SetAt(path, info);
+
+        _idleWorkers++;
+
+        Notify(path, true);
     }
+}
+
+// Starts workers for the queued probes, which no idle worker will take.
+// Workers hanging in a given up probe don't count. _cs must be locked.
+//
+void CDriveInformationPool::StartWorkers()
+{
+    int hung = 0;
 
-    if(dialog != NULL)
+    POSITION pos = _cache.GetStartPosition();
+    while(pos != NULL)
     {
-        // Theoretically the dialog may have been closed at this point.
-        // SendMessage() to a non-existing window simply fails immediately.
-        // If in the meantime the system recycled the window handle,
-        // (it may even belong to another process now?!),
-        // we are safe, because WMU_THREADFINISHED is a unique registered message.
-        // (Well if the other process crashes because of our message, there is nothing we can do about it.)
-        // If the window handle is recycled by a new Select drives dialog,
-        // its new serial will prevent it from reacting.
-        ::SendMessage(dialog, WMU_THREADFINISHED, m_serial, (LPARAM)this);
-    }
+        CString key;
+        DRIVEINFO info;
+        _cache.GetNextAssoc(pos, key, info);
 
-    RemoveRunningThread();
+        if(info.probing && info.timedOut)
+        {
+            hung++;
+        }
+    }
 
-    ASSERT(m_bAutoDelete); // Object will delete itself.
-    return false; // no Run(), please!
+    int needed = (int)_queue.GetCount() - _idleWorkers;
+    while(needed > 0 && _workers - hung < WORKERS && _workers < MAX_WORKERS)
+    {
+        // The workers live as long as the process. They delete themselves.
+        if(AfxBeginThread(_WorkerProc, NULL) == NULL)
+        {
+            break;
+        }
+        _workers++;
+        _idleWorkers++;
+        needed--;
+    }
 }
 
-// This method is only called by the gui thread, while we hang
-// in SendMessage(dialog, WMU_THREADFINISHED, 0, this).
-// So we need no synchronization.
+// Posts WMU_THREADFINISHED to the dialogs waiting for path. _cs must be locked.
+// We post (don't send), so that a worker never waits for the gui thread.
+// If in the meantime the window handle has been recycled by a new Select
+// drives dialog, its new serial will prevent it from reacting.
 //
-LPARAM CDriveInformationThread::GetDriveInformation(bool& success, CString& name, ULONGLONG& total, ULONGLONG& free)
+void CDriveInformationPool::Notify(const CString& path, bool done)
 {
-    name = m_name;
-    total = m_totalBytes;
-    free = m_freeBytes;
-    success = m_success;
+    POSITION pos = _requests.GetHeadPosition();
+    while(pos != NULL)
+    {
+        POSITION current = pos;
+        const REQUEST request = _requests.GetNext(pos);
+
+        if(request.path == path)
+        {
+            ::PostMessage(request.dialog, WMU_THREADFINISHED, request.serial, request.driveItem);
+            if(done)
+            {
+                _requests.RemoveAt(current);
+            }
+        }
+    }
+}
 
-    return m_driveItem;
+CString CDriveInformationPool::GetKey(LPCTSTR path)
+{
+    CString key = path;
+    key.MakeUpper();
+    return key;
 }
 
 
@@ -545,6 +693,7 @@ BEGIN_MESSAGE_MAP(CSelectDrivesDlg, CDialog)
     ON_MESSAGE(WMU_OK, OnWmuOk)
     ON_REGISTERED_MESSAGE(WMU_THREADFINISHED, OnWmuThreadFinished)
     ON_WM_SYSCOLORCHANGE()
+    ON_WM_TIMER()
 END_MESSAGE_MAP()
 
 
@@ -594,6 +743,8 @@ BOOL CSelectDrivesDlg::OnInitDialog()
     BringWindowToTop();
     SetForegroundWindow();
 
+    bool querying = false;
+
     DWORD drives = ::GetLogicalDrives();
     int i;
     DWORD mask = 0x00000001;
@@ -613,7 +764,7 @@ BOOL CSelectDrivesDlg::OnInitDialog()
             continue;
         }
 
-        // The check of remote drives will be done in the background by the CDriveInformationThread.
+        // The check of remote drives will be done in the background by the CDriveInformationPool.
         if(type != DRIVE_REMOTE && !DriveExists(s))
         {
             continue;
@@ -621,7 +772,10 @@ BOOL CSelectDrivesDlg::OnInitDialog()
 
         CDriveItem *item = new CDriveItem(&m_list, s);
         m_list.InsertListItem(m_list.GetItemCount(), item);
-        item->StartQuery(m_hWnd, _serial);
+        if(item->StartQuery(m_hWnd, _serial))
+        {
+            querying = true;
+        }
 
         for(int k = 0; k < m_selectedDrives.GetSize(); k++)
         {
@@ -635,6 +789,11 @@ BOOL CSelectDrivesDlg::OnInitDialog()
 
     m_list.SortItems();
 
+    if(querying)
+    {
+        SetTimer(TIMER_ID, TIMEOUT_CHECK_INTERVAL, NULL);
+    }
+
     m_radio = CPersistence::GetSelectDrivesRadio();
     UpdateData(false);
 
@@ -710,7 +869,7 @@ void CSelectDrivesDlg::OnOK()
     m_selectedDrives.RemoveAll();
     if(m_radio == RADIO_AFOLDER)
     {
-        m_folderName = getFullPathName_(m_folderName);
+        m_folderName = MyGetFullPathName(m_folderName);
         UpdateData(false);
     }
 
@@ -838,7 +997,7 @@ void CSelectDrivesDlg::OnGetMinMaxInfo(MINMAXINFO* mmi)
 
 void CSelectDrivesDlg::OnDestroy()
 {
-    CDriveInformationThread::InvalidateDialogHandle();
+    CDriveInformationPool::InvalidateDialogHandle(m_hWnd);
 
     m_layout.OnDestroy();
     CDialog::OnDestroy();
@@ -850,9 +1009,9 @@ LRESULT CSelectDrivesDlg::OnWmuOk(WPARAM, LPARAM)
     return 0;
 }
 
-// This message is _sent_ by a CDriveInformationThread.
+// This message is posted by the CDriveInformationPool.
 //
-LRESULT CSelectDrivesDlg::OnWmuThreadFinished(WPARAM serial, LPARAM lparam)
+LRESULT CSelectDrivesDlg::OnWmuThreadFinished(WPARAM serial, LPARAM driveItem)
 {
     if(serial != _serial)
     {
@@ -860,15 +1019,6 @@ LRESULT CSelectDrivesDlg::OnWmuThreadFinished(WPARAM serial, LPARAM lparam)
         return 0;
     }
 
-    CDriveInformationThread *thread = (CDriveInformationThread *)lparam;
-
-    bool success;
-    CString name;
-    ULONGLONG total;
-    ULONGLONG free;
-
-    LPARAM driveItem = thread->GetDriveInformation(success, name, total, free);
-
     // For paranoia's sake we check, whether driveItem is in our list.
     // (and we so find its index.)
     LVFINDINFO fi;
@@ -885,6 +1035,16 @@ LRESULT CSelectDrivesDlg::OnWmuThreadFinished(WPARAM serial, LPARAM lparam)
 
     CDriveItem *item = (CDriveItem *)driveItem;
 
+    bool success;
+    CString name;
+    ULONGLONG total;
+    ULONGLONG free;
+
+    if(!CDriveInformationPool::GetCachedInformation(item->GetPath(), success, name, total, free))
+    {
+        return 0;
+    }
+
     item->SetDriveInformation(success, name, total, free);
 
     m_list.RedrawItems(i, i);
@@ -900,6 +1060,15 @@ void CSelectDrivesDlg::OnSysColorChange()
     m_list.SysColorChanged();
 }
 
+void CSelectDrivesDlg::OnTimer(UINT_PTR /*nIDEvent*/)
+{
+    // Hung probes are given up here. Their items get a WMU_THREADFINISHED.
+    if(!CDriveInformationPool::CheckTimeouts(m_hWnd))
+    {
+        KillTimer(TIMER_ID);
+    }
+}
+
 // Callback function for the dialog shown by SHBrowseForFolder()
 int CALLBACK CSelectDrivesDlg::BrowseCallbackProc(HWND hWnd, UINT uMsg, LPARAM lParam, LPARAM lpData)
 {
@@ -913,29 +1082,3 @@ int CALLBACK CSelectDrivesDlg::BrowseCallbackProc(HWND hWnd, UINT uMsg, LPARAM l
     }
     return 0;
 }
-
-CString CSelectDrivesDlg::getFullPathName_(LPCTSTR relativePath)
-{
-    LPTSTR dummy;
-    CString buffer;
-
-    DWORD len = _MAX_PATH;
-
-    DWORD dw = ::GetFullPathName(relativePath, len, buffer.GetBuffer(len), &dummy);
-    buffer.ReleaseBuffer();
-
-    while(dw >= len)
-    {
-        len += _MAX_PATH;
-        dw = ::GetFullPathName(relativePath, len, buffer.GetBuffer(len), &dummy);
-        buffer.ReleaseBuffer();
-    }
-
-    if(0 == dw)
-    {
-        VTRACE(_T("GetFullPathName(%s) failed: GetLastError returns %u"), relativePath, ::GetLastError());
-        return relativePath;
-    }
-
-    return buffer;
-}
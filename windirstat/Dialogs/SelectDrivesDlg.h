@@ -26,7 +26,6 @@
 #include "ownerdrawnlistcontrol.h"
 #include "layout.h"
 #include "resource.h"
-#include "set.h"
 
 //
 // The dialog has these three radio buttons.
@@ -49,7 +48,7 @@ class CDriveItem: public COwnerDrawnListItem
 {
 public:
     CDriveItem(CDrivesList *list, LPCTSTR pszPath);
-    void StartQuery(HWND dialog, UINT serial);
+    bool StartQuery(HWND dialog, UINT serial);
 
     void SetDriveInformation(bool success, LPCTSTR name, ULONGLONG total, ULONGLONG free);
 
@@ -68,7 +67,7 @@ private:
     CString m_path;         // e.g. "C:\"
     bool m_isRemote;        // Whether the drive type is DRIVE_REMOTE (network drive)
 
-    bool m_querying;        // Information thread is running.
+    bool m_querying;        // No information available yet.
     bool m_success;         // Drive is accessible. false while m_querying is true.
 
     CString m_name;         // e.g. "BOOT (C:)"
@@ -79,42 +78,80 @@ private:
 };
 
 //
-// CDriveInformationThread. Does the GetVolumeInformation() call, which
-// may hang for ca. 30 sec, it a network drive is not accessible.
+// CDriveInformationPool. Does the GetVolumeInformation() calls, which
+// may hang for ca. 30 sec, if a network drive is not accessible.
 //
-class CDriveInformationThread: public CWinThread
+// A few shared worker threads probe the drives. The results are cached
+// for the lifetime of the process, so that the dialog shows them at once
+// when it is opened again; stale results are probed again in the
+// background. A probe, which takes longer than PROBE_TIMEOUT, counts as
+// "not accessible" and no longer occupies a worker slot. A drive is never
+// probed twice at the same time, so a dead share costs one thread at most.
+//
+// All methods are static and called by the gui thread.
+//
+class CDriveInformationPool
 {
-    // Set of all running CDriveInformationThreads.
-    // Used by InvalidateDialogHandle().
-    static CSet<CDriveInformationThread *, CDriveInformationThread *> _runningThreads;
-    static CCriticalSection _csRunningThreads;
-
-    // The objects register and unregister themselves in _runningThreads
-    void AddRunningThread();
-    void RemoveRunningThread();
-
 public:
-    static void InvalidateDialogHandle();
-    static void OnAppExit();
-
-    CDriveInformationThread(LPCTSTR path, LPARAM driveItem, HWND dialog, UINT serial);
-    virtual BOOL InitInstance();
-
-    LPARAM GetDriveInformation(bool& success, CString& name, ULONGLONG& total, ULONGLONG& free);
+    enum
+    {
+        WORKERS = 4,            // Workers, which are not hung
+        MAX_WORKERS = 16,       // Including hung ones
+        PROBE_TIMEOUT = 5000,   // ms
+        CACHE_TTL = 60000       // ms
+    };
+
+    // Gets the cached information of path, if any.
+    // Return: false, if path has never been probed.
+    static bool GetCachedInformation(LPCTSTR path, bool& success, CString& name, ULONGLONG& total, ULONGLONG& free);
+
+    // Probes path, unless the cached information is fresh. When done,
+    // posts WMU_THREADFINISHED(serial, driveItem) to the dialog.
+    // Return: false, if nothing will be posted (the cache is fresh).
+    static bool Query(LPCTSTR path, LPARAM driveItem, HWND dialog, UINT serial);
+
+    // To be called periodically while queries are pending. Gives up
+    // hung probes and starts workers for the queued ones.
+    // Return: false, if no queries of the dialog are pending anymore.
+    static bool CheckTimeouts(HWND dialog);
+
+    // The dialog is being closed. Forgets its queries.
+    static void InvalidateDialogHandle(HWND dialog);
 
 private:
-    const CString m_path;       // Path like "C:\"
-    const LPARAM m_driveItem;   // The list item, we belong to
-
-    CCriticalSection m_cs;  // for m_dialog
-    HWND m_dialog;          // synchronized by m_cs
-    const UINT m_serial;    // serial number of m_dialog
-
-    // "[out]"-parameters
-    CString m_name;         // Result: name like "BOOT (C:)", valid if m_success
-    ULONGLONG m_totalBytes; // Result: capacity of the drive, valid if m_success
-    ULONGLONG m_freeBytes;  // Result: free space on the drive, valid if m_success
-    bool m_success;         // Result: false, iff drive is unaccessible.
+    struct DRIVEINFO
+    {
+        bool success;       // Drive is accessible
+        CString name;       // e.g. "BOOT (C:)"
+        ULONGLONG total;
+        ULONGLONG free;
+        bool valid;         // false, if never probed
+        DWORD retrieved;    // GetTickCount() of the result
+        bool probing;       // A probe is queued or running
+        bool timedOut;      // The running probe has been given up
+        DWORD probeStarted; // GetTickCount() of the queueing
+    };
+
+    struct REQUEST
+    {
+        CString path;
+        LPARAM driveItem;
+        HWND dialog;
+        UINT serial;
+    };
+
+    static UINT _WorkerProc(LPVOID);
+    static void StartWorkers();
+    static void Notify(const CString& path, bool done);
+    static CString GetKey(LPCTSTR path);
+
+    static CCriticalSection _cs;    // for all of the following
+    static CMap<CString, LPCTSTR, DRIVEINFO, DRIVEINFO&> _cache;
+    static CList<CString, LPCTSTR> _queue;      // Paths to be probed
+    static CList<REQUEST, REQUEST&> _requests;  // Waiting for a result
+    static int _workers;                        // Running worker threads
+    static int _idleWorkers;                    // Workers waiting for _queue
+    static CSemaphore _queued;                  // Count of _queue
 };
 
 //
@@ -147,7 +184,6 @@ class CSelectDrivesDlg : public CDialog
 {
     DECLARE_DYNAMIC(CSelectDrivesDlg)
     enum { IDD = IDD_SELECTDRIVES };
-    static CString getFullPathName_(LPCTSTR relativePath);
 
 public:
     CSelectDrivesDlg(CWnd* pParent = NULL);
@@ -188,6 +224,7 @@ protected:
     afx_msg void OnDestroy();
     afx_msg LRESULT OnWmuOk(WPARAM, LPARAM);
     afx_msg LRESULT OnWmuThreadFinished(WPARAM, LPARAM lparam);
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
     afx_msg void OnSysColorChange();
 };
 
@@ -39,6 +39,23 @@ DWORD CFileFindWDS::GetAttributes() const
     }
 }
 
+// The reparse tag (e.g. IO_REPARSE_TAG_MOUNT_POINT), if GetAttributes()
+// contains FILE_ATTRIBUTE_REPARSE_POINT, otherwise 0.
+DWORD CFileFindWDS::GetReparseTag() const
+{
+    ASSERT(m_hContext != NULL);
+    ASSERT_VALID(this);
+
+    if(m_pFoundInfo != NULL && (((LPWIN32_FIND_DATA)m_pFoundInfo)->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+    {
+        return ((LPWIN32_FIND_DATA)m_pFoundInfo)->dwReserved0;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
 // Wrapper for file size retrieval
 // This function tries to return compressed file size whenever possible.
 // If the file is not compressed the uncompressed size is being returned.
@@ -62,3 +79,53 @@ ULONGLONG CFileFindWDS::GetCompressedLength() const
     // Use the file size already found by the finder object
     return GetLength();
 }
+
+// The space the file occupies on the volume. The length is rounded up
+// to the cluster size, which is exact for ordinary files. Only compressed
+// and sparse files, whose allocation does not follow from the length,
+// cost an extra GetCompressedFileSize() call.
+ULONGLONG CFileFindWDS::GetAllocatedLength(DWORD clusterSize) const
+{
+    ASSERT(clusterSize > 0);
+
+    ULONGLONG length = GetLength();
+
+    if((GetAttributes() & (FILE_ATTRIBUTE_COMPRESSED | FILE_ATTRIBUTE_SPARSE_FILE)) != 0)
+    {
+        ULARGE_INTEGER ret;
+        ret.LowPart = ::GetCompressedFileSize(GetFilePath(), &ret.HighPart);
+
+        if(ret.LowPart != INVALID_FILE_SIZE || ::GetLastError() == NO_ERROR)
+        {
+            length = ret.QuadPart;
+        }
+    }
+
+    return (length + clusterSize - 1) / clusterSize * clusterSize;
+}
+
+// Identifies the file on its volume, so that several hard links to it
+// can be told apart from distinct files. This opens the file, so the
+// scanner calls it only if the user asked for it.
+bool CFileFindWDS::GetFileIdentity(DWORD& volumeSerial, ULONGLONG& fileIndex, DWORD& links) const
+{
+    HANDLE h = ::CreateFile(GetFilePath(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+    if(h == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL b = ::GetFileInformationByHandle(h, &info);
+    ::CloseHandle(h);
+    if(!b)
+    {
+        return false;
+    }
+
+    volumeSerial = info.dwVolumeSerialNumber;
+    fileIndex = (ULONGLONG)info.nFileIndexHigh << 32 | info.nFileIndexLow;
+    links = info.nNumberOfLinks;
+    return true;
+}
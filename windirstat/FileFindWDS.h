@@ -28,7 +28,10 @@ class CFileFindWDS : public CFileFind
 {
 public:
     DWORD GetAttributes() const;
+    DWORD GetReparseTag() const;
     ULONGLONG GetCompressedLength() const;
+    ULONGLONG GetAllocatedLength(DWORD clusterSize) const;
+    bool GetFileIdentity(DWORD& volumeSerial, ULONGLONG& fileIndex, DWORD& links) const;
 };
 
 #endif // __WDS_FILEFINDWDS_H__
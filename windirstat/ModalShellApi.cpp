@@ -40,10 +40,10 @@ CModalShellApi::CModalShellApi()
 {
 }
 
-void CModalShellApi::DeleteFile(LPCTSTR fileName, bool toRecycleBin)
+void CModalShellApi::DeleteFiles(const CStringArray& fileNames, bool toRecycleBin)
 {
     m_operation = DELETE_FILE;
-    m_fileName = fileName;
+    m_fileNames.Copy(fileNames);
     m_toRecycleBin = toRecycleBin;
 
     DoModal();
@@ -55,27 +55,32 @@ void CModalShellApi::DoOperation()
     {
     case DELETE_FILE:
         {
-            DoDeleteFile();
+            DoDeleteFiles();
         }
         break;
     }
 }
 
-void CModalShellApi::DoDeleteFile()
+void CModalShellApi::DoDeleteFiles()
 {
-    int len = m_fileName.GetLength();
-    LPTSTR psz = m_fileName.GetBuffer(len + 2);
-    psz[len + 1]= 0;
+    // pFrom is a list of null terminated names, terminated by an empty name.
+    CArray<TCHAR, TCHAR> from;
+    for(int i = 0; i < m_fileNames.GetSize(); i++)
+    {
+        const int len = m_fileNames[i].GetLength();
+        const INT_PTR pos = from.GetSize();
+        from.SetSize(pos + len + 1);
+        memcpy(from.GetData() + pos, m_fileNames[i].GetString(), (len + 1) * sizeof(TCHAR));
+    }
+    from.Add(0);
 
     SHFILEOPSTRUCT sfos;
     ZeroMemory(&sfos, sizeof(sfos));
     sfos.wFunc = FO_DELETE;
-    sfos.pFrom = psz;
+    sfos.pFrom = from.GetData();
     sfos.fFlags = m_toRecycleBin ? FOF_ALLOWUNDO : 0;
 
     sfos.hwnd = *AfxGetMainWnd();
 
     ::SHFileOperation(&sfos); // FIXME: use return value
-
-    m_fileName.ReleaseBuffer();
 }
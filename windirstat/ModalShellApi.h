@@ -37,15 +37,16 @@ class CModalShellApi : public CModalApiShuttle
 public:
     CModalShellApi();
 
-    void DeleteFile(LPCTSTR fileName, bool toRecycleBin);
+    // One SHFileOperation() for all files, so that the user is asked once.
+    void DeleteFiles(const CStringArray& fileNames, bool toRecycleBin);
 
 protected:
     virtual void DoOperation();
 
-    void DoDeleteFile();
+    void DoDeleteFiles();
 
     int m_operation;        // Enum specifying the desired operation
-    CString m_fileName;     // File name to be deleted
+    CStringArray m_fileNames;   // Files to be deleted
     bool m_toRecycleBin;    // True if file shall only be move to the recycle bin
 };
 
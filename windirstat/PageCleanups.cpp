@@ -121,8 +121,8 @@ BOOL CPageCleanups::OnInitDialog()
     m_ctlRefreshPolicy.AddString(LoadString(IDS_POLICY_NOREFRESH));
     m_ctlRefreshPolicy.AddString(LoadString(IDS_POLICY_REFRESHTHISENTRY));
     m_ctlRefreshPolicy.AddString(LoadString(IDS_POLICY_REFRESHPARENT));
-    // We don't do this: m_ctlRefreshPolicy.AddString("Assume entry has been deleted");
-    // That conflicts with "works for <Files> Pseudoentries".
+    // For <Files> pseudo entries this is a plain refresh.
+    m_ctlRefreshPolicy.AddString(LoadString(IDS_POLICY_ASSUMEDELETED));
 
     GetOptions()->GetUserDefinedCleanups(m_udc);
 
@@ -62,6 +62,8 @@ void CPageGeneral::DoDataExchange(CDataExchange* pDX)
     DDX_Check(pDX, IDC_SHOWSTRIPES, m_listStripes);
     DDX_Check(pDX, IDC_FULLROWSELECTION, m_listFullRowSelection);
     DDX_Check(pDX, IDC_SKIPHIDDEN, m_skipHidden);
+    DDX_Check(pDX, IDC_ALLOCATEDSIZE, m_allocatedSize);
+    DDX_Check(pDX, IDC_HARDLINKSONCE, m_countHardLinksOnce);
 }
 
 
@@ -75,6 +77,8 @@ BEGIN_MESSAGE_MAP(CPageGeneral, CPropertyPage)
     ON_BN_CLICKED(IDC_SHOWSTRIPES, OnBnClickedListStripes)
     ON_BN_CLICKED(IDC_FULLROWSELECTION, OnBnClickedListFullRowSelection)
     ON_BN_CLICKED(IDC_SKIPHIDDEN, OnBnClickedSkipHidden)
+    ON_BN_CLICKED(IDC_ALLOCATEDSIZE, OnBnClickedAllocatedSize)
+    ON_BN_CLICKED(IDC_HARDLINKSONCE, OnBnClickedCountHardLinksOnce)
 END_MESSAGE_MAP()
 
 
@@ -92,6 +96,8 @@ BOOL CPageGeneral::OnInitDialog()
     m_followJunctionPoints = GetOptions()->IsFollowJunctionPoints();
     m_useWdsLocale = GetOptions()->IsUseWdsLocale();
     m_skipHidden = GetOptions()->IsSkipHidden();
+    m_allocatedSize = GetOptions()->IsAllocatedSize();
+    m_countHardLinksOnce = GetOptions()->IsCountHardLinksOnce();
 
     m_followMountPoints = false;    // Otherwise we would see pacman only.
     m_ctlFollowMountPoints.ShowWindow(SW_HIDE); // Ignorance is bliss.
@@ -137,6 +143,8 @@ void CPageGeneral::OnOK()
     GetOptions()->SetListStripes(FALSE != m_listStripes);
     GetOptions()->SetListFullRowSelection(FALSE != m_listFullRowSelection);
     GetOptions()->SetSkipHidden(FALSE != m_skipHidden);
+    GetOptions()->SetAllocatedSize(FALSE != m_allocatedSize);
+    GetOptions()->SetCountHardLinksOnce(FALSE != m_countHardLinksOnce);
 
     LANGID id = (LANGID)m_combo.GetItemData(m_combo.GetCurSel());
     CLanguageOptions::SetLanguage(id);
@@ -191,3 +199,13 @@ void CPageGeneral::OnBnClickedSkipHidden()
 {
     SetModified();
 }
+
+void CPageGeneral::OnBnClickedAllocatedSize()
+{
+    SetModified();
+}
+
+void CPageGeneral::OnBnClickedCountHardLinksOnce()
+{
+    SetModified();
+}
@@ -52,6 +52,8 @@ protected:
     BOOL m_listStripes;
     BOOL m_listFullRowSelection;
     BOOL m_skipHidden;
+    BOOL m_allocatedSize;
+    BOOL m_countHardLinksOnce;
 
     CComboBox m_combo;
     CButton m_ctlFollowMountPoints;
@@ -70,6 +72,8 @@ protected:
     afx_msg void OnBnClickedListStripes();
     afx_msg void OnBnClickedListFullRowSelection();
     afx_msg void OnBnClickedSkipHidden();
+    afx_msg void OnBnClickedAllocatedSize();
+    afx_msg void OnBnClickedCountHardLinksOnce();
 };
 
 #endif // __WDS_PAGEGENERAL_H__
@@ -0,0 +1,383 @@
+// cleanupexecutor.cpp - Implementation of CCleanupExecutor
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include <common/tracer.h>
+#include "cleanupexecutor.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+CCleanupExecutor::CCleanupExecutor()
+    : m_concurrency(1)
+    , m_thread(NULL)
+    , m_cancel(false, true)
+    , m_finished(0)
+    , m_running(0)
+    , m_cancelled(0)
+    , m_done(false)
+{
+}
+
+CCleanupExecutor::~CCleanupExecutor()
+{
+    if(m_thread != NULL)
+    {
+        Cancel();
+        ::WaitForSingleObject(m_thread->m_hThread, INFINITE);
+        delete m_thread;
+    }
+}
+
+int CCleanupExecutor::AddJob(LPCTSTR application, LPCTSTR commandLine, LPCTSTR directory, bool showConsoleWindow)
+{
+    ASSERT(m_thread == NULL);
+
+    JOB job;
+    job.application = application;
+    job.commandLine = commandLine;
+    job.directory = directory;
+    job.showConsoleWindow = showConsoleWindow;
+    job.parent = -1;
+    job.pendingChildren = 0;
+    job.process = NULL;
+    job.state = JS_WAITING;
+    job.result = 0;
+
+    return (int)m_jobs.Add(job);
+}
+
+void CCleanupExecutor::SetParent(int child, int parent)
+{
+    ASSERT(m_thread == NULL);
+    ASSERT(m_jobs[child].parent == -1);
+    ASSERT(child != parent);
+
+    m_jobs[child].parent = parent;
+    m_jobs[parent].pendingChildren++;
+}
+
+void CCleanupExecutor::Start(int concurrency)
+{
+    ASSERT(m_thread == NULL);
+
+    m_concurrency = min(max(concurrency, 1), MAXCONCURRENCY);
+
+    for(int i = 0; i < m_jobs.GetSize(); i++)
+    {
+        if(m_jobs[i].pendingChildren == 0)
+        {
+            m_ready.AddTail(i);
+        }
+    }
+
+    // We wait for the thread in the destructor, so it must not delete itself.
+    m_thread = AfxBeginThread(_ThreadProc, this, THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+    if(m_thread == NULL)
+    {
+        // Nothing can be run, so all jobs are reported as failed.
+        DWORD error = ::GetLastError();
+        VTRACE(_T("AfxBeginThread failed: GetLastError returns %u"), error);
+        if(error == ERROR_SUCCESS)
+        {
+            error = ERROR_NOT_ENOUGH_MEMORY;
+        }
+        FailRemainingJobs(error);
+
+        CSingleLock lock(&m_cs, true);
+        m_done = true;
+        return;
+    }
+    m_thread->m_bAutoDelete = false;
+    m_thread->ResumeThread();
+}
+
+void CCleanupExecutor::Cancel()
+{
+    m_cancel.SetEvent();
+}
+
+bool CCleanupExecutor::IsDone()
+{
+    CSingleLock lock(&m_cs, true);
+    return m_done;
+}
+
+int CCleanupExecutor::GetJobCount() const
+{
+    return (int)m_jobs.GetSize();
+}
+
+void CCleanupExecutor::GetProgress(int& finished, int& running, int& failed, int& cancelled)
+{
+    CSingleLock lock(&m_cs, true);
+
+    finished = m_finished;
+    running = m_running;
+    failed = (int)m_failures.GetSize();
+    cancelled = m_cancelled;
+}
+
+int CCleanupExecutor::GetFailure(int n)
+{
+    CSingleLock lock(&m_cs, true);
+    return m_failures[n];
+}
+
+CCleanupExecutor::JOBSTATE CCleanupExecutor::GetJobState(int i, DWORD& result)
+{
+    CSingleLock lock(&m_cs, true);
+
+    result = m_jobs[i].result;
+    return m_jobs[i].state;
+}
+
+CString CCleanupExecutor::GetJobDirectory(int i) const
+{
+    // Not changed after Start()
+    return m_jobs[i].directory;
+}
+
+UINT CCleanupExecutor::_ThreadProc(LPVOID param)
+{
+    ((CCleanupExecutor *)param)->Run();
+    return 0;
+}
+
+void CCleanupExecutor::Run()
+{
+    // handles[0] is the cancel event, handles[k + 1] the process of running[k].
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    CArray<int, int> running;
+
+    handles[0] = m_cancel;
+
+    for(;;)
+    {
+        while(running.GetSize() < m_concurrency && !m_ready.IsEmpty() && !IsCancelled())
+        {
+            int i = m_ready.RemoveHead();
+            if(Launch(i))
+            {
+                running.Add(i);
+            }
+            else
+            {
+                ReleaseParent(i);
+            }
+        }
+
+        if(running.GetSize() == 0)
+        {
+            break;
+        }
+
+        for(int k = 0; k < running.GetSize(); k++)
+        {
+            handles[k + 1] = m_jobs[running[k]].process;
+        }
+
+        DWORD r = ::WaitForMultipleObjects((DWORD)running.GetSize() + 1, handles, false, INFINITE);
+
+        if(r > WAIT_OBJECT_0 && r <= WAIT_OBJECT_0 + running.GetSize())
+        {
+            int k = r - WAIT_OBJECT_0 - 1;
+            int i = running[k];
+
+            DWORD exitCode = 0;
+            ::GetExitCodeProcess(m_jobs[i].process, &exitCode);
+            ::CloseHandle(m_jobs[i].process);
+            m_jobs[i].process = NULL;
+
+            SetJobState(i, JS_FINISHED, exitCode);
+            ReleaseParent(i);
+            running.RemoveAt(k);
+        }
+        else if(r == WAIT_FAILED)
+        {
+            // We can't wait for the processes anymore.
+            const DWORD error = ::GetLastError();
+            VTRACE(_T("WaitForMultipleObjects failed: GetLastError returns %u"), error);
+            FailRemainingJobs(error);
+            running.RemoveAll();
+            break;
+        }
+        else
+        {
+            // Cancelled.
+            // Note: Only the command interpreter is terminated, not
+            // processes which it may have started in turn.
+            ASSERT(r == WAIT_OBJECT_0);
+
+            for(int k = 0; k < running.GetSize(); k++)
+            {
+                int i = running[k];
+                ::TerminateProcess(m_jobs[i].process, ERROR_CANCELLED);
+                ::CloseHandle(m_jobs[i].process);
+                m_jobs[i].process = NULL;
+
+                SetJobState(i, JS_CANCELLED, ERROR_CANCELLED);
+            }
+            running.RemoveAll();
+            break;
+        }
+    }
+
+    CSingleLock lock(&m_cs, true);
+
+    // Whatever has not been started, won't be.
+    for(int i = 0; i < m_jobs.GetSize(); i++)
+    {
+        if(m_jobs[i].state == JS_WAITING)
+        {
+            m_jobs[i].state = JS_CANCELLED;
+            m_cancelled++;
+        }
+    }
+    m_done = true;
+}
+
+bool CCleanupExecutor::IsCancelled()
+{
+    return WAIT_OBJECT_0 == ::WaitForSingleObject(m_cancel, 0);
+}
+
+bool CCleanupExecutor::Launch(int i)
+{
+    JOB& job = m_jobs[i];
+
+    STARTUPINFO si;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESHOWWINDOW;
+    si.wShowWindow = job.showConsoleWindow ? SW_SHOWNORMAL : SW_HIDE;
+
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&pi, sizeof(pi));
+
+    // CreateProcess() may modify the command line buffer.
+    CString cmdline = job.commandLine;
+
+    BOOL b = ::CreateProcess(
+        job.application,
+        cmdline.GetBuffer(),
+        NULL,
+        NULL,
+        false,
+        0,
+        NULL,
+        job.directory,
+        &si,
+        &pi
+    );
+    cmdline.ReleaseBuffer();
+    if(!b)
+    {
+        SetJobState(i, JS_FAILED, ::GetLastError());
+        return false;
+    }
+
+    ::CloseHandle(pi.hThread);
+    job.process = pi.hProcess;
+
+    SetJobState(i, JS_RUNNING, 0);
+    return true;
+}
+
+void CCleanupExecutor::SetJobState(int i, JOBSTATE state, DWORD result)
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(m_jobs[i].state == JS_RUNNING)
+    {
+        m_running--;
+    }
+
+    m_jobs[i].state = state;
+    m_jobs[i].result = result;
+
+    switch (state)
+    {
+    case JS_RUNNING:
+        m_running++;
+        break;
+
+    case JS_FINISHED:
+        m_finished++;
+        if(result != 0)
+        {
+            m_failures.Add(i);
+        }
+        break;
+
+    case JS_FAILED:
+        m_finished++;
+        m_failures.Add(i);
+        break;
+
+    case JS_CANCELLED:
+        m_cancelled++;
+        break;
+
+    default:
+        ASSERT(0);
+    }
+}
+
+// Terminates the running jobs and marks them and the waiting ones as failed.
+// Worker thread, or before it has been started.
+//
+void CCleanupExecutor::FailRemainingJobs(DWORD error)
+{
+    for(int i = 0; i < m_jobs.GetSize(); i++)
+    {
+        if(m_jobs[i].process != NULL)
+        {
+            ::TerminateProcess(m_jobs[i].process, error);
+            ::CloseHandle(m_jobs[i].process);
+            m_jobs[i].process = NULL;
+        }
+
+        if(m_jobs[i].state == JS_WAITING || m_jobs[i].state == JS_RUNNING)
+        {
+            SetJobState(i, JS_FAILED, error);
+        }
+    }
+}
+
+// A job has ended (or could not be started). Its parent may start as soon
+// as all of its children have.
+//
+void CCleanupExecutor::ReleaseParent(int i)
+{
+    int parent = m_jobs[i].parent;
+    if(parent == -1)
+    {
+        return;
+    }
+
+    ASSERT(m_jobs[parent].pendingChildren > 0);
+    if(--m_jobs[parent].pendingChildren == 0)
+    {
+        m_ready.AddTail(parent);
+    }
+}
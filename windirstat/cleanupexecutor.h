@@ -0,0 +1,111 @@
+// cleanupexecutor.h - Declaration of CCleanupExecutor
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_CLEANUPEXECUTOR_H__
+#define __WDS_CLEANUPEXECUTOR_H__
+#pragma once
+
+//
+// CCleanupExecutor. Runs the command lines of a user defined cleanup on a
+// worker thread, at most a given number of processes at a time.
+//
+// A job can have a parent, which is started only after all of its children
+// have finished. So a recursive cleanup still processes the subdirectories
+// of a directory before the directory itself, while independent subtrees
+// run concurrently.
+//
+// Jobs are added before Start(). After that, the GUI thread only polls the
+// progress; the states and results are synchronized by m_cs.
+//
+class CCleanupExecutor
+{
+public:
+    enum JOBSTATE
+    {
+        JS_WAITING,
+        JS_RUNNING,
+        JS_FINISHED,    // Result is the exit code
+        JS_FAILED,      // Could not be started, result is the error code
+        JS_CANCELLED
+    };
+
+    // One wait handle is needed for the cancel event.
+    enum { MAXCONCURRENCY = MAXIMUM_WAIT_OBJECTS - 1 };
+
+    CCleanupExecutor();
+    ~CCleanupExecutor(); // Cancels and waits for the worker thread
+
+    int AddJob(LPCTSTR application, LPCTSTR commandLine, LPCTSTR directory, bool showConsoleWindow);
+    void SetParent(int child, int parent);
+
+    void Start(int concurrency);
+    // Starts no more jobs and terminates the running ones.
+    void Cancel();
+
+    bool IsDone();
+    int GetJobCount() const;
+    void GetProgress(int& finished, int& running, int& failed, int& cancelled);
+
+    // Failed jobs (not started or non-zero exit code) in the order they failed.
+    // n < failed from GetProgress().
+    int GetFailure(int n);
+
+    JOBSTATE GetJobState(int i, DWORD& result);
+    CString GetJobDirectory(int i) const;
+
+private:
+    struct JOB
+    {
+        CString application;
+        CString commandLine;
+        CString directory;
+        bool showConsoleWindow;
+        int parent;             // -1 or index
+        int pendingChildren;    // Worker thread only
+        HANDLE process;         // Worker thread only
+        JOBSTATE state;         // m_cs
+        DWORD result;           // m_cs
+    };
+
+    static UINT _ThreadProc(LPVOID param);
+    void Run();
+    bool IsCancelled();
+    bool Launch(int i);
+    void SetJobState(int i, JOBSTATE state, DWORD result);
+    void ReleaseParent(int i);
+    void FailRemainingJobs(DWORD error);
+
+    CArray<JOB, JOB&> m_jobs;
+    CList<int, int> m_ready;    // Jobs without pending children, worker thread only
+    int m_concurrency;
+
+    CWinThread *m_thread;
+    CEvent m_cancel;            // Manual reset
+
+    CCriticalSection m_cs;      // for the following members and the job states
+    CArray<int, int> m_failures;
+    int m_finished;
+    int m_running;
+    int m_cancelled;
+    bool m_done;
+};
+
+#endif // __WDS_CLEANUPEXECUTOR_H__
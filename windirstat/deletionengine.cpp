@@ -0,0 +1,421 @@
+// deletionengine.cpp - Implementation of CDeletionEngine
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include <common/tracer.h>
+#include "FileFindWDS.h"
+#include "deletionengine.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+CDeletionEngine::CDeletionEngine()
+    : m_stop(false, true)
+    , m_queued(0, LONG_MAX)
+    , m_startTicks(0)
+    , m_runningThreads(0)
+    , m_done(false)
+    , m_cancelled(false)
+{
+    ZeroMemory(&m_progress, sizeof(m_progress));
+}
+
+CDeletionEngine::~CDeletionEngine()
+{
+    Cancel();
+
+    for(int i = 0; i < m_threads.GetSize(); i++)
+    {
+        ::WaitForSingleObject(m_threads[i]->m_hThread, INFINITE);
+        delete m_threads[i];
+    }
+
+    for(int i = 0; i < m_jobs.GetSize(); i++)
+    {
+        delete m_jobs[i];
+    }
+}
+
+int CDeletionEngine::AddRoot(LPCTSTR path, bool isDirectory)
+{
+    ASSERT(m_threads.GetSize() == 0);
+
+    m_rootIsDirectory.Add(isDirectory);
+    return (int)m_rootPaths.Add(path);
+}
+
+void CDeletionEngine::Start(int threads)
+{
+    ASSERT(m_threads.GetSize() == 0);
+    ASSERT(m_rootPaths.GetSize() > 0);
+
+    threads = min(max(threads, 1), MAXTHREADS);
+
+    m_startTicks = ::GetTickCount();
+    m_rootFinished.SetSize(m_rootPaths.GetSize());
+
+    for(int i = 0; i < m_rootPaths.GetSize(); i++)
+    {
+        m_rootFinished[i] = false;
+        Push(NewJob(m_rootPaths[i], m_rootIsDirectory[i], i, NULL));
+    }
+
+    m_runningThreads = threads;
+
+    for(int i = 0; i < threads; i++)
+    {
+        // We wait for the threads in the destructor, so they must not delete themselves.
+        CWinThread *thread = AfxBeginThread(_ThreadProc, this, THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+        if(thread == NULL)
+        {
+            // Stop the others and finish as cancelled, so that the caller
+            // doesn't wait for the threads which never ran.
+            VTRACE(_T("AfxBeginThread failed"));
+            Cancel();
+            for(; i < threads; i++)
+            {
+                ThreadFinished();
+            }
+            break;
+        }
+        thread->m_bAutoDelete = false;
+        m_threads.Add(thread);
+        thread->ResumeThread();
+    }
+}
+
+void CDeletionEngine::Cancel()
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(!m_done && m_finishedRoots.GetSize() < m_rootPaths.GetSize())
+    {
+        m_cancelled = true;
+    }
+    m_stop.SetEvent();
+}
+
+bool CDeletionEngine::IsDone()
+{
+    CSingleLock lock(&m_cs, true);
+    return m_done;
+}
+
+bool CDeletionEngine::IsCancelled()
+{
+    CSingleLock lock(&m_cs, true);
+    return m_cancelled;
+}
+
+int CDeletionEngine::GetRootCount() const
+{
+    return (int)m_rootPaths.GetSize();
+}
+
+CString CDeletionEngine::GetRootPath(int i) const
+{
+    return m_rootPaths[i];
+}
+
+void CDeletionEngine::GetProgress(PROGRESS& progress)
+{
+    CSingleLock lock(&m_cs, true);
+
+    progress = m_progress;
+    if(!m_done)
+    {
+        progress.milliseconds = ::GetTickCount() - m_startTicks;
+    }
+}
+
+int CDeletionEngine::GetFinishedRootCount()
+{
+    CSingleLock lock(&m_cs, true);
+    return (int)m_finishedRoots.GetSize();
+}
+
+int CDeletionEngine::GetFinishedRoot(int n)
+{
+    CSingleLock lock(&m_cs, true);
+    return m_finishedRoots[n];
+}
+
+void CDeletionEngine::GetError(int n, CString& path, DWORD& error)
+{
+    CSingleLock lock(&m_cs, true);
+
+    path = m_errors[n].path;
+    error = m_errors[n].error;
+}
+
+UINT CDeletionEngine::_ThreadProc(LPVOID param)
+{
+    ((CDeletionEngine *)param)->Run();
+    return 0;
+}
+
+void CDeletionEngine::Run()
+{
+    HANDLE handles[2];
+    handles[0] = m_stop;
+    handles[1] = m_queued;
+
+    // m_stop has priority, as WaitForMultipleObjects() reports the lowest index.
+    while(WAIT_OBJECT_0 + 1 == ::WaitForMultipleObjects(2, handles, false, INFINITE))
+    {
+        DIRJOB *job = NULL;
+        {
+            CSingleLock lock(&m_cs, true);
+            job = m_queue.RemoveHead();
+        }
+
+        Process(job);
+    }
+
+    ThreadFinished();
+}
+
+void CDeletionEngine::ThreadFinished()
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(--m_runningThreads > 0)
+    {
+        return;
+    }
+
+    // We are the last one. If stopped, report the remaining roots, too,
+    // so that the caller refreshes them.
+    for(int i = 0; i < m_rootFinished.GetSize(); i++)
+    {
+        if(!m_rootFinished[i])
+        {
+            m_rootFinished[i] = true;
+            m_finishedRoots.Add(i);
+        }
+    }
+
+    m_progress.milliseconds = ::GetTickCount() - m_startTicks;
+    m_done = true;
+}
+
+bool CDeletionEngine::IsStopping()
+{
+    // m_stop is also set when all roots are finished, but then
+    // nothing is left to be stopped.
+    return WAIT_OBJECT_0 == ::WaitForSingleObject(m_stop, 0);
+}
+
+CDeletionEngine::DIRJOB *CDeletionEngine::NewJob(const CString& path, bool isDirectory, int root, DIRJOB *parent)
+{
+    DIRJOB *job = new DIRJOB;
+    job->path = path;
+    job->isDirectory = isDirectory;
+    job->root = root;
+    job->parent = parent;
+    job->pendingChildren = 1;
+
+    CSingleLock lock(&m_cs, true);
+    m_jobs.Add(job);
+
+    return job;
+}
+
+// Deletes the files of a directory and queues its subdirectories.
+//
+void CDeletionEngine::Process(DIRJOB *job)
+{
+    if(!job->isDirectory)
+    {
+        ULONGLONG length = 0;
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if(::GetFileAttributesEx(job->path, GetFileExInfoStandard, &data))
+        {
+            length = (ULONGLONG)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+        }
+
+        DeleteOneFile(job->path, length);
+        Complete(job);
+        return;
+    }
+
+    // A root, which is a reparse point itself, is removed like the
+    // reparse points below the roots, without enumerating the target.
+    // Complete() removes it.
+    if(job->parent == NULL)
+    {
+        const DWORD attributes = ::GetFileAttributes(job->path);
+        if(attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+        {
+            Complete(job);
+            return;
+        }
+    }
+
+    CFileFindWDS finder;
+    BOOL b = finder.FindFile(job->path + _T("\\*.*"));
+    while(b && !IsStopping())
+    {
+        b = finder.FindNextFile();
+        if(finder.IsDots())
+        {
+            continue;
+        }
+
+        const CString path = finder.GetFilePath();
+
+        if(!finder.IsDirectory())
+        {
+            DeleteOneFile(path, finder.GetLength());
+        }
+        else if((finder.GetAttributes() & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+        {
+            // Remove the reparse point, not what it points to.
+            RemoveOneDirectory(path);
+        }
+        else
+        {
+            DIRJOB *child = NewJob(path, true, job->root, job);
+            {
+                CSingleLock lock(&m_cs, true);
+                job->pendingChildren++;
+            }
+            Push(child);
+        }
+    }
+    // The directory can't be removed while we hold the find handle.
+    finder.Close();
+
+    if(IsStopping())
+    {
+        return;
+    }
+
+    // Release the count of our own enumeration.
+    bool complete = false;
+    {
+        CSingleLock lock(&m_cs, true);
+        complete = (--job->pendingChildren == 0);
+    }
+
+    if(complete)
+    {
+        Complete(job);
+    }
+}
+
+// All children of job have been processed. Removes the directory and
+// propagates the completion to the parent.
+//
+void CDeletionEngine::Complete(DIRJOB *job)
+{
+    while(job != NULL && !IsStopping())
+    {
+        if(job->isDirectory)
+        {
+            RemoveOneDirectory(job->path);
+        }
+        job->path.Empty();
+
+        CSingleLock lock(&m_cs, true);
+
+        DIRJOB *parent = job->parent;
+        if(parent == NULL)
+        {
+            m_rootFinished[job->root] = true;
+            m_finishedRoots.Add(job->root);
+
+            if(m_finishedRoots.GetSize() == m_rootPaths.GetSize())
+            {
+                // Let the threads go home.
+                m_stop.SetEvent();
+            }
+            return;
+        }
+
+        if(--parent->pendingChildren > 0)
+        {
+            return;
+        }
+        job = parent;
+    }
+}
+
+bool CDeletionEngine::DeleteOneFile(const CString& path, ULONGLONG length)
+{
+    BOOL b = ::DeleteFile(path);
+    if(!b && ::GetLastError() == ERROR_ACCESS_DENIED && ::SetFileAttributes(path, FILE_ATTRIBUTE_NORMAL))
+    {
+        // Was read-only
+        b = ::DeleteFile(path);
+    }
+
+    if(!b)
+    {
+        AddError(path, ::GetLastError());
+        return false;
+    }
+
+    CSingleLock lock(&m_cs, true);
+    m_progress.files++;
+    m_progress.bytes += length;
+    return true;
+}
+
+bool CDeletionEngine::RemoveOneDirectory(const CString& path)
+{
+    BOOL b = ::RemoveDirectory(path);
+    if(!b && ::GetLastError() == ERROR_ACCESS_DENIED && ::SetFileAttributes(path, FILE_ATTRIBUTE_NORMAL))
+    {
+        b = ::RemoveDirectory(path);
+    }
+
+    if(!b)
+    {
+        AddError(path, ::GetLastError());
+        return false;
+    }
+
+    CSingleLock lock(&m_cs, true);
+    m_progress.directories++;
+    return true;
+}
+
+void CDeletionEngine::Push(DIRJOB *job)
+{
+    {
+        CSingleLock lock(&m_cs, true);
+        m_queue.AddTail(job);
+    }
+    m_queued.Unlock(1, NULL);
+}
+
+void CDeletionEngine::AddError(const CString& path, DWORD error)
+{
+    ERRORINFO info;
+    info.path = path;
+    info.error = error;
+
+    CSingleLock lock(&m_cs, true);
+    m_errors.Add(info);
+    m_progress.errors++;
+}
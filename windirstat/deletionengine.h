@@ -0,0 +1,124 @@
+// deletionengine.h - Declaration of CDeletionEngine
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_DELETIONENGINE_H__
+#define __WDS_DELETIONENGINE_H__
+#pragma once
+
+//
+// CDeletionEngine. Permanently deletes a set of files and directory trees
+// (the roots) with several worker threads.
+//
+// The unit of work is a directory: a worker enumerates it, deletes its
+// files and queues its subdirectories. When the last subdirectory of a
+// directory has been removed, the directory itself is removed. Reparse
+// points (junctions, mount points, symbolic links) are removed, never
+// followed.
+//
+// Roots are added before Start(). After that, the GUI thread only polls the
+// progress; the counters and lists are synchronized by m_cs.
+//
+class CDeletionEngine
+{
+public:
+    enum { MAXTHREADS = 32 };
+
+    struct PROGRESS
+    {
+        ULONGLONG files;        // Deleted files
+        ULONGLONG directories;  // Removed directories
+        ULONGLONG bytes;        // Length of the deleted files
+        ULONGLONG errors;
+        DWORD milliseconds;     // Since Start()
+    };
+
+    CDeletionEngine();
+    ~CDeletionEngine(); // Cancels and waits for the worker threads
+
+    int AddRoot(LPCTSTR path, bool isDirectory);
+
+    void Start(int threads);
+    // Stops after the entries being deleted. What is deleted, is deleted.
+    void Cancel();
+
+    bool IsDone();
+    // Whether Cancel() has been called before all roots were finished
+    bool IsCancelled();
+    int GetRootCount() const;
+    CString GetRootPath(int i) const;
+    void GetProgress(PROGRESS& progress);
+
+    // The roots, which have been processed completely (or given up on
+    // cancellation), in that order. n < GetFinishedRootCount()
+    int GetFinishedRootCount();
+    int GetFinishedRoot(int n);
+
+    // n < progress.errors
+    void GetError(int n, CString& path, DWORD& error);
+
+private:
+    struct DIRJOB
+    {
+        CString path;
+        bool isDirectory;       // false for a file root
+        int root;
+        DIRJOB *parent;         // NULL for a root
+        int pendingChildren;    // m_cs. Plus one while being enumerated.
+    };
+
+    struct ERRORINFO
+    {
+        CString path;
+        DWORD error;
+    };
+
+    static UINT _ThreadProc(LPVOID param);
+    void Run();
+    void ThreadFinished();
+    bool IsStopping();
+    DIRJOB *NewJob(const CString& path, bool isDirectory, int root, DIRJOB *parent);
+    void Process(DIRJOB *job);
+    void Complete(DIRJOB *job);
+    bool DeleteOneFile(const CString& path, ULONGLONG length);
+    bool RemoveOneDirectory(const CString& path);
+    void Push(DIRJOB *job);
+    void AddError(const CString& path, DWORD error);
+
+    CStringArray m_rootPaths;               // Not changed after Start()
+    CArray<bool, bool> m_rootIsDirectory;   // Not changed after Start()
+    CArray<CWinThread *, CWinThread *> m_threads;
+    CEvent m_stop;          // Manual reset. Set when done or cancelled.
+    CSemaphore m_queued;    // Count of m_queue
+    DWORD m_startTicks;
+
+    CCriticalSection m_cs;  // for the following members and DIRJOB::pendingChildren
+    CList<DIRJOB *, DIRJOB *> m_queue;
+    CArray<DIRJOB *, DIRJOB *> m_jobs;      // All jobs, deleted by the destructor
+    CArray<bool, bool> m_rootFinished;
+    CArray<int, int> m_finishedRoots;
+    CArray<ERRORINFO, ERRORINFO&> m_errors;
+    PROGRESS m_progress;
+    int m_runningThreads;
+    bool m_done;
+    bool m_cancelled;
+};
+
+#endif // __WDS_DELETIONENGINE_H__
@@ -25,6 +25,15 @@
 #include "mainframe.h"
 #include "osspecific.h"
 #include "globalhelpers.h"
+#include "scanstats.h"
+#include "fileidentity.h"
+#include "spillfile.h"
+#include "scanfilter.h"
+#include "scanhistory.h"
+#include "treeexporter.h"
+#include "cleanupexecutor.h"
+#include "cleanupprogressdlg.h"
+#include "deleteprogressdlg.h"
 #include "deletewarningdlg.h"
 #include "modalshellapi.h"
 #include <common/mdexceptions.h>
@@ -53,6 +62,63 @@ namespace
         RGB(255, 255, 150),
         RGB(255, 255, 255)
     };
+
+    // Subtrees are spilled as a whole, if they have between SPILL_MIN_ITEMS
+    // (less is not worth a spill file record) and SPILL_MAX_ITEMS items
+    // (more would take too long to read back on expand).
+    const ULONGLONG SPILL_MIN_ITEMS = 64;
+    const ULONGLONG SPILL_MAX_ITEMS = 64 * 1024;
+
+    // Parameter of CDirstatDoc::_RecordScanHistoryThread()
+    struct HISTORYJOB
+    {
+        CString file;
+        HISTORYSNAPSHOT snapshot;
+    };
+
+    // Returns the file item, or NULL.
+    CItem *FindFileByPath(CItem *root, const CString& path)
+    {
+        const int i = path.ReverseFind(wds::chrBackslash);
+        if(i < 0)
+        {
+            return NULL;
+        }
+
+        // Drive paths end with a backslash, the others don't.
+        CString folder = path.Left(i);
+        folder.MakeLower();
+        CItem *parent = root->FindDirectoryByPath(folder);
+        if(parent == NULL)
+        {
+            parent = root->FindDirectoryByPath(folder + wds::chrBackslash);
+        }
+        if(parent == NULL)
+        {
+            return NULL;
+        }
+
+        const CString name = path.Mid(i + 1);
+        for(int j = 0; j < parent->GetChildrenCount(); j++)
+        {
+            CItem *child = parent->GetChild(j);
+            if(child->GetType() == IT_FILESFOLDER)
+            {
+                for(int k = 0; k < child->GetChildrenCount(); k++)
+                {
+                    if(child->GetChild(k)->GetName().CompareNoCase(name) == 0)
+                    {
+                        return child->GetChild(k);
+                    }
+                }
+            }
+            else if(child->GetType() == IT_FILE && child->GetName().CompareNoCase(name) == 0)
+            {
+                return child;
+            }
+        }
+        return NULL;
+    }
 }
 
 CDirstatDoc *_theDocument;
@@ -73,6 +139,9 @@ CDirstatDoc::CDirstatDoc()
     m_rootItem = NULL;
     m_workingItem = NULL;
     m_zoomItem = NULL;
+    m_spillRetryUsage = 0;
+    m_historyThread = NULL;
+    m_fullScan = false;
 
     m_showFreeSpace = CPersistence::GetShowFreeSpace();
     m_showUnknown = CPersistence::GetShowUnknown();
@@ -86,6 +155,8 @@ CDirstatDoc::~CDirstatDoc()
     CPersistence::SetShowFreeSpace(m_showFreeSpace);
     CPersistence::SetShowUnknown(m_showUnknown);
 
+    WaitForScanHistory();
+
     delete m_rootItem;
     _theDocument = NULL;
 }
@@ -198,7 +269,7 @@ void CDirstatDoc::DeleteContents()
     SetWorkingItem(NULL);
     m_zoomItem = NULL;
     m_selectedItems.RemoveAll();
-    GetWDSApp()->ReReadMountPoints();
+    GetWDSApp()->InvalidateMountPoints();
 }
 
 BOOL CDirstatDoc::OnNewDocument()
@@ -216,7 +287,27 @@ BOOL CDirstatDoc::OnOpenDocument(LPCTSTR lpszPathName)
 {
     CDocument::OnNewDocument(); // --> DeleteContents()
 
-    CString spec = lpszPathName;
+    GetScanStatistics()->Reset();
+    GetFileIdentities()->RemoveAll();
+    GetScanFilter()->StartScan();
+    GetSpillFile()->Reset();
+    m_spillRetryUsage = 0;
+    m_fullScan = true;
+
+    CreateRootItem(lpszPathName);
+
+    GetMainFrame()->MinimizeGraphView();
+    GetMainFrame()->MinimizeTypeView();
+
+    UpdateAllViews(NULL, HINT_NEWROOT);
+    return true;
+}
+
+// Builds the root item (and the drive items) for a selection from
+// EncodeSelection(). The scan itself is done by Work().
+//
+void CDirstatDoc::CreateRootItem(LPCTSTR spec)
+{
     CString folder;
     CStringArray drives;
     DecodeSelection(spec, folder, drives);
@@ -274,12 +365,6 @@ BOOL CDirstatDoc::OnOpenDocument(LPCTSTR lpszPathName)
     }
 
     SetWorkingItem(m_rootItem);
-
-    GetMainFrame()->MinimizeGraphView();
-    GetMainFrame()->MinimizeTypeView();
-
-    UpdateAllViews(NULL, HINT_NEWROOT);
-    return true;
 }
 
 // We don't want MFCs AfxFullPath()-Logic, because lpszPathName
@@ -377,10 +462,25 @@ bool CDirstatDoc::Work(CWorkLimiter* limiter)
     if(!m_rootItem->IsDone())
     {
         m_rootItem->DoSomeWork(limiter);
+        GetScanStatistics()->SamplePendingReadJobs(m_rootItem->GetReadJobs());
         if(m_rootItem->IsDone())
         {
             m_extensionDataValid = false;
 
+            GetScanStatistics()->Finish();
+
+            VTRACE(_T("Scheduling: %I64u steps, %.1f ms"), GetScanStatistics()->scheduleSteps, CScanStatistics::ToMilliseconds(GetScanStatistics()->scheduleTime));
+            VTRACE(_T("Entries: %I64u, system calls: %I64u"), GetScanStatistics()->entries, GetScanStatistics()->syscalls);
+            VTRACE(_T("UI updates: %I64u, %.1f ms"), GetScanStatistics()->visualUpdates, CScanStatistics::ToMilliseconds(GetScanStatistics()->visualUpdateTime));
+
+            // Refreshes of single items (and of the recyclers after a
+            // deletion) are no scans of their own.
+            if(m_fullScan)
+            {
+                m_fullScan = false;
+                RecordScanHistory();
+            }
+
             GetMainFrame()->SetProgressPos100();
             GetMainFrame()->RestoreTypeView();
             GetMainFrame()->RestoreGraphView();
@@ -399,6 +499,9 @@ bool CDirstatDoc::Work(CWorkLimiter* limiter)
         }
 
     }
+
+    SpillColdSubtrees();
+
     if(m_rootItem->IsDone())
     {
         SetWorkingItem(NULL);
@@ -447,6 +550,20 @@ void CDirstatDoc::RefreshJunctionItems()
     RecurseRefreshJunctionItems(root);
 }
 
+// Starts a refresh of the whole tree.
+// Called when the user changes the allocated size option.
+//
+void CDirstatDoc::RefreshAllItems()
+{
+    CItem *root = GetRootItem();
+    if(NULL == root)
+    {
+        return;
+    }
+
+    RefreshItem(root);
+}
+
 bool CDirstatDoc::IsRootDone()
 {
     return m_rootItem != NULL && m_rootItem->IsDone();
@@ -517,8 +634,34 @@ void CDirstatDoc::AssertSelectionValid()
 }
 #endif
 
-void CDirstatDoc::SetSelection(const CItem * /*item*/, bool /*keepReselectChildStack*/)
+// Makes item the only selected item (or none, if NULL) and zooms out,
+// if the zoom item doesn't contain it.
+//
+void CDirstatDoc::SetSelection(const CItem *item, bool keepReselectChildStack)
 {
+    if(item != NULL && m_zoomItem != NULL)
+    {
+        CItem *newzoom = CItem::FindCommonAncestor(m_zoomItem, item);
+        if(newzoom != m_zoomItem)
+        {
+            SetZoomItem(newzoom);
+        }
+    }
+
+    bool keep = keepReselectChildStack || (m_selectedItems.GetSize() == 1 && m_selectedItems[0] == item);
+
+    RemoveAllSelections();
+    if(item != NULL)
+    {
+        AddSelection(item);
+    }
+
+    GetMainFrame()->SetSelectionMessageText();
+
+    if(!keep)
+    {
+        ClearReselectChildStack();
+    }
 }
 
 CItem *CDirstatDoc::GetSelection(size_t i)
@@ -543,6 +686,20 @@ bool CDirstatDoc::IsSelected(const CItem *item)
     return false;
 }
 
+// Whether a selected item lies in the subtree of item (or is item).
+//
+bool CDirstatDoc::IsAncestorOfSelection(const CItem *item)
+{
+    for(int i = 0; i < m_selectedItems.GetSize(); i++)
+    {
+        if(item->IsAncestorOf(m_selectedItems[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void CDirstatDoc::SetHighlightExtension(LPCTSTR ext)
 {
     m_highlightExtension = ext;
@@ -686,10 +843,20 @@ void CDirstatDoc::RecurseRefreshMountPointItems(CItem *item)
     {
         RefreshItem(item);
     }
+
+    // Don't load all spilled subtrees at once. A refresh below
+    // makes the subtree hot again.
+    const bool spilled = item->IsSpilled();
+
     for(int i = 0; i < item->GetChildrenCount(); i++)
     {
         RecurseRefreshMountPointItems(item->GetChild(i));
     }
+
+    if(spilled && IsSpillCandidate(item))
+    {
+        item->Spill();
+    }
 }
 
 void CDirstatDoc::RecurseRefreshJunctionItems(CItem *item)
@@ -698,10 +865,85 @@ void CDirstatDoc::RecurseRefreshJunctionItems(CItem *item)
     {
         RefreshItem(item);
     }
+
+    // Don't load all spilled subtrees at once. A refresh below
+    // makes the subtree hot again.
+    const bool spilled = item->IsSpilled();
+
     for(int i = 0; i < item->GetChildrenCount(); i++)
     {
         RecurseRefreshJunctionItems(item->GetChild(i));
     }
+
+    if(spilled && IsSpillCandidate(item))
+    {
+        item->Spill();
+    }
+}
+
+// Keeps the item tree within the memory budget (COptions::GetSpillBudget()):
+// if it exceeds the budget, spills cold subtrees until it has shrunk to
+// 3/4 of it. Called regularly during and after the scan.
+//
+void CDirstatDoc::SpillColdSubtrees()
+{
+    const ULONGLONG usage = CItem::GetMemoryUsage();
+    GetScanStatistics()->SampleItemMemory(usage);
+
+    const ULONGLONG budget = (ULONGLONG)GetOptions()->GetSpillBudget() * 1024 * 1024;
+    if(budget == 0 || usage <= budget || usage <= m_spillRetryUsage || m_rootItem == NULL)
+    {
+        return;
+    }
+
+    const ULONGLONG target = budget / 4 * 3;
+    RecurseSpillColdSubtrees(m_rootItem, target);
+
+    // The stack may point into a spilled subtree.
+    ClearReselectChildStack();
+
+    // If we could not get below the target (everything is visible, or not
+    // yet scanned), don't walk the tree again before it has grown further.
+    m_spillRetryUsage = CItem::GetMemoryUsage() > target ? CItem::GetMemoryUsage() + budget / 8 : 0;
+}
+
+void CDirstatDoc::RecurseSpillColdSubtrees(CItem *item, ULONGLONG target)
+{
+    for(int i = 0; i < item->GetChildrenCount() && CItem::GetMemoryUsage() > target; i++)
+    {
+        CItem *child = item->GetChild(i);
+        if(IsLeaf(child->GetType()) || child->IsSpilled() || child->GetItemsCount() < SPILL_MIN_ITEMS)
+        {
+            continue;
+        }
+
+        if(IsSpillCandidate(child))
+        {
+            child->Spill();
+        }
+        else
+        {
+            RecurseSpillColdSubtrees(child, target);
+        }
+    }
+}
+
+// A subtree can be spilled, if it is complete, collapsed and small enough
+// to be read back quickly, and if no selection or zoom points into it.
+//
+bool CDirstatDoc::IsSpillCandidate(const CItem *item)
+{
+    if(item->GetType() != IT_DIRECTORY || !item->IsDone() || item->IsVisible() || item->GetItemsCount() > SPILL_MAX_ITEMS)
+    {
+        return false;
+    }
+
+    if(m_zoomItem != NULL && item->IsAncestorOf(m_zoomItem))
+    {
+        return false;
+    }
+
+    return !IsAncestorOfSelection(item);
 }
 
 // Gets all items of type IT_DRIVE.
@@ -745,6 +987,71 @@ void CDirstatDoc::RefreshRecyclers()
     SetWorkingItem(GetRootItem());
 }
 
+// Adds the totals of the completed scan to the history database, if there is one.
+void CDirstatDoc::RecordScanHistory()
+{
+    const CString file = GetOptions()->GetHistoryDatabase();
+    if(file.IsEmpty())
+    {
+        return;
+    }
+
+    // Only the snapshot is taken here. Writing the database can take
+    // seconds and is done in the background. If the last scan is still
+    // being written, this one is left out rather than waiting for it.
+    if(m_historyThread != NULL)
+    {
+        if(::WaitForSingleObject(m_historyThread->m_hThread, 0) == WAIT_TIMEOUT)
+        {
+            VTRACE(_T("Scan history: still recording the last scan, skipped"));
+            return;
+        }
+        WaitForScanHistory();
+    }
+
+    HISTORYJOB *job = new HISTORYJOB;
+    job->file = file;
+    CScanHistory::Snapshot(m_rootItem, GetExtensionData(), job->snapshot);
+
+    m_historyThread = AfxBeginThread(_RecordScanHistoryThread, job, THREAD_PRIORITY_BELOW_NORMAL, 0, CREATE_SUSPENDED);
+    if(m_historyThread == NULL)
+    {
+        delete job;
+        return;
+    }
+    m_historyThread->m_bAutoDelete = false;
+    m_historyThread->ResumeThread();
+}
+
+void CDirstatDoc::WaitForScanHistory()
+{
+    if(m_historyThread == NULL)
+    {
+        return;
+    }
+    ::WaitForSingleObject(m_historyThread->m_hThread, INFINITE);
+    delete m_historyThread;
+    m_historyThread = NULL;
+}
+
+UINT CDirstatDoc::_RecordScanHistoryThread(LPVOID param)
+{
+    HISTORYJOB *job = (HISTORYJOB *)param;
+
+    CScanHistory history;
+    if(!history.Open(job->file) || history.Record(job->snapshot) == 0)
+    {
+        VTRACE(_T("Scan history %s: %s"), job->file.GetString(), history.GetLastError().GetString());
+    }
+    else
+    {
+        VTRACE(_T("Scan history: %I64u rows, %.1f ms"), history.GetRecordedRows(), CScanStatistics::ToMilliseconds(history.GetRecordTime()));
+    }
+
+    delete job;
+    return 0;
+}
+
 void CDirstatDoc::RebuildExtensionData()
 {
     CWaitCursor wc;
@@ -842,15 +1149,54 @@ void CDirstatDoc::SetWorkingItem(CItem *item)
     m_workingItem = item;
 }
 
-// Deletes a file or directory via SHFileOperation.
+// Whether the selected items can be deleted: files and directories,
+// but not the root.
+//
+bool CDirstatDoc::IsSelectionDeletable()
+{
+    if(m_selectedItems.GetSize() == 0)
+    {
+        return false;
+    }
+
+    for(int i = 0; i < m_selectedItems.GetSize(); i++)
+    {
+        const CItem *item = m_selectedItems[i];
+        if(item->GetType() != IT_DIRECTORY && item->GetType() != IT_FILE || item->IsRootItem())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Deletes the selected files and directories. To the recycle bin with one
+// SHFileOperation, permanently with a CDeletionEngine in the background
+// (CDeleteProgressDlg removes the items from the tree when they are gone).
 // Return: false, if canceled
 //
-bool CDirstatDoc::DeletePhysicalItem(CItem *item, bool toTrashBin)
+bool CDirstatDoc::DeletePhysicalItems(bool toTrashBin)
 {
+    ASSERT(IsSelectionDeletable());
+
+    // The refreshes below change the selection.
+    CArray<CItem *, CItem *> items;
+    items.Copy(m_selectedItems);
+
+    CString name;
+    if(items.GetSize() == 1)
+    {
+        name = items[0]->GetPath();
+    }
+    else
+    {
+        name.FormatMessage(IDS_sSELECTEDITEMS, FormatCount(items.GetSize()).GetString());
+    }
+
     if(CPersistence::GetShowDeleteWarning())
     {
         CDeleteWarningDlg warning;
-        warning.m_fileName = item->GetPath();
+        warning.m_fileName = name;
         if(IDYES != warning.DoModal())
         {
             return false;
@@ -858,17 +1204,58 @@ bool CDirstatDoc::DeletePhysicalItem(CItem *item, bool toTrashBin)
         CPersistence::SetShowDeleteWarning(!warning.m_dontShowAgain);
     }
 
-    ASSERT(item->GetParent() != NULL);
+    if(toTrashBin)
+    {
+        CStringArray paths;
+        for(int i = 0; i < items.GetSize(); i++)
+        {
+            paths.Add(items[i]->GetPath());
+        }
+
+        CModalShellApi msa;
+        msa.DeleteFiles(paths, true);
 
-    CModalShellApi msa;
-    msa.DeleteFile(item->GetPath(), toTrashBin);
+        // The items are siblings, so none of them removes another one.
+        for(int i = 0; i < items.GetSize(); i++)
+        {
+            RefreshDeletedItem(items[i]);
+        }
+        return true;
+    }
+
+    // SHFileOperation() asked for confirmation, the engine doesn't.
+    CString msg;
+    msg.FormatMessage(IDS_PERMANENTLYDELETEs, name.GetString());
+    if(IDYES != AfxMessageBox(msg, MB_YESNO | MB_ICONWARNING))
+    {
+        return false;
+    }
+
+    ULONGLONG count = 0;
+    for(int i = 0; i < items.GetSize(); i++)
+    {
+        count += items[i]->GetItemsCount() + 1;
+    }
 
-    RefreshItem(item);
+    CDeleteProgressDlg *dlg = new CDeleteProgressDlg(count);
+    for(int i = 0; i < items.GetSize(); i++)
+    {
+        dlg->GetEngine()->AddRoot(items[i]->GetPath(), IT_DIRECTORY == items[i]->GetType());
+    }
+
+    // The items are about to vanish.
+    SetSelection(items[0]->GetParent());
+    UpdateAllViews(NULL, HINT_SELECTIONCHANGED);
+
+    dlg->Run(GetOptions()->GetDeleteConcurrency());
     return true;
 }
 
 void CDirstatDoc::SetZoomItem(CItem *item)
 {
+    // The treemap would show a spilled item as one cushion.
+    item->Rehydrate();
+
     m_zoomItem = item;
     UpdateAllViews(NULL, HINT_ZOOMCHANGED);
 }
@@ -890,8 +1277,7 @@ void CDirstatDoc::RefreshItem(CItem *item)
         SetZoomItem(item);
     }
 
-    // FIXME: Multi-select
-    if(item->IsAncestorOf(GetSelection(0)))
+    if(IsAncestorOfSelection(item))
     {
         SetSelection(item);
         UpdateAllViews(NULL, HINT_SELECTIONCHANGED);
@@ -899,6 +1285,22 @@ void CDirstatDoc::RefreshItem(CItem *item)
 
     SetWorkingItemAncestor(item);
 
+    // A refresh of an idle tree counts as a new scan. While scanning,
+    // it adds to the running one.
+    if(IsRootDone())
+    {
+        GetScanStatistics()->Reset();
+        GetScanFilter()->StartScan();
+    }
+
+    if(item == GetRootItem())
+    {
+        m_fullScan = true;
+    }
+
+    // The subtree counts its hard links anew.
+    ReleaseHardLinks(item);
+
     CItem *parent = item->GetParent();
 
     if(!item->StartRefresh())
@@ -907,8 +1309,7 @@ void CDirstatDoc::RefreshItem(CItem *item)
         {
             SetZoomItem(parent);
         }
-        // FIXME: Multi-select
-        if(GetSelection(0) == item)
+        if(IsSelected(item))
         {
             SetSelection(parent);
             UpdateAllViews(NULL, HINT_SELECTIONCHANGED);
@@ -922,6 +1323,98 @@ void CDirstatDoc::RefreshItem(CItem *item)
     UpdateAllViews(NULL);
 }
 
+// Removes a deleted item from the tree without a rescan, or refreshes it, if it still exists.
+//
+void CDirstatDoc::RefreshDeletedItem(CItem *item)
+{
+    ASSERT(item != NULL);
+
+    bool exists = true;
+    if(IT_FILE == item->GetType())
+    {
+        exists = (FALSE != ::PathFileExists(item->GetPath()));
+    }
+    else if(IT_DIRECTORY == item->GetType())
+    {
+        exists = FolderExists(item->GetPath());
+    }
+
+    if(exists || item->GetParent() == NULL)
+    {
+        RefreshItem(item);
+        return;
+    }
+
+    CWaitCursor wc;
+
+    ClearReselectChildStack();
+
+    CItem *parent = item->GetParent();
+
+    if(item->IsAncestorOf(GetZoomItem()))
+    {
+        SetZoomItem(parent);
+    }
+
+    if(IsAncestorOfSelection(item))
+    {
+        SetSelection(parent);
+        UpdateAllViews(NULL, HINT_SELECTIONCHANGED);
+    }
+
+    if(item->IsAncestorOf(m_workingItem))
+    {
+        SetWorkingItem(parent);
+    }
+
+    if(m_extensionDataValid)
+    {
+        item->RecurseSubtractExtensionData(&m_extensionData);
+    }
+
+    ReleaseHardLinks(item);
+    item->RemoveFromTree(); // --> delete item
+
+    UpdateAllViews(NULL);
+}
+
+// The links of files with several hard links in the subtree of item are
+// about to be rescanned or removed. Files, which were counted there, but
+// are also linked elsewhere, are now counted at one of the other links.
+//
+void CDirstatDoc::ReleaseHardLinks(CItem *item)
+{
+    if(item == GetRootItem())
+    {
+        GetFileIdentities()->RemoveAll();
+        return;
+    }
+
+    CArray<HARDLINKMOVE, const HARDLINKMOVE&> moved;
+    GetFileIdentities()->Release(item->GetPath(), item->GetType() == IT_FILESFOLDER, moved);
+
+    for(int i = 0; i < moved.GetSize(); i++)
+    {
+        CItem *file = FindFileByPath(GetRootItem(), moved[i].path);
+        if(file == NULL)
+        {
+            continue;
+        }
+
+        file->UpwardAddSize(moved[i].length);
+
+        if(m_extensionDataValid)
+        {
+            SExtensionRecord r;
+            if(m_extensionData.Lookup(file->GetExtension(), r))
+            {
+                r.bytes += moved[i].length;
+                m_extensionData.SetAt(file->GetExtension(), r);
+            }
+        }
+    }
+}
+
 // UDC confirmation Dialog.
 //
 void CDirstatDoc::AskForConfirmation(const USERDEFINEDCLEANUP *udc, CItem *item)
@@ -966,25 +1459,64 @@ void CDirstatDoc::PerformUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, CItem
         }
     }
 
-    if(udc->recurseIntoSubdirectories && item->GetType() != IT_FILESFOLDER)
+    CString refreshPath = path;
+    refreshPath.MakeLower();
+
+    bool recurse = udc->recurseIntoSubdirectories && item->GetType() != IT_FILESFOLDER;
+
+    if(!recurse && !udc->waitForCompletion)
+    {
+        CallUserDefinedCleanup(isDirectory, udc->commandLine, path, path, udc->showConsoleWindow);
+        RefreshAfterUserDefinedCleanup(udc->refreshPolicy, refreshPath);
+        return;
+    }
+
+    // The commands run in the background. The dialog refreshes
+    // the tree when they have finished.
+    CCleanupProgressDlg *dlg = new CCleanupProgressDlg(udc->title, udc->refreshPolicy, refreshPath);
+
+    if(recurse)
     {
         ASSERT(IT_DRIVE == item->GetType() || IT_DIRECTORY == item->GetType());
 
-        RecursiveUserDefinedCleanup(udc, path, path);
+        // With hidden items skipped or entries excluded by the scan
+        // filter, the tree lacks directories the cleanup must see.
+        if(GetOptions()->IsSkipHidden() || GetScanFilter()->HasExcludeRules())
+        {
+            RecursiveUserDefinedCleanup(dlg->GetExecutor(), udc, path, path);
+        }
+        else
+        {
+            RecurseUserDefinedCleanupFromTree(dlg->GetExecutor(), udc, path, item);
+        }
     }
     else
     {
-        CallUserDefinedCleanup(isDirectory, udc->commandLine, path, path, udc->showConsoleWindow, udc->waitForCompletion);
+        AddUserDefinedCleanupJob(dlg->GetExecutor(), isDirectory, udc, path, path);
     }
+
+    dlg->Run(GetOptions()->GetCleanupConcurrency());
 }
 
-void CDirstatDoc::RefreshAfterUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, CItem *item)
+// path is the lower case path of the item the cleanup was called for.
+// As the cleanup may have run in the background, the tree may have
+// changed meanwhile. So we look the item up again.
+//
+void CDirstatDoc::RefreshAfterUserDefinedCleanup(REFRESHPOLICY refreshPolicy, const CString& path)
 {
-    switch (udc->refreshPolicy)
+    if(RP_NO_REFRESH == refreshPolicy || NULL == GetRootItem())
     {
-    case RP_NO_REFRESH:
-        break;
+        return;
+    }
 
+    CItem *item = GetRootItem()->FindDirectoryByPath(path);
+    if(NULL == item)
+    {
+        return;
+    }
+
+    switch (refreshPolicy)
+    {
     case RP_REFRESH_THIS_ENTRY:
         {
             RefreshItem(item);
@@ -997,20 +1529,27 @@ void CDirstatDoc::RefreshAfterUserDefinedCleanup(const USERDEFINEDCLEANUP *udc,
         }
         break;
 
-    // case RP_ASSUME_ENTRY_HAS_BEEN_DELETED:
-    // Feature not implemented.
-    // break;
+    case RP_ASSUME_ENTRY_HAS_BEEN_DELETED:
+        {
+            // Pseudo entries like <Files> and drives are refreshed.
+            RefreshDeletedItem(item);
+        }
+        break;
 
     default:
         ASSERT(0);
     }
 }
 
-void CDirstatDoc::RecursiveUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath)
+// Adds the jobs for currentPath and its subdirectories to the executor.
+// The subdirectories are children of currentPath's job, so that they are
+// processed first (depth first). Returns the job of currentPath.
+//
+int CDirstatDoc::RecursiveUserDefinedCleanup(CCleanupExecutor *executor, const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath)
 {
-    // (Depth first.)
+    CArray<int, int> children;
 
-    CFileFind finder;
+    CFileFindWDS finder;
     BOOL b = finder.FindFile(currentPath + _T("\\*.*"));
     while(b)
     {
@@ -1019,29 +1558,124 @@ void CDirstatDoc::RecursiveUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, con
         {
             continue;
         }
-        if(GetWDSApp()->IsVolumeMountPoint(finder.GetFilePath()) && !GetOptions()->IsFollowMountPoints())
+        if(GetWDSApp()->IsVolumeMountPoint(finder) && !GetOptions()->IsFollowMountPoints())
         {
             continue;
         }
-        if(GetWDSApp()->IsFolderJunction(finder.GetFilePath()) && !GetOptions()->IsFollowJunctionPoints())
+        if(GetWDSApp()->IsFolderJunction(finder) && !GetOptions()->IsFollowJunctionPoints())
         {
             continue;
         }
 
-        RecursiveUserDefinedCleanup(udc, rootPath, finder.GetFilePath());
+        children.Add(RecursiveUserDefinedCleanup(executor, udc, rootPath, finder.GetFilePath()));
+    }
+
+    int job = AddUserDefinedCleanupJob(executor, true, udc, rootPath, currentPath);
+    for(int i = 0; i < children.GetSize(); i++)
+    {
+        executor->SetParent(children[i], job);
     }
 
-    CallUserDefinedCleanup(true, udc->commandLine, rootPath, currentPath, udc->showConsoleWindow, true);
+    return job;
 }
 
-void CDirstatDoc::CallUserDefinedCleanup(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, bool showConsoleWindow, bool wait)
+// Like RecursiveUserDefinedCleanup(), but takes the subdirectories from the
+// tree instead of enumerating the disk again. Subtrees which are not
+// completely read, or whose directory has changed since the scan, are
+// enumerated from disk.
+//
+int CDirstatDoc::RecurseUserDefinedCleanupFromTree(CCleanupExecutor *executor, const USERDEFINEDCLEANUP *udc, const CString& rootPath, CItem *item)
 {
-    CString userCommandLine = BuildUserDefinedCleanupCommandLine(format, rootPath, currentPath);
+    const CString path = item->GetPath();
 
-    CString app = GetCOMSPEC();
-    CString cmdline;
-    cmdline.Format(_T("%s /C %s"), GetBaseNameFromPath(app).GetString(), userCommandLine.GetString());
-    CString directory = isDirectory ? currentPath : GetFolderNameFromPath(currentPath);
+    if(!item->IsDone() || !IsUnchangedSinceScan(item, path))
+    {
+        return RecursiveUserDefinedCleanup(executor, udc, rootPath, path);
+    }
+
+    // Don't load all spilled subtrees at once
+    const bool spilled = item->IsSpilled();
+
+    CArray<int, int> children;
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        CItem *child = item->GetChild(i);
+        if(child->GetType() != IT_DIRECTORY || !IsFollowedByCleanup(child))
+        {
+            continue;
+        }
+
+        children.Add(RecurseUserDefinedCleanupFromTree(executor, udc, rootPath, child));
+    }
+
+    if(spilled)
+    {
+        item->Spill();
+    }
+
+    int job = AddUserDefinedCleanupJob(executor, true, udc, rootPath, path);
+    for(int i = 0; i < children.GetSize(); i++)
+    {
+        executor->SetParent(children[i], job);
+    }
+
+    return job;
+}
+
+// The same decision as in RecursiveUserDefinedCleanup(), but from the
+// attributes recorded during the scan. Only reparse points need a lookup.
+//
+bool CDirstatDoc::IsFollowedByCleanup(const CItem *item)
+{
+    const DWORD attr = item->GetAttributes();
+    if(attr == INVALID_FILE_ATTRIBUTES || (attr & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+    {
+        return true;
+    }
+
+    if(GetWDSApp()->IsVolumeMountPoint(item->GetPath()))
+    {
+        return GetOptions()->IsFollowMountPoints();
+    }
+
+    return GetOptions()->IsFollowJunctionPoints();
+}
+
+// Adding, removing or renaming an entry updates the last write time of
+// the directory. As the last change of an item is the maximum over its
+// subtree, a later time means that the directory has changed since the scan.
+//
+bool CDirstatDoc::IsUnchangedSinceScan(const CItem *item, const CString& path)
+{
+    if(!GetOptions()->IsCleanupCheckFreshness())
+    {
+        return true;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if(!::GetFileAttributesEx(path, GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+
+    FILETIME lastChange = item->GetLastChange();
+    return !(lastChange < data.ftLastWriteTime);
+}
+
+int CDirstatDoc::AddUserDefinedCleanupJob(CCleanupExecutor *executor, bool isDirectory, const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath)
+{
+    CString app, cmdline, directory;
+    GetUserDefinedCleanupProcess(isDirectory, udc->commandLine, rootPath, currentPath, app, cmdline, directory);
+
+    return executor->AddJob(app, cmdline, directory, udc->showConsoleWindow);
+}
+
+// Starts the cleanup without waiting for it.
+//
+void CDirstatDoc::CallUserDefinedCleanup(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, bool showConsoleWindow)
+{
+    CString app, cmdline, directory;
+    GetUserDefinedCleanupProcess(isDirectory, format, rootPath, currentPath, app, cmdline, directory);
 
     STARTUPINFO si;
     ZeroMemory(&si, sizeof(si));
@@ -1074,13 +1708,16 @@ void CDirstatDoc::CallUserDefinedCleanup(bool isDirectory, const CString& format
     }
 
     CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+}
 
-    if(wait)
-    {
-        WaitForHandleWithRepainting(pi.hProcess);
-    }
+void CDirstatDoc::GetUserDefinedCleanupProcess(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, CString& app, CString& cmdline, CString& directory)
+{
+    CString userCommandLine = BuildUserDefinedCleanupCommandLine(format, rootPath, currentPath);
 
-    CloseHandle(pi.hProcess);
+    app = GetCOMSPEC();
+    cmdline.Format(_T("%s /C %s"), GetBaseNameFromPath(app).GetString(), userCommandLine.GetString());
+    directory = isDirectory ? currentPath : GetFolderNameFromPath(currentPath);
 }
 
 
@@ -1166,6 +1803,8 @@ BEGIN_MESSAGE_MAP(CDirstatDoc, CDocument)
     ON_COMMAND(ID_CLEANUP_OPEN, OnCleanupOpen)
     ON_UPDATE_COMMAND_UI(ID_CLEANUP_PROPERTIES, OnUpdateCleanupProperties)
     ON_COMMAND(ID_CLEANUP_PROPERTIES, OnCleanupProperties)
+    ON_UPDATE_COMMAND_UI(ID_REPORT_EXPORT, OnUpdateReportExport)
+    ON_COMMAND(ID_REPORT_EXPORT, OnReportExport)
 END_MESSAGE_MAP()
 
 
@@ -1198,6 +1837,35 @@ void CDirstatDoc::OnRefreshall()
     RefreshItem(GetRootItem());
 }
 
+void CDirstatDoc::OnUpdateReportExport(CCmdUI *pCmdUI)
+{
+    pCmdUI->Enable(IsRootDone());
+}
+
+void CDirstatDoc::OnReportExport()
+{
+    CFileDialog dlg(false, _T("csv"), NULL, OFN_OVERWRITEPROMPT | OFN_HIDEREADONLY | OFN_NOCHANGEDIR, LoadString(IDS_EXPORTFILTER), AfxGetMainWnd());
+    if(IDOK != dlg.DoModal())
+    {
+        return;
+    }
+
+    CWaitCursor wc;
+
+    try
+    {
+        CTreeExporter exporter(CTreeExporter::FormatFromFileName(dlg.GetPathName()));
+        exporter.Export(GetRootItem(), dlg.GetPathName(), false);
+
+        VTRACE(_T("Export: %I64u items, %I64u bytes, %.1f ms"), exporter.GetItemCount(), exporter.GetByteCount(), CScanStatistics::ToMilliseconds(exporter.GetTime()));
+    }
+    catch (CException *pe)
+    {
+        pe->ReportError();
+        pe->Delete();
+    }
+}
+
 void CDirstatDoc::OnUpdateEditCopy(CCmdUI *pCmdUI)
 {
     // FIXME: Multi-select
@@ -1451,28 +2119,17 @@ void CDirstatDoc::OnCommandPromptHere()
 
 void CDirstatDoc::OnUpdateCleanupDeletetotrashbin(CCmdUI *pCmdUI)
 {
-    // FIXME: Multi-select
-    CItem *item = GetSelection(0);
-
-    pCmdUI->Enable(
-        DirectoryListHasFocus()
-        && item != NULL
-        && (IT_DIRECTORY == item->GetType() || IT_FILE == item->GetType())
-        && !item->IsRootItem()
-    );
+    pCmdUI->Enable(DirectoryListHasFocus() && IsSelectionDeletable());
 }
 
 void CDirstatDoc::OnCleanupDeletetotrashbin()
 {
-    // FIXME: Multi-select
-    CItem *item = GetSelection(0);
-
-    if(NULL == item || item->GetType() != IT_DIRECTORY && item->GetType() != IT_FILE || item->IsRootItem())
+    if(!IsSelectionDeletable())
     {
         return;
     }
 
-    if(DeletePhysicalItem(item, true))
+    if(DeletePhysicalItems(true))
     {
         RefreshRecyclers();
         UpdateAllViews(NULL);
@@ -1481,30 +2138,18 @@ void CDirstatDoc::OnCleanupDeletetotrashbin()
 
 void CDirstatDoc::OnUpdateCleanupDelete(CCmdUI *pCmdUI)
 {
-    // FIXME: Multi-select
-    CItem *item = GetSelection(0);
-
-    pCmdUI->Enable(
-        DirectoryListHasFocus()
-        && item != NULL
-        && (IT_DIRECTORY == item->GetType() || IT_FILE == item->GetType())
-        && !item->IsRootItem()
-    );
+    pCmdUI->Enable(DirectoryListHasFocus() && IsSelectionDeletable());
 }
 
 void CDirstatDoc::OnCleanupDelete()
 {
-    // FIXME: Multi-select
-    CItem *item = GetSelection(0);
-
-    if(NULL == item || item->GetType() != IT_DIRECTORY && item->GetType() != IT_FILE || item->IsRootItem())
+    if(!IsSelectionDeletable())
     {
         return;
     }
 
-    if(DeletePhysicalItem(item, false))
+    if(DeletePhysicalItems(false))
     {
-        SetWorkingItem(GetRootItem());
         UpdateAllViews(NULL);
     }
 }
@@ -1540,7 +2185,6 @@ void CDirstatDoc::OnUserdefinedcleanup(UINT id)
     {
         AskForConfirmation(udc, item);
         PerformUserDefinedCleanup(udc, item);
-        RefreshAfterUserDefinedCleanup(udc, item);
     }
     catch (CUserException *pe)
     {
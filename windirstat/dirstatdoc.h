@@ -29,6 +29,7 @@
 
 class CItem;
 class CWorkLimiter;
+class CCleanupExecutor;
 
 //
 // The treemap colors as calculated in CDirstatDoc::SetExtensionColors()
@@ -67,6 +68,7 @@ enum
     HINT_EXTENSIONSELECTIONCHANGED, // Type list selected a new extension
     HINT_ZOOMCHANGED,               // Only zoom item has changed.
     HINT_REDRAWWINDOW,              // Only graphically redraw views.
+    HINT_ICONSCHANGED,              // Icon lookups have finished, redraw the lists.
     HINT_SOMEWORKDONE,              // Directory list shall process mouse messages first, then re-sort.
 
     HINT_LISTSTYLECHANGED,          // Options: List style (grid/stripes) or treelist colors changed
@@ -107,11 +109,14 @@ public:
     const CExtensionData *GetExtensionData();
     ULONGLONG GetRootSize();
 
+    void CreateRootItem(LPCTSTR spec);
     void ForgetItemTree();
     bool Work(CWorkLimiter* limiter); // return: true if done.
     bool IsDrive(CString spec);
     void RefreshMountPointItems();
     void RefreshJunctionItems();
+    void RefreshAllItems();
+    void SpillColdSubtrees();
 
     bool IsRootDone();
     CItem *GetRootItem();
@@ -125,6 +130,7 @@ public:
     void AssertSelectionValid();
     size_t GetSelectionCount();
     bool IsSelected(const CItem *item);
+    bool IsAncestorOfSelection(const CItem *item);
     // FIXME: Multi-select
     CItem *GetSelection(size_t i);
     void SetSelection(const CItem *item, bool keepReselectChildStack = false);
@@ -134,6 +140,7 @@ public:
 
     void UnlinkRoot();
     bool UserDefinedCleanupWorksForItem(const USERDEFINEDCLEANUP *udc, const CItem *item);
+    void RefreshAfterUserDefinedCleanup(REFRESHPOLICY refreshPolicy, const CString& path);
     ULONGLONG GetWorkingItemReadJobs();
 
     void OpenItem(const CItem *item);
@@ -141,23 +148,35 @@ public:
 protected:
     void RecurseRefreshMountPointItems(CItem *item);
     void RecurseRefreshJunctionItems(CItem *item);
+    void RecurseSpillColdSubtrees(CItem *item, ULONGLONG target);
+    bool IsSpillCandidate(const CItem *item);
     void GetDriveItems(CArray<CItem *, CItem *>& drives);
     void RefreshRecyclers();
     void RebuildExtensionData();
+    void RecordScanHistory();
+    void WaitForScanHistory();
+    static UINT _RecordScanHistoryThread(LPVOID param);
     void SortExtensionData(CStringArray& sortedExtensions);
     void SetExtensionColors(const CStringArray& sortedExtensions);
     static CExtensionData *_pqsortExtensionData;
     static int __cdecl _compareExtensions(const void *ext1, const void *ext2);
     void SetWorkingItemAncestor(CItem *item);
     void SetWorkingItem(CItem *item);
-    bool DeletePhysicalItem(CItem *item, bool toTrashBin);
+    bool IsSelectionDeletable();
+    bool DeletePhysicalItems(bool toTrashBin);
     void SetZoomItem(CItem *item);
     void RefreshItem(CItem *item);
+    void RefreshDeletedItem(CItem *item);
+    void ReleaseHardLinks(CItem *item);
     void AskForConfirmation(const USERDEFINEDCLEANUP *udc, CItem *item);
     void PerformUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, CItem *item);
-    void RefreshAfterUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, CItem *item);
-    void RecursiveUserDefinedCleanup(const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath);
-    void CallUserDefinedCleanup(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, bool showConsoleWindow, bool wait);
+    int RecursiveUserDefinedCleanup(CCleanupExecutor *executor, const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath);
+    int RecurseUserDefinedCleanupFromTree(CCleanupExecutor *executor, const USERDEFINEDCLEANUP *udc, const CString& rootPath, CItem *item);
+    bool IsFollowedByCleanup(const CItem *item);
+    bool IsUnchangedSinceScan(const CItem *item, const CString& path);
+    int AddUserDefinedCleanupJob(CCleanupExecutor *executor, bool isDirectory, const USERDEFINEDCLEANUP *udc, const CString& rootPath, const CString& currentPath);
+    void CallUserDefinedCleanup(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, bool showConsoleWindow);
+    void GetUserDefinedCleanupProcess(bool isDirectory, const CString& format, const CString& rootPath, const CString& currentPath, CString& app, CString& cmdline, CString& directory);
     CString BuildUserDefinedCleanupCommandLine(LPCTSTR format, LPCTSTR rootPath, LPCTSTR currentPath);
     void PushReselectChild(CItem *item);
     CItem *PopReselectChild();
@@ -184,6 +203,10 @@ protected:
 
     CList<CItem *, CItem *> m_reselectChildStack; // Stack for the "Re-select Child"-Feature
 
+    ULONGLONG m_spillRetryUsage;    // SpillColdSubtrees() found too little, don't try again below this
+    CWinThread *m_historyThread;    // Records the last scan, see RecordScanHistory(). Or NULL.
+    bool m_fullScan;                // The running scan covers the whole tree, so it goes into the history
+
 protected:
     DECLARE_MESSAGE_MAP()
     afx_msg void OnUpdateRefreshselected(CCmdUI *pCmdUI);
@@ -218,6 +241,8 @@ protected:
     afx_msg void OnCleanupOpen();
     afx_msg void OnUpdateCleanupProperties(CCmdUI *pCmdUI);
     afx_msg void OnCleanupProperties();
+    afx_msg void OnUpdateReportExport(CCmdUI *pCmdUI);
+    afx_msg void OnReportExport();
 
 public:
     #ifdef _DEBUG
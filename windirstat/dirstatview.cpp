@@ -189,7 +189,7 @@ CString CDirstatView::GenerateReport()
         {
             CItem *item = (CItem *)m_treeListControl.GetItem(i);
 
-            if(item->GetType() == IT_MYCOMPUTER)
+            if(item->GetType() == IT_MYCOMPUTER || item->GetType() == IT_REMAINDER)
             {
                 continue;
             }
@@ -332,9 +332,10 @@ void CDirstatView::OnLvnItemchanged(NMHDR *pNMHDR, LRESULT *pResult)
             bool selected = ((m_treeListControl.GetItemState(pNMLV->iItem, LVIS_SELECTED) & LVIS_SELECTED) != 0);
             CItem *item = (CItem *)m_treeListControl.GetItem(pNMLV->iItem);
             ASSERT(item != NULL);
+            // The tree list control transfers its selection to the
+            // document (see CTreeListControl::UpdateDocumentSelection()).
             if(selected)
             {
-                GetDocument()->SetSelection(item);
                 GetDocument()->UpdateAllViews(this, HINT_SELECTIONCHANGED);
             }
         }
@@ -345,6 +346,16 @@ void CDirstatView::OnLvnItemchanged(NMHDR *pNMHDR, LRESULT *pResult)
 
 void CDirstatView::OnUpdate(CView *pSender, LPARAM lHint, CObject *pHint)
 {
+    // List the items added since the last update (in one go, see CTreeListControl::OnChildAdded()).
+    // On HINT_NEWROOT, the old items are already gone.
+    if(lHint != HINT_NEWROOT && m_treeListControl.ApplyPendingChanges())
+    {
+        if(lHint != 0 && lHint != HINT_SOMEWORKDONE) // these Sort() anyway
+        {
+            m_treeListControl.Sort();
+        }
+    }
+
     switch (lHint)
     {
     case HINT_NEWROOT:
@@ -371,11 +382,17 @@ void CDirstatView::OnUpdate(CView *pSender, LPARAM lHint, CObject *pHint)
             CItem *item = (CItem *)pHint;
             m_treeListControl.ExtendSelection(item);
         }
+        break;
 
     case HINT_SHOWNEWSELECTION:
         {
-            // FIXME: Multi-select
-//             const CItem *item = (const CItem *)pHint;
+            m_treeListControl.DeselectAll();
+            for (size_t i = 0; i < GetDocument()->GetSelectionCount(); i++)
+            {
+                m_treeListControl.ExpandPathToItem(GetDocument()->GetSelection(i));
+                m_treeListControl.SelectItem(GetDocument()->GetSelection(i));
+            }
+            m_treeListControl.EnsureItemVisible(GetDocument()->GetSelection(0));
         }
         break;
 
@@ -385,6 +402,12 @@ void CDirstatView::OnUpdate(CView *pSender, LPARAM lHint, CObject *pHint)
         }
         break;
 
+    case HINT_ICONSCHANGED:
+        {
+            m_treeListControl.InvalidateRect(NULL);
+        }
+        break;
+
     case HINT_ZOOMCHANGED:
         {
             CView::OnUpdate(pSender, lHint, pHint);
@@ -0,0 +1,248 @@
+// fileidentity.cpp - Implementation of CFileIdentitySet
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "fileidentity.h"
+#include <common/wds_constants.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    CFileIdentitySet _theFileIdentities;
+
+    const ULONGLONG INITIAL_CAPACITY = 4096;
+}
+
+CFileIdentitySet *GetFileIdentities()
+{
+    return &_theFileIdentities;
+}
+
+CFileIdentitySet::CFileIdentitySet()
+    : m_slots(NULL)
+    , m_capacity(0)
+    , m_count(0)
+    , m_freeLinks(-1)
+{
+}
+
+CFileIdentitySet::~CFileIdentitySet()
+{
+    delete[] m_slots;
+}
+
+// The low bits of a file index are the (sequential) MFT record number,
+// so they need to be mixed before we take them modulo the capacity.
+ULONGLONG CFileIdentitySet::_hash(DWORD volumeSerial, ULONGLONG fileIndex)
+{
+    ULONGLONG h = fileIndex ^ ((ULONGLONG)volumeSerial << 32 | volumeSerial);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool CFileIdentitySet::Insert(DWORD volumeSerial, ULONGLONG fileIndex, LPCTSTR path, ULONGLONG length)
+{
+    // Keep the load factor below 3/4
+    if((m_count + 1) * 4 > m_capacity * 3)
+    {
+        Rehash(m_capacity == 0 ? INITIAL_CAPACITY : m_capacity * 2);
+    }
+
+    const ULONGLONG mask = m_capacity - 1;
+    for(ULONGLONG i = _hash(volumeSerial, fileIndex) & mask; ; i = (i + 1) & mask)
+    {
+        SLOT& slot = m_slots[i];
+        if(!slot.used)
+        {
+            slot.fileIndex = fileIndex;
+            slot.volumeSerial = volumeSerial;
+            slot.used = TRUE;
+            slot.length = length;
+            slot.firstLink = NewLink(path, -1);
+            m_count++;
+            return true;
+        }
+        if(slot.fileIndex == fileIndex && slot.volumeSerial == volumeSerial)
+        {
+            // Behind the counted link
+            const int link = NewLink(path, m_links[slot.firstLink].next);
+            m_links[slot.firstLink].next = link;
+            return false;
+        }
+    }
+}
+
+// Goes through all files, which only ever are files with several links.
+void CFileIdentitySet::Release(LPCTSTR path, bool filesOnly, CArray<HARDLINKMOVE, const HARDLINKMOVE&>& moved)
+{
+    const int length = lstrlen(path);
+    bool removed = false;
+
+    for(ULONGLONG j = 0; j < m_capacity; j++)
+    {
+        SLOT& slot = m_slots[j];
+        if(!slot.used)
+        {
+            continue;
+        }
+
+        bool counted = false;
+        int *link = &slot.firstLink;
+        for(bool first = true; *link != -1; first = false)
+        {
+            const int i = *link;
+            if(_isReleased(m_links[i].path, path, length, filesOnly))
+            {
+                counted = counted || first;
+                *link = m_links[i].next;
+                FreeLink(i);
+            }
+            else
+            {
+                link = &m_links[i].next;
+            }
+        }
+
+        if(slot.firstLink == -1)
+        {
+            slot.used = FALSE;
+            m_count--;
+            removed = true;
+        }
+        else if(counted)
+        {
+            HARDLINKMOVE move;
+            move.path = m_links[slot.firstLink].path;
+            move.length = slot.length;
+            moved.Add(move);
+        }
+    }
+
+    // Free slots would break the probe sequences of the others.
+    if(removed)
+    {
+        Rehash(m_capacity);
+    }
+}
+
+void CFileIdentitySet::RemoveAll()
+{
+    delete[] m_slots;
+    m_slots = NULL;
+    m_capacity = 0;
+    m_count = 0;
+    m_links.RemoveAll();
+    m_freeLinks = -1;
+}
+
+// directory is a path as returned by CItem::GetPath(), so only drives
+// end with a backslash.
+bool CFileIdentitySet::_isReleased(const CString& path, LPCTSTR directory, int length, bool filesOnly)
+{
+    if(length == 0)
+    {
+        return !filesOnly;
+    }
+    if(path.GetLength() < length || _tcsnicmp(path, directory, length) != 0)
+    {
+        return false;
+    }
+
+    int rest = length;
+    if(directory[length - 1] != wds::chrBackslash)
+    {
+        if(path.GetLength() == length)
+        {
+            return !filesOnly;
+        }
+        if(path[length] != wds::chrBackslash)
+        {
+            return false;
+        }
+        rest++;
+    }
+    return !filesOnly || path.Find(wds::chrBackslash, rest) == -1;
+}
+
+int CFileIdentitySet::NewLink(LPCTSTR path, int next)
+{
+    LINK link;
+    link.path = path;
+    link.next = next;
+
+    if(m_freeLinks == -1)
+    {
+        return (int)m_links.Add(link);
+    }
+
+    const int i = m_freeLinks;
+    m_freeLinks = m_links[i].next;
+    m_links[i] = link;
+    return i;
+}
+
+void CFileIdentitySet::FreeLink(int i)
+{
+    m_links[i].path.Empty();
+    m_links[i].next = m_freeLinks;
+    m_freeLinks = i;
+}
+
+ULONGLONG CFileIdentitySet::GetCount() const
+{
+    return m_count;
+}
+
+ULONGLONG CFileIdentitySet::GetMemoryUsage() const
+{
+    return m_capacity * sizeof(SLOT) + m_links.GetSize() * sizeof(LINK);
+}
+
+void CFileIdentitySet::Rehash(ULONGLONG capacity)
+{
+    SLOT *slots = new SLOT[(size_t)capacity];
+    ZeroMemory(slots, (size_t)capacity * sizeof(SLOT));
+
+    const ULONGLONG mask = capacity - 1;
+    for(ULONGLONG j = 0; j < m_capacity; j++)
+    {
+        if(m_slots[j].used)
+        {
+            ULONGLONG i = _hash(m_slots[j].volumeSerial, m_slots[j].fileIndex) & mask;
+            while(slots[i].used)
+            {
+                i = (i + 1) & mask;
+            }
+            slots[i] = m_slots[j];
+        }
+    }
+
+    delete[] m_slots;
+    m_slots = slots;
+    m_capacity = capacity;
+}
@@ -0,0 +1,98 @@
+// fileidentity.h - Declaration of CFileIdentitySet
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_FILEIDENTITY_H__
+#define __WDS_FILEIDENTITY_H__
+#pragma once
+
+//
+// HARDLINKMOVE. A file, whose counted link has been released, and the
+// link, which counts it now (see CFileIdentitySet::Release()).
+//
+struct HARDLINKMOVE
+{
+    CString path;       // The link, which counts the file now
+    ULONGLONG length;   // To be added to its item
+};
+
+//
+// CFileIdentitySet. The files (volume serial number plus file index),
+// which the scanner has already counted. Used to count files with several
+// hard links only once.
+//
+// A build tree can contain tens of millions of links, so this is a flat
+// open addressing hash table (linear probing) rather than a CMap, which
+// would allocate an assoc per key.
+//
+// Each file keeps the paths of its links in the tree. The first one is the
+// link, which is counted. When a refresh or a deletion removes links from
+// the tree, Release() forgets them, and a remaining link takes over.
+//
+class CFileIdentitySet
+{
+public:
+    CFileIdentitySet();
+    ~CFileIdentitySet();
+
+    // Returns true if the file was not yet in the set, i.e. the link at
+    // path counts length bytes.
+    bool Insert(DWORD volumeSerial, ULONGLONG fileIndex, LPCTSTR path, ULONGLONG length);
+    // Forgets the links at or below path (with filesOnly: the links directly
+    // in the directory path). moved: the files, which are still linked
+    // elsewhere, but whose counted link was among them.
+    void Release(LPCTSTR path, bool filesOnly, CArray<HARDLINKMOVE, const HARDLINKMOVE&>& moved);
+    void RemoveAll();
+
+    ULONGLONG GetCount() const;
+    ULONGLONG GetMemoryUsage() const;
+
+private:
+    struct SLOT
+    {
+        ULONGLONG fileIndex;
+        DWORD volumeSerial;
+        DWORD used;
+        ULONGLONG length;   // Counted at the first link
+        int firstLink;      // Index into m_links
+    };
+
+    struct LINK
+    {
+        CString path;
+        int next;           // -1: the last link of the file
+    };
+
+    static ULONGLONG _hash(DWORD volumeSerial, ULONGLONG fileIndex);
+    static bool _isReleased(const CString& path, LPCTSTR directory, int length, bool filesOnly);
+    void Rehash(ULONGLONG capacity);
+    int NewLink(LPCTSTR path, int next);
+    void FreeLink(int i);
+
+    SLOT *m_slots;
+    ULONGLONG m_capacity;   // Power of 2, or 0
+    ULONGLONG m_count;
+    CArray<LINK, const LINK&> m_links;
+    int m_freeLinks;        // Chained by LINK::next, -1: none
+};
+
+CFileIdentitySet *GetFileIdentities();
+
+#endif // __WDS_FILEIDENTITY_H__
@@ -508,6 +508,65 @@ DWORD WaitForHandleWithRepainting(HANDLE h, DWORD TimeOut /*= INFINITE*/)
     return r;
 }
 
+CString MyGetFullPathName(LPCTSTR relativePath)
+{
+    LPTSTR dummy;
+    CString buffer;
+
+    DWORD len = _MAX_PATH;
+
+    DWORD dw = ::GetFullPathName(relativePath, len, buffer.GetBuffer(len), &dummy);
+    buffer.ReleaseBuffer();
+
+    while(dw >= len)
+    {
+        len += _MAX_PATH;
+        dw = ::GetFullPathName(relativePath, len, buffer.GetBuffer(len), &dummy);
+        buffer.ReleaseBuffer();
+    }
+
+    if(0 == dw)
+    {
+        VTRACE(_T("GetFullPathName(%s) failed: GetLastError returns %u"), relativePath, ::GetLastError());
+        return relativePath;
+    }
+
+    return buffer;
+}
+
+// Returns the cluster size of the volume containing path, or 0 if it
+// cannot be determined. The size is queried only once per volume.
+DWORD GetClusterSize(LPCTSTR path)
+{
+    static CMap<CString, LPCTSTR, DWORD, DWORD> clusterSizes;
+
+    CString volume;
+    if(!::GetVolumePathName(path, volume.GetBuffer(_MAX_PATH), _MAX_PATH))
+    {
+        volume.ReleaseBuffer(0);
+        return 0;
+    }
+    volume.ReleaseBuffer();
+    volume.MakeLower();
+
+    DWORD clusterSize;
+    if(!clusterSizes.Lookup(volume, clusterSize))
+    {
+        DWORD sectorsPerCluster, bytesPerSector, freeClusters, totalClusters;
+        if(::GetDiskFreeSpace(volume, &sectorsPerCluster, &bytesPerSector, &freeClusters, &totalClusters))
+        {
+            clusterSize = sectorsPerCluster * bytesPerSector;
+        }
+        else
+        {
+            VTRACE(_T("GetDiskFreeSpace(%s) failed: GetLastError returns %u"), volume, ::GetLastError());
+            clusterSize = 0;
+        }
+        clusterSizes.SetAt(volume, clusterSize);
+    }
+    return clusterSize;
+}
+
 bool FolderExists(LPCTSTR path)
 {
     CFileFind finder;
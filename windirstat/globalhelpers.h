@@ -47,6 +47,8 @@ CString PathFromVolumeName(CString name);
 CString GetFolderNameFromPath(LPCTSTR path);
 CString GetCOMSPEC();
 DWORD WaitForHandleWithRepainting(HANDLE h, DWORD TimeOut = INFINITE);
+CString MyGetFullPathName(LPCTSTR relativePath);
+DWORD GetClusterSize(LPCTSTR path);
 bool FolderExists(LPCTSTR path);
 bool DriveExists(const CString& path);
 CString GetUserName();
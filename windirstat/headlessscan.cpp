@@ -0,0 +1,401 @@
+// headlessscan.cpp - Implementation of CHeadlessScan
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "scanstats.h"
+#include "fileidentity.h"
+#include "spillfile.h"
+#include "scanfilter.h"
+#include "options.h"
+#include "globalhelpers.h"
+#include "WorkLimiter.h"
+#include "treeexporter.h"
+#include "treequery.h"
+#include "scanhistory.h"
+#include "headlessscan.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    // We have no UI to keep responsive, so the slices are only there to
+    // sample the pending read jobs and to keep the memory budget.
+    const ULONGLONG WORK_SLICE = 250;
+}
+
+CHeadlessScan::CHeadlessScan(const CWDSCommandLineInfo& cmdInfo)
+    : m_reportFile(cmdInfo.m_reportFile)
+    , m_topCount(cmdInfo.m_topCount)
+    , m_exportFile(cmdInfo.m_exportFile)
+    , m_compressExport(cmdInfo.m_compressExport)
+    , m_scriptFile(cmdInfo.m_scriptFile)
+    , m_historyFile(cmdInfo.m_historyFile)
+    , m_growthDays(cmdInfo.m_growthDays)
+    , m_spillBudget(cmdInfo.m_spillBudget)
+{
+}
+
+int CHeadlessScan::Run(LPCTSTR path)
+{
+    if(*path == 0)
+    {
+        WriteReport(_T("Usage: windirstat /headless <folder or drive> [/report:<file>] [/top:<n>] [/export:<file> [/compress]] [/script:<file>] [/history:<file> [/growth:<days>]] [/budget:<MB>]\r\n"));
+        return EXIT_USAGE;
+    }
+
+    CString folder = MyGetFullPathName(path);
+    if(folder.GetLength() > 3 && folder.Right(1) == wds::chrBackslash)
+    {
+        folder = folder.Left(folder.GetLength() - 1);
+    }
+    if(!FolderExists(folder) && !DriveExists(folder))
+    {
+        VTRACE(_T("Headless scan: %s not found"), folder.GetString());
+        return EXIT_NOTFOUND;
+    }
+
+    // A document without views. CItem leaves the tree list and the
+    // main frame alone, as long as nothing is visible.
+    CDirstatDoc *doc = (CDirstatDoc *)RUNTIME_CLASS(CDirstatDoc)->CreateObject();
+    doc->DeleteContents(); // --> InvalidateMountPoints()
+
+    GetScanStatistics()->Reset();
+    GetFileIdentities()->RemoveAll();
+    GetSpillFile()->Reset();
+
+    // Not saved, we never call COptions::SaveToRegistry().
+    if(m_spillBudget >= 0)
+    {
+        GetOptions()->SetSpillBudget(m_spillBudget);
+    }
+    GetScanFilter()->StartScan();
+
+    CStringArray drives;
+    doc->CreateRootItem(CDirstatDoc::EncodeSelection(RADIO_AFOLDER, folder, drives));
+
+    CItem *root = doc->GetRootItem();
+    CWorkLimiter limiter;
+    while(!root->IsDone())
+    {
+        limiter.Start(WORK_SLICE);
+        root->DoSomeWork(&limiter);
+        GetScanStatistics()->SamplePendingReadJobs(root->GetReadJobs());
+        doc->SpillColdSubtrees();
+    }
+    GetScanStatistics()->Finish();
+
+    CollectLargestFolders(root);
+    CString report = FormatReport(root, doc->GetExtensionData());
+    m_largestFolders.RemoveAll();
+
+    bool exported = true;
+    if(!m_exportFile.IsEmpty())
+    {
+        CString result;
+        exported = Export(root, result);
+        report += _T("\r\n") + result;
+    }
+
+    bool scripted = true;
+    if(!m_scriptFile.IsEmpty())
+    {
+        CString result;
+        scripted = RunScript(root, result);
+        report += _T("\r\n") + result;
+    }
+
+    bool recorded = true;
+    if(!m_historyFile.IsEmpty())
+    {
+        CString result;
+        recorded = RecordHistory(root, doc->GetExtensionData(), result);
+        report += _T("\r\n") + result;
+    }
+
+    delete doc;
+
+    if(!WriteReport(report) || !exported)
+    {
+        return EXIT_CANNOTWRITE;
+    }
+    if(!scripted)
+    {
+        return EXIT_SCRIPTFAILED;
+    }
+    return recorded ? EXIT_OK : EXIT_HISTORYFAILED;
+}
+
+// Writes the tree to m_exportFile. result: what was written and how fast,
+// or the error.
+bool CHeadlessScan::Export(CItem *root, CString& result)
+{
+    try
+    {
+        CTreeExporter exporter(CTreeExporter::FormatFromFileName(m_exportFile));
+        exporter.Export(root, m_exportFile, m_compressExport);
+
+        const double ms = CScanStatistics::ToMilliseconds(exporter.GetTime());
+        result.Format(_T("Export:             %I64u items, %I64u bytes, %.1f ms (%.1f MB/s)\r\n"),
+            exporter.GetItemCount(), exporter.GetByteCount(), ms, ms > 0 ? exporter.GetByteCount() / 1000.0 / ms : 0.0);
+    }
+    catch (CException *pe)
+    {
+        TCHAR message[1024];
+        pe->GetErrorMessage(message, _countof(message));
+        pe->Delete();
+        result.Format(_T("Export failed:      %s\r\n"), message);
+        return false;
+    }
+    return true;
+}
+
+// Runs m_scriptFile over a snapshot of the tree. result: what the script
+// printed and the timings, or the error.
+bool CHeadlessScan::RunScript(CItem *root, CString& result)
+{
+    CTreeQuery query;
+    query.Snapshot(root);
+
+    CString output;
+    const bool ok = query.Run(m_scriptFile, output);
+
+    CString line;
+    line.Format(_T("%s%d nodes, snapshot %.1f ms, run %.1f ms\r\n"),
+        ok ? _T("Script:             ") : _T("Script failed:      "), query.GetNodeCount(),
+        CScanStatistics::ToMilliseconds(query.GetSnapshotTime()), CScanStatistics::ToMilliseconds(query.GetRunTime()));
+
+    result = output;
+    if(!result.IsEmpty() && result.Right(2) != _T("\r\n"))
+    {
+        result += _T("\r\n");
+    }
+    result += line;
+    return ok;
+}
+
+// Adds the scan to m_historyFile and, with m_growthDays, lists the
+// m_topCount folders which grew most. result: the rows written and how
+// fast, the growth, or the error.
+bool CHeadlessScan::RecordHistory(CItem *root, const CExtensionData *extensionData, CString& result)
+{
+    CScanHistory history;
+    if(!history.Open(m_historyFile))
+    {
+        result.Format(_T("History failed:     %s\r\n"), history.GetLastError().GetString());
+        return false;
+    }
+
+    HISTORYSNAPSHOT snapshot;
+    CScanHistory::Snapshot(root, extensionData, snapshot);
+    const LONGLONG scan = history.Record(snapshot);
+    if(scan == 0)
+    {
+        result.Format(_T("History failed:     %s\r\n"), history.GetLastError().GetString());
+        return false;
+    }
+
+    const double ms = CScanStatistics::ToMilliseconds(history.GetRecordTime());
+    result.Format(_T("History:            scan %I64d, %I64u rows, %.1f ms (%.0f rows/s)\r\n"),
+        scan, history.GetRecordedRows(), ms, ms > 0 ? history.GetRecordedRows() * 1000.0 / ms : 0.0);
+
+    if(m_growthDays < 0)
+    {
+        return true;
+    }
+
+    const LONGLONG since = CScanHistory::GetUnixTime() - (LONGLONG)m_growthDays * 86400;
+
+    LONGLONG baselineTime;
+    CArray<HISTORYGROWTH, HISTORYGROWTH&> growth;
+    if(!history.GetGrowth(scan, since, m_topCount, baselineTime, growth))
+    {
+        CString line;
+        line.Format(_T("Growth failed:      %s\r\n"), history.GetLastError().GetString());
+        result += line;
+        return false;
+    }
+
+    if(baselineTime == 0)
+    {
+        result += _T("\r\nGrowth: no earlier scan to compare with.\r\n");
+        return true;
+    }
+
+    // As a number, so that scripts can parse it
+    CString line;
+    line.Format(_T("\r\nGrowth since the scan at %I64d:\r\n"), baselineTime);
+    result += line;
+    for(int i = 0; i < growth.GetSize(); i++)
+    {
+        line.Format(_T("  %+16I64d %16I64u  %s\r\n"), growth[i].growth, growth[i].size, growth[i].path.GetString());
+        result += line;
+    }
+    return true;
+}
+
+// Keeps the m_topCount largest folders (subtree sizes) in m_largestFolders.
+void CHeadlessScan::CollectLargestFolders(CItem *item)
+{
+    if(item->GetType() != IT_DIRECTORY && item->GetType() != IT_DRIVE && item->GetType() != IT_MYCOMPUTER)
+    {
+        return;
+    }
+
+    if(item->GetType() != IT_MYCOMPUTER)
+    {
+        const ULONGLONG size = item->GetSize();
+        const int count = (int)m_largestFolders.GetSize();
+        if(count < m_topCount || size > m_largestFolders[count - 1].bytes)
+        {
+            int i = 0;
+            while(i < count && m_largestFolders[i].bytes >= size)
+            {
+                i++;
+            }
+            FOLDERTOTAL folder;
+            folder.path = item->GetPath();
+            folder.files = item->GetFilesCount();
+            folder.bytes = size;
+            m_largestFolders.InsertAt(i, folder);
+            if(m_largestFolders.GetSize() > m_topCount)
+            {
+                m_largestFolders.SetSize(m_topCount);
+            }
+        }
+    }
+
+    // Don't load all spilled subtrees at once
+    const bool spilled = item->IsSpilled();
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        CollectLargestFolders(item->GetChild(i));
+    }
+
+    if(spilled)
+    {
+        item->Spill();
+    }
+}
+
+CString CHeadlessScan::FormatReport(const CItem *root, const CExtensionData *extensionData)
+{
+    CString report;
+    CString line;
+
+    line.Format(_T("WinDirStat report for %s\r\n\r\n"), root->GetPath().GetString());
+    report += line;
+    line.Format(_T("Size:        %I64u bytes\r\nFiles:       %I64u\r\nDirectories: %I64u\r\n"),
+        root->GetSize(), root->GetFilesCount(), root->GetSubdirsCount());
+    report += line;
+
+    // Sizes are written in bytes, without thousands separators,
+    // so that scripts can parse the report.
+    report += _T("\r\nLargest folders:\r\n");
+    for(int i = 0; i < m_largestFolders.GetSize(); i++)
+    {
+        const FOLDERTOTAL& folder = m_largestFolders[i];
+        line.Format(_T("  %16I64u %10I64u files  %s\r\n"), folder.bytes, folder.files, folder.path.GetString());
+        report += line;
+    }
+
+    CArray<EXTENSIONTOTAL, EXTENSIONTOTAL&> extensions;
+    extensions.SetSize(extensionData->GetCount());
+
+    int n = 0;
+    POSITION pos = extensionData->GetStartPosition();
+    while(pos != NULL)
+    {
+        CString ext;
+        SExtensionRecord r;
+        extensionData->GetNextAssoc(pos, ext, r);
+
+        extensions[n].ext = ext;
+        extensions[n].files = r.files;
+        extensions[n].bytes = r.bytes;
+        n++;
+    }
+
+    qsort(extensions.GetData(), extensions.GetSize(), sizeof(EXTENSIONTOTAL), &_compareExtensionTotals);
+
+    report += _T("\r\nExtensions:\r\n");
+    for(int i = 0; i < extensions.GetSize() && i < m_topCount; i++)
+    {
+        line.Format(_T("  %16I64u %10I64u files  %s\r\n"), extensions[i].bytes, extensions[i].files,
+            extensions[i].ext.IsEmpty() ? _T("(none)") : extensions[i].ext.GetString());
+        report += line;
+    }
+
+    report += _T("\r\nScan statistics:\r\n");
+    report += GetScanStatistics()->FormatReport();
+
+    return report;
+}
+
+// Writes the report as UTF-8 to m_reportFile, or to stdout.
+bool CHeadlessScan::WriteReport(const CString& report)
+{
+    CW2A utf8(report, CP_UTF8);
+    const DWORD length = (DWORD)strlen(utf8);
+
+    if(m_reportFile.IsEmpty())
+    {
+        // We are a GUI application. Without redirection, we borrow
+        // the console of the command prompt, if there is one.
+        HANDLE out = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        if(out == NULL || out == INVALID_HANDLE_VALUE)
+        {
+            ::AttachConsole(ATTACH_PARENT_PROCESS);
+            out = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        }
+        DWORD written = 0;
+        return out != NULL && out != INVALID_HANDLE_VALUE && ::WriteFile(out, (LPCSTR)utf8, length, &written, NULL) && written == length;
+    }
+
+    try
+    {
+        CFile file(m_reportFile, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite);
+        file.Write((LPCSTR)utf8, length);
+        file.Close();
+    }
+    catch (CException *pe)
+    {
+        TCHAR message[1024];
+        pe->GetErrorMessage(message, _countof(message));
+        VTRACE(_T("Headless scan: %s"), message);
+        pe->Delete();
+        return false;
+    }
+    return true;
+}
+
+// Largest first
+int __cdecl CHeadlessScan::_compareExtensionTotals(const void *p1, const void *p2)
+{
+    const EXTENSIONTOTAL *e1 = (const EXTENSIONTOTAL *)p1;
+    const EXTENSIONTOTAL *e2 = (const EXTENSIONTOTAL *)p2;
+
+    return usignum(e2->bytes, e1->bytes);
+}
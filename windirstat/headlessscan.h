@@ -0,0 +1,97 @@
+// headlessscan.h - Declaration of CHeadlessScan
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_HEADLESSSCAN_H__
+#define __WDS_HEADLESSSCAN_H__
+#pragma once
+
+#include "dirstatdoc.h"
+
+class CItem;
+class CWDSCommandLineInfo;
+
+//
+// CHeadlessScan. Scans a folder or drive without creating any window
+// ("windirstat.exe /headless <path> [/report:<file>] [/top:<n>]
+// [/export:<file> [/compress]] [/script:<file>] [/history:<file>
+// [/growth:<days>]] [/budget:<MB>]"), e.g. from a scheduled task. There is no message loop: the scan runs as fast
+// as it can, then a plain text report (largest folders, extensions, scan
+// statistics) is written to the file or to stdout. /export additionally
+// writes the whole tree (see CTreeExporter). /script runs a Lua script
+// over the tree and appends what it prints (see CTreeQuery). /history
+// adds the directory totals to a database and /growth reports the folders,
+// which grew most since the scan that many days ago (see CScanHistory).
+// /budget
+// overrides the memory budget (see COptions::GetSpillBudget()).
+// Run() returns the process exit code.
+//
+class CHeadlessScan
+{
+public:
+    enum
+    {
+        EXIT_OK,
+        EXIT_USAGE,         // No path given
+        EXIT_NOTFOUND,      // The path is not an accessible folder or drive
+        EXIT_CANNOTWRITE,   // The report or the export could not be written
+        EXIT_SCRIPTFAILED,  // The script could not be read or raised an error
+        EXIT_HISTORYFAILED  // The history database could not be written or queried
+    };
+
+    CHeadlessScan(const CWDSCommandLineInfo& cmdInfo);
+    int Run(LPCTSTR path);
+
+protected:
+    struct EXTENSIONTOTAL
+    {
+        CString ext;
+        ULONGLONG files;
+        ULONGLONG bytes;
+    };
+
+    // A copy, not the CItem, because the item may be spilled meanwhile.
+    struct FOLDERTOTAL
+    {
+        CString path;
+        ULONGLONG files;
+        ULONGLONG bytes;
+    };
+
+    void CollectLargestFolders(CItem *item);
+    bool Export(CItem *root, CString& result);
+    bool RunScript(CItem *root, CString& result);
+    bool RecordHistory(CItem *root, const CExtensionData *extensionData, CString& result);
+    CString FormatReport(const CItem *root, const CExtensionData *extensionData);
+    bool WriteReport(const CString& report);
+    static int __cdecl _compareExtensionTotals(const void *p1, const void *p2);
+
+    CString m_reportFile;   // Empty: stdout
+    int m_topCount;         // Number of folders and extensions to report
+    CString m_exportFile;   // Empty: no export
+    bool m_compressExport;
+    CString m_scriptFile;   // Empty: no script
+    CString m_historyFile;  // Empty: no history
+    int m_growthDays;       // -1: no growth report
+    int m_spillBudget;      // MB, -1: keep the option
+    CArray<FOLDERTOTAL, FOLDERTOTAL&> m_largestFolders; // Largest first
+};
+
+#endif // __WDS_HEADLESSSCAN_H__
@@ -28,6 +28,12 @@
 #include "WorkLimiter.h"
 #include "item.h"
 #include "globalhelpers.h"
+#include "scanstats.h"
+#include "fileidentity.h"
+#include "spillfile.h"
+#include "scanfilter.h"
+#include "set.h"
+#include <algorithm>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -40,8 +46,104 @@ namespace
 
     const SIZE sizeDeflatePacman = { 1, 2 };
 
+    // While scanning, the UI (paint, pacmen) is updated every VISUAL_UPDATE_INTERVAL ms,
+    // between directories. The enumeration of a directory does no UI work.
+    const ULONGLONG VISUAL_UPDATE_INTERVAL = 40;
+
     // File attribute packing
     const unsigned char INVALID_m_attributes = 0x80;
+
+    // The cluster size to round file sizes to, or 0 if the allocated size
+    // option is off (or the volume does not tell).
+    DWORD GetAllocationClusterSize(const CString& path)
+    {
+        return GetOptions()->IsAllocatedSize() ? GetClusterSize(path) : 0;
+    }
+
+    ULONGLONG GetFoundLength(const CFileFindWDS& finder, DWORD clusterSize)
+    {
+        return clusterSize > 0 ? finder.GetAllocatedLength(clusterSize) : finder.GetCompressedLength();
+    }
+
+    // With the "count hard links only once" option, a file with several
+    // links is counted where the scan finds it first. Only such files go
+    // into the identity set, which keeps it small on ordinary volumes.
+    // length: what the file counts, if this is its first link.
+    bool IsFurtherHardLink(const CFileFindWDS& finder, ULONGLONG length)
+    {
+        DWORD volumeSerial;
+        ULONGLONG fileIndex;
+        DWORD links;
+        if(!finder.GetFileIdentity(volumeSerial, fileIndex, links) || links < 2)
+        {
+            return false;
+        }
+        return !GetFileIdentities()->Insert(volumeSerial, fileIndex, finder.GetFilePath(), length);
+    }
+
+    // A spilled item, as written by CItem::RecurseWriteChildren().
+    // It is followed by the name and then by its children.
+    struct SPILLEDITEM
+    {
+        ULONGLONG size;
+        ULONGLONG files;
+        ULONGLONG subdirs;
+        FILETIME lastChange;
+        ULONGLONG ticksWorked;
+        DWORD childCount;
+        DWORD nameLength;           // in TCHARs
+        WORD type;
+        unsigned char attributes;   // Packed, see CItem::SetAttributes()
+        unsigned char reserved;
+    };
+
+    // Grow in large steps, the data can be megabytes.
+    const INT_PTR SPILL_GROW_BY = 64 * 1024;
+
+    void AppendBytes(CArray<BYTE, BYTE>& data, const void *bytes, size_t length)
+    {
+        const INT_PTR size = data.GetSize();
+        data.SetSize(size + length, SPILL_GROW_BY);
+        memcpy(data.GetData() + size, bytes, length);
+    }
+
+    void ReadBytes(const BYTE *&p, const BYTE *end, void *bytes, size_t length)
+    {
+        ASSERT(p + length <= end);
+        memcpy(bytes, p, length);
+        p += length;
+    }
+
+    // Like CItem::ReadChildren(), but only the directories, without items
+    void ReadDirectories(const BYTE *&p, const BYTE *end, DWORD count, CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&>& directories, int parent)
+    {
+        for(DWORD i = 0; i < count; i++)
+        {
+            SPILLEDITEM record;
+            ReadBytes(p, end, &record, sizeof(record));
+
+            int index = parent;
+            if((record.type & ~ITF_FLAGS) == IT_DIRECTORY)
+            {
+                DIRECTORYTOTALS directory;
+                directory.parent = parent;
+                ReadBytes(p, end, directory.name.GetBuffer(record.nameLength), record.nameLength * sizeof(TCHAR));
+                directory.name.ReleaseBuffer(record.nameLength);
+                directory.size = record.size;
+                directory.files = record.files;
+                directory.subdirs = record.subdirs;
+                directory.lastChange = record.lastChange;
+                index = (int)directories.Add(directory);
+            }
+            else
+            {
+                ASSERT(p + record.nameLength * sizeof(TCHAR) <= end);
+                p += record.nameLength * sizeof(TCHAR);
+            }
+
+            ReadDirectories(p, end, record.childCount, directories, index);
+        }
+    }
 }
 
 
@@ -55,11 +157,13 @@ CItem::CItem(ITEMTYPE type, LPCTSTR name, bool dontFollow)
     , m_subdirs(0)
     , m_readJobDone(false)
     , m_done(false)
+    , m_spilled(false)
     , m_ticksWorked(0)
     , m_readJobs(0)
     , m_attributes(0)
+    , m_schedule(NULL)
 {
-    if(GetType() == IT_FILE || dontFollow || GetType() == IT_FREESPACE || GetType() == IT_UNKNOWN || GetType() == IT_MYCOMPUTER)
+    if(GetType() == IT_FILE || dontFollow || GetType() == IT_FREESPACE || GetType() == IT_UNKNOWN || GetType() == IT_MYCOMPUTER || GetType() == IT_REMAINDER)
     {
         SetReadJobDone();
         m_readJobs = 0;
@@ -75,6 +179,8 @@ CItem::CItem(ITEMTYPE type, LPCTSTR name, bool dontFollow)
     }
 
     ZeroMemory(&m_lastChange, sizeof(m_lastChange));
+
+    _memoryUsage += GetOwnMemoryUsage();
 }
 
 CItem::~CItem()
@@ -83,6 +189,14 @@ CItem::~CItem()
     {
         delete m_children[i];
     }
+    delete m_schedule;
+
+    // Also a rehydrated subtree keeps its record (see Rehydrate()).
+    if(!IsLeaf(GetType()))
+    {
+        GetSpillFile()->Discard(this);
+    }
+    _memoryUsage -= GetOwnMemoryUsage();
 }
 
 CRect CItem::TmiGetRectangle() const
@@ -216,7 +330,7 @@ CString CItem::GetText(int subitem) const
         break;
 
     case COL_ATTRIBUTES:
-        if(GetType() != IT_FREESPACE && GetType() != IT_UNKNOWN && GetType() != IT_MYCOMPUTER && GetType() != IT_FILESFOLDER)
+        if(GetType() != IT_FREESPACE && GetType() != IT_UNKNOWN && GetType() != IT_MYCOMPUTER && GetType() != IT_FILESFOLDER && GetType() != IT_REMAINDER)
         {
             s = FormatAttributes(GetAttributes());
         }
@@ -263,6 +377,16 @@ int CItem::CompareSibling(const CTreeListItem *tlib, int subitem) const
 {
     CItem *other = (CItem *)tlib;
 
+    // The remainder item is always last, regardless of the sort order.
+    if(GetType() == IT_REMAINDER)
+    {
+        return 2;
+    }
+    if(other->GetType() == IT_REMAINDER)
+    {
+        return -2;
+    }
+
     int r = 0;
     switch (subitem)
     {
@@ -350,14 +474,20 @@ int CItem::CompareSibling(const CTreeListItem *tlib, int subitem) const
     return r;
 }
 
+// Reads a spilled subtree back (see Spill()). The tree list and the
+// walks over the tree see it like any other, so this can mean disk I/O.
 int CItem::GetChildrenCount() const
 {
+    if(m_spilled)
+    {
+        const_cast<CItem *>(this)->Rehydrate();
+    }
     return int(m_children.GetSize());
 }
 
 CTreeListItem *CItem::GetTreeListChild(int i) const
 {
-    return m_children[i];
+    return GetChild(i);
 }
 
 int CItem::GetImageToCache() const
@@ -382,6 +512,10 @@ int CItem::GetImageToCache() const
     {
         image = GetMyImageList()->getUnknownImage();
     }
+    else if(GetType() == IT_REMAINDER)
+    {
+        image = GetMyImageList()->getEmptyImage();
+    }
     else
     {
         CString path = GetPath();
@@ -394,14 +528,78 @@ int CItem::GetImageToCache() const
         {
             image = GetMyImageList()->getJunctionImage();
         }
+        else if(GetType() == IT_DIRECTORY)
+        {
+            image = GetMyImageList()->getDirectoryImage(path, GetAttributes());
+        }
+        else if(GetType() == IT_FILE)
+        {
+            image = GetMyImageList()->getFileItemImage(path, GetExtension());
+        }
         else
         {
-            image = GetMyImageList()->getFileImage(path);
+            image = GetMyImageList()->getDriveImage(path);
         }
     }
     return image;
 }
 
+ULONGLONG CItem::GetTreeListWeight() const
+{
+    return GetSize();
+}
+
+CTreeListItem *CItem::CreateRemainderItem() const
+{
+    CItem *remainder = new CItem(IT_REMAINDER, wds::strEmpty);
+    remainder->SetParent(const_cast<CItem *>(this));
+    remainder->m_done = true;
+    return remainder;
+}
+
+// The remainder item sums up all our children, which are not listed.
+void CItem::UpdateRemainderItem(CTreeListItem *tlremainder, CTreeListItem *const *listed, int listedCount) const
+{
+    CItem *remainder = (CItem *)tlremainder;
+    ASSERT(remainder->GetType() == IT_REMAINDER);
+
+    CSet<const CTreeListItem *, const CTreeListItem *> isListed;
+    isListed.InitHashTable(listedCount * 2 + 1);
+    for(int i = 0; i < listedCount; i++)
+    {
+        isListed.SetKey(listed[i]);
+    }
+
+    remainder->m_size = 0;
+    remainder->m_files = 0;
+    remainder->m_subdirs = 0;
+    ZeroMemory(&remainder->m_lastChange, sizeof(remainder->m_lastChange));
+
+    for(int i = 0; i < GetChildrenCount(); i++)
+    {
+        const CItem *child = GetChild(i);
+        if(isListed.Lookup(child))
+        {
+            continue;
+        }
+
+        remainder->m_size += child->GetSize();
+        remainder->m_files += child->GetFilesCount() + (child->GetType() == IT_FILE ? 1 : 0);
+        remainder->m_subdirs += child->GetSubdirsCount() + (child->GetType() == IT_DIRECTORY ? 1 : 0);
+        if(remainder->m_lastChange < child->GetLastChange())
+        {
+            remainder->m_lastChange = child->GetLastChange();
+        }
+    }
+
+    remainder->m_name.FormatMessage(IDS_sMOREITEMS, FormatCount(GetChildrenCount() - listedCount).GetString());
+}
+
+bool CItem::IsRemainderItem() const
+{
+    return GetType() == IT_REMAINDER;
+}
+
 void CItem::DrawAdditionalState(CDC *pdc, const CRect& rcLabel) const
 {
     if(!IsRootItem() && this == GetDocument()->GetZoomItem())
@@ -423,6 +621,13 @@ int CItem::GetSubtreePercentageWidth()
     return 105;
 }
 
+// Approximately, the memory our items occupy. COptions::GetSpillBudget()
+// is compared with this.
+ULONGLONG CItem::GetMemoryUsage()
+{
+    return _memoryUsage;
+}
+
 CItem *CItem::FindCommonAncestor(const CItem *item1, const CItem *item2)
 {
     const CItem *parent = item1;
@@ -545,8 +750,13 @@ void CItem::UpdateLastChange()
     }
 }
 
+// Like GetChildrenCount(), this can read a spilled subtree back.
 CItem *CItem::GetChild(int i) const
 {
+    if(m_spilled)
+    {
+        const_cast<CItem *>(this)->Rehydrate();
+    }
     return m_children[i];
 }
 
@@ -579,29 +789,54 @@ void CItem::AddChild(CItem *child)
     UpwardAddReadJobs(child->GetReadJobs());
     UpwardUpdateLastChange(child->GetLastChange());
 
+    LinkChild(child);
+}
+
+// Adds child to our children without touching the totals.
+void CItem::LinkChild(CItem *child)
+{
+    DeleteSchedule();
     m_children.Add(child);
     child->SetParent(this);
 
-    GetTreeListControl()->OnChildAdded(this, child);
+    // The tree list only cares about visible parents. (During a
+    // headless scan there is no tree list at all.)
+    if(IsVisible())
+    {
+        GetTreeListControl()->OnChildAdded(this, child);
+    }
 }
 
 void CItem::RemoveChild(int i)
 {
     CItem *child = GetChild(i);
     m_children.RemoveAt(i);
-    GetTreeListControl()->OnChildRemoved(this, child);
+    DeleteSchedule();
+    if(IsVisible())
+    {
+        GetTreeListControl()->OnChildRemoved(this, child);
+    }
     delete child;
 }
 
 void CItem::RemoveAllChildren()
 {
-    GetTreeListControl()->OnRemovingAllChildren(this);
+    if(IsVisible())
+    {
+        GetTreeListControl()->OnRemovingAllChildren(this);
+    }
+
+    // No need to load them only to delete them. The record of a
+    // rehydrated subtree is obsolete, too.
+    GetSpillFile()->Discard(this);
+    m_spilled = false;
 
     for(int i = 0; i < GetChildrenCount(); i++)
     {
         delete m_children[i];
     }
     m_children.SetSize(0);
+    DeleteSchedule();
 }
 
 void CItem::UpwardAddSubdirs(ULONGLONG dirCount)
@@ -690,6 +925,53 @@ void CItem::UpwardUpdateLastChange(const FILETIME& t)
     }
 }
 
+CItem::SUBTREEDELTA::SUBTREEDELTA()
+    : size(0)
+    , files(0)
+    , subdirs(0)
+    , readJobs(0)
+{
+    ZeroMemory(&lastChange, sizeof(lastChange));
+}
+
+void CItem::SUBTREEDELTA::Add(const SUBTREEDELTA& other)
+{
+    size += other.size;
+    files += other.files;
+    subdirs += other.subdirs;
+    readJobs += other.readJobs;
+    UpdateLastChange(other.lastChange);
+}
+
+void CItem::SUBTREEDELTA::UpdateLastChange(const FILETIME& t)
+{
+    if(lastChange < t)
+    {
+        lastChange = t;
+    }
+}
+
+// Adds delta to our own totals only
+void CItem::AddDelta(const SUBTREEDELTA& delta)
+{
+    m_size += delta.size;
+    m_files += delta.files;
+    m_subdirs += delta.subdirs;
+    m_readJobs += (ULONGLONG)delta.readJobs; // wraps around, if negative
+    if(m_lastChange < delta.lastChange)
+    {
+        m_lastChange = delta.lastChange;
+    }
+}
+
+void CItem::UpwardAddDelta(const SUBTREEDELTA& delta)
+{
+    for(CItem *p = this; p != NULL; p = p->GetParent())
+    {
+        p->AddDelta(delta);
+    }
+}
+
 // This method may also decrease the last change
 void CItem::UpwardRecalcLastChange()
 {
@@ -828,6 +1110,11 @@ double CItem::GetFraction() const
     {
         return 1.0;
     }
+    // While scanning, our parent's total may lag behind ours (see SUBTREEDELTA).
+    if(GetSize() > GetParent()->GetSize())
+    {
+        return 1.0;
+    }
     return (double) GetSize() / GetParent()->GetSize();
 }
 
@@ -1004,24 +1291,7 @@ void CItem::SetDone()
     if(GetType() == IT_DRIVE)
     {
         UpdateFreeSpaceItem();
-
-        if(GetDocument()->OptionShowUnknown())
-        {
-            CItem *unknown = FindUnknownItem();
-
-            ULONGLONG total;
-            ULONGLONG free;
-            CDirstatApp::getDiskFreeSpace(GetPath(), total, free);
-
-            ULONGLONG unknownspace = total - GetSize();
-            if(!GetDocument()->OptionShowFreeSpace())
-            {
-                unknownspace -= free;
-            }
-            unknown->SetSize(unknownspace);
-
-            UpwardAddSize(unknownspace);
-        }
+        UpdateUnknownItem();
     }
 
 // #ifdef _DEBUG
@@ -1036,9 +1306,98 @@ void CItem::SetDone()
 
     ZeroMemory(&m_rect, sizeof(m_rect));
 
+    DeleteSchedule();
     m_done = true;
 }
 
+// Heap order for m_schedule: the child with the least ticks worked on top
+bool CItem::_isMoreWorked(const CItem *item1, const CItem *item2)
+{
+    return item1->GetTicksWorked() > item2->GetTicksWorked();
+}
+
+// Returns the unfinished child we have worked on least, or NULL.
+// Only the first call after a change of our children is O(n), the
+// following ones are O(1), with O(log n) in RescheduleChild().
+CItem *CItem::GetScheduledChild()
+{
+    const ULONGLONG start = CScanStatistics::Now();
+
+    if(m_schedule == NULL)
+    {
+        m_schedule = new CArray<CItem *, CItem *>;
+        m_schedule->SetSize(0, GetChildrenCount());
+        for(int i = 0; i < GetChildrenCount(); i++)
+        {
+            if(!GetChild(i)->IsDone())
+            {
+                m_schedule->Add(GetChild(i));
+            }
+        }
+        std::make_heap(m_schedule->GetData(), m_schedule->GetData() + m_schedule->GetSize(), _isMoreWorked);
+    }
+
+    CItem *child = (m_schedule->GetSize() > 0) ? m_schedule->GetAt(0) : NULL;
+
+    GetScanStatistics()->scheduleSteps++;
+    GetScanStatistics()->scheduleTime += CScanStatistics::Now() - start;
+
+    return child;
+}
+
+// The child on top of the heap has been worked on. Restore the heap order.
+// Its ticks have changed already, so the range is no valid heap for
+// std::pop_heap() any more. We sift the top down ourselves.
+void CItem::RescheduleChild()
+{
+    if(m_schedule == NULL)
+    {
+        // Our children have changed meanwhile
+        return;
+    }
+
+    const ULONGLONG start = CScanStatistics::Now();
+
+    ASSERT(m_schedule->GetSize() > 0);
+    CItem **first = m_schedule->GetData();
+    INT_PTR count = m_schedule->GetSize();
+
+    if(first[0]->IsDone())
+    {
+        count--;
+        first[0] = first[count];
+        m_schedule->SetSize(count);
+    }
+
+    INT_PTR i = 0;
+    for(;;)
+    {
+        INT_PTR c = 2 * i + 1;
+        if(c >= count)
+        {
+            break;
+        }
+        if(c + 1 < count && _isMoreWorked(first[c], first[c + 1]))
+        {
+            c++;
+        }
+        if(!_isMoreWorked(first[i], first[c]))
+        {
+            break;
+        }
+        std::swap(first[i], first[c]);
+        i = c;
+    }
+
+    GetScanStatistics()->scheduleTime += CScanStatistics::Now() - start;
+}
+
+void CItem::DeleteSchedule()
+{
+    delete m_schedule;
+    m_schedule = NULL;
+}
+
 ULONGLONG CItem::GetTicksWorked() const
 {
     return m_ticksWorked;
@@ -1050,6 +1409,37 @@ void CItem::AddTicksWorked(ULONGLONG more)
 }
 
 void CItem::DoSomeWork(CWorkLimiter* limiter)
+{
+    // Attribute the statistics to the drive we are on. For a folder
+    // scan, the folder stands for the volume. (Below My Computer, the
+    // drives set it themselves.) The same holds for the cluster size.
+    DWORD clusterSize = 0;
+    if(GetType() != IT_MYCOMPUTER)
+    {
+        const CItem *volume = this;
+        while(volume->GetType() != IT_DRIVE && volume->GetParent() != NULL && volume->GetParent()->GetType() != IT_MYCOMPUTER)
+        {
+            volume = volume->GetParent();
+        }
+        GetScanStatistics()->SetCurrentVolume(volume->GetPath());
+        clusterSize = GetAllocationClusterSize(GetPath());
+    }
+
+    SUBTREEDELTA delta;
+    DoSomeWork(limiter, delta, clusterSize);
+
+    // Our own totals (and those of our descendants) are up to date.
+    if(GetParent() != NULL)
+    {
+        GetParent()->UpwardAddDelta(delta);
+    }
+}
+
+// Everything added to our totals is added to delta, too. The caller
+// adds it to its own totals, so that each level of the recursion
+// updates its totals once per call.
+// clusterSize is that of our volume (see GetAllocationClusterSize()).
+void CItem::DoSomeWork(CWorkLimiter *limiter, SUBTREEDELTA& delta, DWORD clusterSize)
 {
     if(IsDone())
     {
@@ -1062,35 +1452,76 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
 
     const ULONGLONG start = _GetTickCount64();
 
+    CScanStatistics *stats = GetScanStatistics();
+    if(GetType() == IT_DRIVE)
+    {
+        stats->SetCurrentVolume(GetPath());
+    }
+
+    // A reparse point may be the mount point of another volume.
+    if(GetType() == IT_DRIVE || GetType() == IT_DIRECTORY && (GetAttributes() & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+    {
+        clusterSize = GetAllocationClusterSize(GetPath());
+    }
+
     if(GetType() == IT_DRIVE || GetType() == IT_DIRECTORY)
     {
         if(!IsReadJobDone())
         {
             ULONGLONG dirCount = 0;
             ULONGLONG fileCount = 0;
+            SUBTREEDELTA own;
 
             CList<FILEINFO, FILEINFO> files;
 
+            // Enumeration time is the whole loop minus the time spent
+            // in AddDirectory() (insertion).
+            SCANDIRECTORY scan;
+            ZeroMemory(&scan, sizeof(scan));
+            const ULONGLONG enumerationStart = CScanStatistics::Now();
+
+            const bool countHardLinksOnce = GetOptions()->IsCountHardLinksOnce();
+
+            CScanFilter *filter = GetScanFilter();
+            const bool filtering = !filter->IsEmpty();
+            if(filtering && filter->NeedsPath())
+            {
+                filter->BeginDirectory(GetPath());
+            }
 
             CFileFindWDS finder;
             BOOL b = finder.FindFile(GetFindPattern());
+            scan.syscalls++;
             while(b)
             {
-                DriveVisualUpdateDuringWork();
-
                 b = finder.FindNextFile();
+                scan.syscalls++;
                 if(finder.IsDots())
                 {
                     continue;
                 }
+                scan.entries++;
                 if(GetOptions()->IsSkipHidden() && finder.IsHidden())
                 {
                     continue;
                 }
+                if(filtering)
+                {
+                    const ULONGLONG filterStart = CScanStatistics::Now();
+                    const bool excluded = filter->IsExcluded(finder.GetFileName(), finder.GetAttributes(), finder.GetLength());
+                    scan.filterTime += CScanStatistics::Now() - filterStart;
+                    if(excluded)
+                    {
+                        scan.filtered++;
+                        continue;
+                    }
+                }
                 if(finder.IsDirectory())
                 {
                     dirCount++;
-                    AddDirectory(finder);
+                    const ULONGLONG insertionStart = CScanStatistics::Now();
+                    AddDirectory(finder, own);
+                    scan.insertionTime += CScanStatistics::Now() - insertionStart;
                 }
                 else
                 {
@@ -1100,11 +1531,24 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
                     fi.name = finder.GetFileName();
                     fi.attributes = finder.GetAttributes();
                     // Retrieve file size
-                    fi.length = finder.GetCompressedLength();
+                    fi.length = GetFoundLength(finder, clusterSize);
                     finder.GetLastWriteTime(&fi.lastWriteTime);
                     // (We don't use GetLastWriteTime(CTime&) here, because, if the file has
                     // an invalid timestamp, that function would ASSERT and throw an Exception.)
 
+                    if(countHardLinksOnce)
+                    {
+                        const ULONGLONG identityStart = CScanStatistics::Now();
+                        if(IsFurtherHardLink(finder, fi.length))
+                        {
+                            scan.hardLinks++;
+                            scan.hardLinkBytes += fi.length;
+                            fi.length = 0;
+                        }
+                        scan.syscalls += 3; // CreateFile(), GetFileInformationByHandle(), CloseHandle()
+                        scan.identityTime += CScanStatistics::Now() - identityStart;
+                    }
+
                     files.AddTail(fi);
                 }
             }
@@ -1121,19 +1565,38 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
 //                 filesFolder = this;
 //             }
 
+            const ULONGLONG insertionStart = CScanStatistics::Now();
+            scan.enumerationTime = insertionStart - enumerationStart - scan.insertionTime;
+
             for(POSITION pos = files.GetHeadPosition(); pos != NULL; files.GetNext(pos))
             {
                 const FILEINFO& fi = files.GetAt(pos);
-                this->AddFile(fi);
+                this->AddFile(fi, own);
+            }
+
+            scan.insertionTime += CScanStatistics::Now() - insertionStart;
+            scan.directories = dirCount;
+            scan.files = fileCount;
+            stats->RecordDirectory(scan);
+            if(stats->IsSlowDirectory(scan.enumerationTime))
+            {
+                stats->AddSlowDirectory(GetPath(), scan);
             }
 
 //             if(filesFolder != NULL)
 //             {
-                this->UpwardAddFiles(fileCount);
+                own.files += fileCount;
 //             }
 
-            UpwardAddSubdirs(dirCount);
-            SetReadJobDone();
+            own.subdirs += dirCount;
+
+            // SetReadJobDone(), but without propagation
+            m_readJobDone = true;
+            own.readJobs--;
+
+            AddDelta(own);
+            delta.Add(own);
+
             AddTicksWorked(_GetTickCount64() - start);
         }
         if(GetType() == IT_DRIVE)
@@ -1166,21 +1629,7 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
         const ULONGLONG startChildren = _GetTickCount64();
         while(!limiter->IsDone())
         {
-            ULONGLONG minticks = ULONGLONG_MAX;
-            CItem *minchild = NULL;
-            for(int i = 0; i < GetChildrenCount(); i++)
-            {
-                CItem *child = GetChild(i);
-                if(child->IsDone())
-                {
-                    continue;
-                }
-                if(child->GetTicksWorked() < minticks)
-                {
-                    minticks = child->GetTicksWorked();
-                    minchild = child;
-                }
-            }
+            CItem *minchild = GetScheduledChild();
             if(minchild == NULL)
             {
                 SetDone();
@@ -1188,7 +1637,13 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
             }
             if (!limiter->IsDone())
             {
-                minchild->DoSomeWork(limiter);
+                SUBTREEDELTA childDelta;
+                minchild->DoSomeWork(limiter, childDelta, clusterSize);
+                AddDelta(childDelta);
+                delta.Add(childDelta);
+
+                // Its ticks have increased, or it is done.
+                RescheduleChild();
             }
         }
         AddTicksWorked(_GetTickCount64() - startChildren);
@@ -1264,6 +1719,16 @@ bool CItem::StartRefresh()
     // Special case IT_FILESFOLDER
     if(GetType() == IT_FILESFOLDER)
     {
+        const DWORD clusterSize = GetAllocationClusterSize(GetPath());
+
+        // Like DoSomeWork()
+        CScanFilter *filter = GetScanFilter();
+        const bool filtering = !filter->IsEmpty();
+        if(filtering && filter->NeedsPath())
+        {
+            filter->BeginDirectory(GetPath());
+        }
+
         CFileFindWDS finder;
         BOOL b = finder.FindFile(GetFindPattern());
         while(b)
@@ -1272,12 +1737,22 @@ bool CItem::StartRefresh()
             if(finder.IsDirectory())
                 continue;
 
+            if(filtering && filter->IsExcluded(finder.GetFileName(), finder.GetAttributes(), finder.GetLength()))
+            {
+                GetScanStatistics()->filtered++;
+                continue;
+            }
+
             FILEINFO fi;
             fi.name = finder.GetFileName();
             fi.attributes = finder.GetAttributes();
             // Retrieve file size
-            fi.length = finder.GetCompressedLength();
+            fi.length = GetFoundLength(finder, clusterSize);
             finder.GetLastWriteTime(&fi.lastWriteTime);
+            if(GetOptions()->IsCountHardLinksOnce() && IsFurtherHardLink(finder, fi.length))
+            {
+                fi.length = 0;
+            }
 
             AddFile(fi);
             UpwardAddFiles(1);
@@ -1329,14 +1804,37 @@ bool CItem::StartRefresh()
         if(b)
         {
             finder.FindNextFile();
+
+            // Excluded by the scan filter (the rules may have changed
+            // since the scan): the item goes away like a deleted one.
+            CScanFilter *filter = GetScanFilter();
+            if(!filter->IsEmpty())
+            {
+                if(filter->NeedsPath())
+                {
+                    filter->BeginDirectory(GetParent()->GetPath());
+                }
+                if(filter->IsExcluded(finder.GetFileName(), finder.GetAttributes(), finder.GetLength()))
+                {
+                    GetScanStatistics()->filtered++;
+                    GetParent()->UpwardRecalcLastChange();
+                    GetParent()->RemoveChild(GetParent()->FindChildIndex(this)); // --> delete this
+                    return false;
+                }
+            }
+
             if(!finder.IsDirectory())
             {
                 FILEINFO fi;
                 fi.name = finder.GetFileName();
                 fi.attributes = finder.GetAttributes();
                 // Retrieve file size
-                fi.length = finder.GetCompressedLength();
+                fi.length = GetFoundLength(finder, GetAllocationClusterSize(GetPath()));
                 finder.GetLastWriteTime(&fi.lastWriteTime);
+                if(GetOptions()->IsCountHardLinksOnce() && IsFurtherHardLink(finder, fi.length))
+                {
+                    fi.length = 0;
+                }
 
                 SetLastChange(fi.lastWriteTime);
 
@@ -1396,6 +1894,53 @@ bool CItem::StartRefresh()
     return true;
 }
 
+// The physical item has been deleted. Unlike StartRefresh(), this does
+// not read the disk and does not set the ancestors undone (which would
+// rebuild the extension data when the root is done again): we subtract
+// our counts from the ancestors and remove ourselves. --> delete this
+//
+void CItem::RemoveFromTree()
+{
+    ASSERT(GetType() == IT_FILE || GetType() == IT_DIRECTORY);
+
+    CItem *parent = GetParent();
+    ASSERT(parent != NULL);
+
+    UpwardSubtractReadJobs(GetReadJobs());
+
+    if(GetType() == IT_FILE)
+    {
+        parent->UpwardSubtractFiles(1);
+    }
+    else
+    {
+        // Our subtree and ourselves
+        parent->UpwardSubtractFiles(GetFilesCount());
+        parent->UpwardSubtractSubdirs(GetSubdirsCount() + 1);
+    }
+
+    parent->UpwardSubtractSize(GetSize());
+
+    parent->RemoveChild(parent->FindChildIndex(this)); // --> delete this
+
+    // The deletion has modified the parent directory just now.
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    parent->UpwardUpdateLastChange(now);
+
+    // The space is free now.
+    CItem *drive = parent;
+    while(drive != NULL && drive->GetType() != IT_DRIVE)
+    {
+        drive = drive->GetParent();
+    }
+    if(drive != NULL && drive->IsDone())
+    {
+        drive->UpdateFreeSpaceItem();
+        drive->UpdateUnknownItem();
+    }
+}
+
 void CItem::UpwardSetUndone()
 {
     if(GetType() == IT_DRIVE && IsDone() && GetDocument()->OptionShowUnknown())
@@ -1417,6 +1962,9 @@ void CItem::UpwardSetUndone()
 
     m_done = false;
 
+    // One of our children may be undone again, or have less ticks worked.
+    DeleteSchedule();
+
     if(GetParent() != NULL)
     {
         GetParent()->UpwardSetUndone();
@@ -1564,6 +2112,38 @@ CItem *CItem::FindUnknownItem() const
     }
 }
 
+// <Unknown> is the capacity minus everything else we know of.
+//
+void CItem::UpdateUnknownItem()
+{
+    ASSERT(GetType() == IT_DRIVE);
+
+    if(!GetDocument()->OptionShowUnknown())
+    {
+        return;
+    }
+
+    CItem *unknown = FindUnknownItem();
+    ASSERT(unknown != NULL);
+
+    // Our size without <Unknown>
+    UpwardSubtractSize(unknown->GetSize());
+    unknown->SetSize(0);
+
+    ULONGLONG total;
+    ULONGLONG free;
+    CDirstatApp::getDiskFreeSpace(GetPath(), total, free);
+
+    ULONGLONG unknownspace = total - GetSize();
+    if(!GetDocument()->OptionShowFreeSpace())
+    {
+        unknownspace -= free;
+    }
+    unknown->SetSize(unknownspace);
+
+    UpwardAddSize(unknownspace);
+}
+
 void CItem::RemoveUnknownItem()
 {
     ASSERT(GetType() == IT_DRIVE);
@@ -1580,40 +2160,115 @@ void CItem::RemoveUnknownItem()
     RemoveChild(i);
 }
 
+// path is lower case. Only our own path is built, below us the path is
+// matched against the names of the items.
 CItem *CItem::FindDirectoryByPath(const CString& path)
 {
     CString myPath = GetPath();
     myPath.MakeLower();
-
-    int i = 0;
-    while(i < myPath.GetLength() && i < path.GetLength() && myPath[i] == path[i])
+    if(myPath == path)
     {
-        i++;
+        return this;
     }
 
-    if(i < myPath.GetLength())
+    CString base = UpwardGetPathWithoutBackslash();
+    base.MakeLower();
+    if(path.Left(base.GetLength()) != base)
     {
         return NULL;
     }
 
-    if(i >= path.GetLength())
-    {
-        ASSERT(myPath == path);
-        return this;
-    }
+    return FindChildByPath(path, base.GetLength());
+}
+
+// The first offset characters of path are our path without backslash.
+CItem *CItem::FindChildByPath(const CString& path, int offset)
+{
+    // If the path is not below us after all, spill again.
+    const bool spilled = IsSpilled();
 
-    for(i = 0; i < GetChildrenCount(); i++)
+    for(int i = 0; i < GetChildrenCount(); i++)
     {
-        CItem *item = GetChild(i)->FindDirectoryByPath(path);
+        CItem *child = GetChild(i);
+        const int end = child->MatchPath(path, offset);
+        if(end == -1)
+        {
+            continue;
+        }
+
+        // Drives (and their files folders) have a backslash at the end of their path.
+        const bool backslash = child->GetType() == IT_DRIVE || child->GetType() == IT_FILESFOLDER && GetType() == IT_DRIVE;
+        if(backslash ? end + 1 == path.GetLength() && path[end] == wds::chrBackslash : end == path.GetLength())
+        {
+            return child;
+        }
+
+        CItem *item = child->FindChildByPath(path, end);
         if(item != NULL)
         {
             return item;
         }
     }
 
+    if(spilled)
+    {
+        Spill();
+    }
     return NULL;
 }
 
+// Like UpwardGetPathWithoutBackslash(), but compares instead of appending.
+// Returns the offset behind our name, or -1 if path does not lead through us.
+int CItem::MatchPath(const CString& path, int offset) const
+{
+    CString name;
+    switch (GetType())
+    {
+    case IT_DRIVE:
+        {
+            offset = 0;
+            name = PathFromVolumeName(m_name);
+        }
+        break;
+
+    case IT_DIRECTORY:
+    case IT_FILE:
+        {
+            if(offset > 0 || GetType() == IT_FILE)
+            {
+                if(offset >= path.GetLength() || path[offset] != wds::chrBackslash)
+                {
+                    return -1;
+                }
+                offset++;
+            }
+            name = m_name;
+        }
+        break;
+
+    case IT_FILESFOLDER:
+        {
+            return offset;
+        }
+
+    default:
+        {
+            return -1;
+        }
+    }
+
+    const int end = offset + name.GetLength();
+    if(end > path.GetLength() || _tcsnicmp(path.GetString() + offset, name, name.GetLength()) != 0)
+    {
+        return -1;
+    }
+    if(end < path.GetLength() && path[end] != wds::chrBackslash)
+    {
+        return -1;
+    }
+    return end;
+}
+
 void CItem::RecurseCollectExtensionData(CExtensionData *ed)
 {
     GetWDSApp()->PeriodicalUpdateRamUsage();
@@ -1640,10 +2295,215 @@ void CItem::RecurseCollectExtensionData(CExtensionData *ed)
     }
     else
     {
+        // Walking the whole tree must not load all spilled subtrees at once.
+        const bool spilled = IsSpilled();
+
         for(int i = 0; i < GetChildrenCount(); i++)
         {
             GetChild(i)->RecurseCollectExtensionData(ed);
         }
+
+        if(spilled)
+        {
+            Spill();
+        }
+    }
+}
+
+void CItem::RecurseSubtractExtensionData(CExtensionData *ed)
+{
+    ITEMTYPE type = GetType();
+    if(IsLeaf(type))
+    {
+        if(type == IT_FILE)
+        {
+            CString ext = GetExtension();
+            SExtensionRecord r;
+            if(ed->Lookup(ext, r))
+            {
+                r.bytes -= GetSize();
+                r.files--;
+
+                if(r.files == 0)
+                {
+                    ed->RemoveKey(ext);
+                }
+                else
+                {
+                    ed->SetAt(ext, r);
+                }
+            }
+        }
+    }
+    else
+    {
+        // The subtree is about to be deleted, so no need to spill it again.
+        for(int i = 0; i < GetChildrenCount(); i++)
+        {
+            GetChild(i)->RecurseSubtractExtensionData(ed);
+        }
+    }
+}
+
+bool CItem::IsSpilled() const
+{
+    return m_spilled;
+}
+
+// Writes our subtree to the spill file and deletes our children. Only
+// our own totals (size, files, subdirs, last change) stay in memory.
+// The first call of GetChildrenCount() or GetChild() brings them back.
+// The caller (CDirstatDoc::SpillColdSubtrees()) makes sure, that nobody
+// holds pointers into the subtree.
+// If the subtree has not changed since it was read back, the spill file
+// keeps the old record and writes nothing.
+void CItem::Spill()
+{
+    ASSERT(IsDone());
+    ASSERT(!IsVisible());
+    ASSERT(!m_spilled);
+    ASSERT(m_schedule == NULL);
+
+    CArray<BYTE, BYTE> data;
+    const DWORD count = GetChildrenCount();
+    AppendBytes(data, &count, sizeof(count));
+    RecurseWriteChildren(data);
+
+    if(!GetSpillFile()->Store(this, data))
+    {
+        return;
+    }
+
+    for(int i = 0; i < m_children.GetSize(); i++)
+    {
+        delete m_children[i];
+    }
+    m_children.RemoveAll();
+    m_spilled = true;
+
+    GetScanStatistics()->spilledSubtrees++;
+}
+
+// Reads our subtree back. The record stays in the spill file for the
+// next Spill(). RemoveAllChildren() and the destructor discard it.
+void CItem::Rehydrate()
+{
+    if(!m_spilled)
+    {
+        return;
+    }
+    m_spilled = false;
+
+    CArray<BYTE, BYTE> data;
+    if(!GetSpillFile()->Load(this, data))
+    {
+        // We can only go on without the children.
+        GetSpillFile()->Discard(this);
+        return;
+    }
+
+    const BYTE *p = data.GetData();
+    const BYTE *end = p + data.GetSize();
+
+    DWORD count;
+    ReadBytes(p, end, &count, sizeof(count));
+    ReadChildren(p, end, count);
+    ASSERT(p == end);
+
+    GetScanStatistics()->rehydratedSubtrees++;
+}
+
+// Appends the directories of our spilled subtree (pre-order) straight from
+// the spill file, without reading the items back. parent: the index of our
+// own entry in directories.
+bool CItem::GetSpilledDirectories(CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&>& directories, int parent) const
+{
+    ASSERT(m_spilled);
+
+    CArray<BYTE, BYTE> data;
+    if(!GetSpillFile()->Load(this, data))
+    {
+        return false;
+    }
+
+    const BYTE *p = data.GetData();
+    const BYTE *end = p + data.GetSize();
+
+    DWORD count;
+    ReadBytes(p, end, &count, sizeof(count));
+    ReadDirectories(p, end, count, directories, parent);
+    ASSERT(p == end);
+    return true;
+}
+
+ULONGLONG CItem::GetOwnMemoryUsage() const
+{
+    // Pseudo items are few, and the name of a remainder item changes
+    // after construction, so it would be subtracted with another size.
+    if(GetType() == IT_REMAINDER || GetType() == IT_FREESPACE || GetType() == IT_UNKNOWN)
+    {
+        return 0;
+    }
+
+    // The item, our entry in the parent's m_children and the name
+    // (without the heap and CString overhead)
+    return sizeof(CItem) + sizeof(CItem *) + (m_name.GetLength() + 1) * sizeof(TCHAR);
+}
+
+// Appends our children and, recursively, their subtrees (pre-order).
+void CItem::RecurseWriteChildren(CArray<BYTE, BYTE>& data) const
+{
+    for(int i = 0; i < GetChildrenCount(); i++)
+    {
+        const CItem *child = GetChild(i);
+
+        SPILLEDITEM record;
+        ZeroMemory(&record, sizeof(record));
+        record.size = child->m_size;
+        record.files = child->m_files;
+        record.subdirs = child->m_subdirs;
+        record.lastChange = child->m_lastChange;
+        record.ticksWorked = child->m_ticksWorked;
+        record.childCount = child->GetChildrenCount();
+        record.nameLength = child->m_name.GetLength();
+        record.type = (WORD)child->m_type;
+        record.attributes = child->m_attributes;
+
+        AppendBytes(data, &record, sizeof(record));
+        AppendBytes(data, child->m_name.GetString(), record.nameLength * sizeof(TCHAR));
+        child->RecurseWriteChildren(data);
+    }
+}
+
+void CItem::ReadChildren(const BYTE *&p, const BYTE *end, DWORD count)
+{
+    ASSERT(m_children.GetSize() == 0);
+    m_children.SetSize(count);
+
+    for(DWORD i = 0; i < count; i++)
+    {
+        SPILLEDITEM record;
+        ReadBytes(p, end, &record, sizeof(record));
+
+        CString name;
+        ReadBytes(p, end, name.GetBuffer(record.nameLength), record.nameLength * sizeof(TCHAR));
+        name.ReleaseBuffer(record.nameLength);
+
+        CItem *child = new CItem((ITEMTYPE)record.type, name);
+        child->m_size = record.size;
+        child->m_files = record.files;
+        child->m_subdirs = record.subdirs;
+        child->m_lastChange = record.lastChange;
+        child->m_ticksWorked = record.ticksWorked;
+        child->m_attributes = record.attributes;
+        child->m_readJobDone = true;
+        child->m_readJobs = 0;
+        child->m_done = true;
+        ZeroMemory(&child->m_rect, sizeof(child->m_rect));
+        child->SetParent(this);
+        m_children[i] = child;
+
+        child->ReadChildren(p, end, record.childCount);
     }
 }
 
@@ -1842,21 +2702,24 @@ CString CItem::UpwardGetPathWithoutBackslash() const
     return path;
 }
 
-void CItem::AddDirectory(CFileFindWDS& finder)
+void CItem::AddDirectory(CFileFindWDS& finder, SUBTREEDELTA& delta)
 {
-    bool dontFollow = GetWDSApp()->IsVolumeMountPoint(finder.GetFilePath()) && !GetOptions()->IsFollowMountPoints();
+    bool dontFollow = GetWDSApp()->IsVolumeMountPoint(finder) && !GetOptions()->IsFollowMountPoints();
 
-    dontFollow |= GetWDSApp()->IsFolderJunction(finder.GetFilePath()) && !GetOptions()->IsFollowJunctionPoints();
+    dontFollow |= GetWDSApp()->IsFolderJunction(finder) && !GetOptions()->IsFollowJunctionPoints();
 
     CItem *child = new CItem(IT_DIRECTORY, finder.GetFileName(), dontFollow);
     FILETIME t;
     finder.GetLastWriteTime(&t);
     child->SetLastChange(t);
     child->SetAttributes(finder.GetAttributes());
-    AddChild(child);
+
+    delta.readJobs += child->GetReadJobs();
+    delta.UpdateLastChange(t);
+    LinkChild(child);
 }
 
-void CItem::AddFile(const FILEINFO& fi)
+void CItem::AddFile(const FILEINFO& fi, SUBTREEDELTA& delta)
 {
     CItem *child = new CItem(IT_FILE, fi.name);
     child->SetSize(fi.length);
@@ -1864,11 +2727,34 @@ void CItem::AddFile(const FILEINFO& fi)
     child->SetAttributes(fi.attributes);
     child->SetDone();
 
-    AddChild(child);
+    delta.size += fi.length;
+    delta.UpdateLastChange(fi.lastWriteTime);
+    LinkChild(child);
 }
 
+ULONGLONG CItem::_nextVisualUpdate = 0;
+ULONGLONG CItem::_memoryUsage = 0;
+
+// Paints and drives the pacmen, if the last time is VISUAL_UPDATE_INTERVAL ago.
+// DoSomeWork() calls us once per directory, never while it enumerates one.
+// Reading the tick count is all it costs in between.
 void CItem::DriveVisualUpdateDuringWork()
 {
+    const ULONGLONG now = _GetTickCount64();
+    if(now < _nextVisualUpdate)
+    {
+        return;
+    }
+
+    // Headless scan
+    if(GetMainFrame() == NULL)
+    {
+        return;
+    }
+    _nextVisualUpdate = now + VISUAL_UPDATE_INTERVAL;
+
+    const ULONGLONG start = CScanStatistics::Now();
+
     MSG msg;
     while(PeekMessage(&msg, NULL, WM_PAINT, WM_PAINT, PM_REMOVE))
     {
@@ -1877,6 +2763,9 @@ void CItem::DriveVisualUpdateDuringWork()
 
     GetMainFrame()->DrivePacman();
     UpwardDrivePacman();
+
+    GetScanStatistics()->visualUpdates++;
+    GetScanStatistics()->visualUpdateTime += CScanStatistics::Now() - start;
 }
 
 void CItem::UpwardDrivePacman()
@@ -55,6 +55,7 @@ enum ITEMTYPE
     IT_FILESFOLDER,     // Pseudo Folder "<Files>"
     IT_FREESPACE,       // Pseudo File "<Free Space>"
     IT_UNKNOWN,         // Pseudo File "<Unknown>"
+    IT_REMAINDER,       // Pseudo Item "<n more items>", lists only (see CTreeListItem::CreateRemainderItem())
 
     ITF_FLAGS    = 0xF000,
     ITF_ROOTITEM = 0x8000   // This is an additional flag, not a type.
@@ -76,6 +77,17 @@ inline bool operator== (const FILETIME& t1, const FILETIME& t2)
     return (t1.dwLowDateTime == t2.dwLowDateTime) && (t1.dwHighDateTime == t2.dwHighDateTime);
 }
 
+// The totals of a directory, without its children. See CItem::GetSpilledDirectories().
+struct DIRECTORYTOTALS
+{
+    int parent;             // Index of the parent directory in the array, -1: none
+    CString name;
+    ULONGLONG size;
+    ULONGLONG files;
+    ULONGLONG subdirs;
+    FILETIME lastChange;
+};
+
 //
 // CItem. This is the object, from which the whole tree is built.
 // For every directory, file etc., we find on the Harddisks, there is one CItem.
@@ -107,6 +119,22 @@ class CItem: public CTreeListItem, public CTreemap::Item
         DWORD attributes;
     };
 
+    // During a scan, the totals of a directory are collected here and added
+    // to the ancestors once per directory and DoSomeWork() call, instead of
+    // once per file (which would cost O(files * depth)).
+    struct SUBTREEDELTA
+    {
+        ULONGLONG size;
+        ULONGLONG files;
+        ULONGLONG subdirs;
+        LONGLONG readJobs;      // May be negative
+        FILETIME lastChange;
+
+        SUBTREEDELTA();
+        void Add(const SUBTREEDELTA& other);
+        void UpdateLastChange(const FILETIME& t);
+    };
+
 public:
     CItem(ITEMTYPE type, LPCTSTR name, bool dontFollow = false);
     ~CItem();
@@ -120,19 +148,24 @@ public:
     virtual CTreeListItem *GetTreeListChild(int i) const;
     virtual int GetImageToCache() const;
     virtual void DrawAdditionalState(CDC *pdc, const CRect& rcLabel) const;
+    virtual ULONGLONG GetTreeListWeight() const;
+    virtual CTreeListItem *CreateRemainderItem() const;
+    virtual void UpdateRemainderItem(CTreeListItem *remainder, CTreeListItem *const *listed, int listedCount) const;
+    virtual bool IsRemainderItem() const;
 
     // CTreemap::Item interface
-    virtual            bool TmiIsLeaf()                const { return IsLeaf(GetType()); }
+    virtual            bool TmiIsLeaf()                const { return IsLeaf(GetType()) || m_spilled; }
     virtual           CRect TmiGetRectangle()          const;
     virtual            void TmiSetRectangle(const CRect& rc);
     virtual        COLORREF TmiGetGraphColor()         const { return GetGraphColor(); }
-    virtual             int TmiGetChildrenCount()      const { return GetChildrenCount(); }
+    virtual             int TmiGetChildrenCount()      const { return m_spilled ? 0 : GetChildrenCount(); }
     virtual CTreemap::Item *TmiGetChild(int c)         const { return GetChild(c); }
     virtual       ULONGLONG TmiGetSize()               const { return GetSize(); }
 
     // CItem
     static int GetSubtreePercentageWidth();
     static CItem *FindCommonAncestor(const CItem *item1, const CItem *item2);
+    static ULONGLONG GetMemoryUsage();
 
     bool IsAncestorOf(const CItem *item) const;
     ULONGLONG GetProgressRange() const;
@@ -184,6 +217,7 @@ public:
     void AddTicksWorked(ULONGLONG more);
     void DoSomeWork(CWorkLimiter* limiter);
     bool StartRefresh();
+    void RemoveFromTree();
     void UpwardSetUndone();
     void RefreshRecycler();
     void CreateFreeSpaceItem();
@@ -192,12 +226,25 @@ public:
     void RemoveFreeSpaceItem();
     void CreateUnknownItem();
     CItem *FindUnknownItem() const;
+    void UpdateUnknownItem();
     void RemoveUnknownItem();
     CItem *FindDirectoryByPath(const CString& path);
     void RecurseCollectExtensionData(CExtensionData *ed);
+    void RecurseSubtractExtensionData(CExtensionData *ed);
+    bool IsSpilled() const;
+    void Spill();
+    void Rehydrate();
+    bool GetSpilledDirectories(CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&>& directories, int parent) const;
 
 private:
+    static ULONGLONG _nextVisualUpdate; // See DriveVisualUpdateDuringWork()
+    static ULONGLONG _memoryUsage;      // Approximate size of all CItems, see GetOwnMemoryUsage()
+
     static int __cdecl _compareBySize(const void *p1, const void *p2);
+    static bool _isMoreWorked(const CItem *item1, const CItem *item2);
+    CItem *GetScheduledChild();
+    void RescheduleChild();
+    void DeleteSchedule();
     ULONGLONG GetProgressRangeMyComputer() const;
     ULONGLONG GetProgressPosMyComputer() const;
     ULONGLONG GetProgressRangeDrive() const;
@@ -208,11 +255,20 @@ private:
     int FindFreeSpaceItemIndex() const;
     int FindUnknownItemIndex() const;
     CString UpwardGetPathWithoutBackslash() const;
-    void AddDirectory(CFileFindWDS& finder);
-    void AddFile(const FILEINFO& fi);
+    int MatchPath(const CString& path, int offset) const;
+    CItem *FindChildByPath(const CString& path, int offset);
+    void DoSomeWork(CWorkLimiter *limiter, SUBTREEDELTA& delta, DWORD clusterSize);
+    void LinkChild(CItem *child);
+    void AddDelta(const SUBTREEDELTA& delta);
+    void UpwardAddDelta(const SUBTREEDELTA& delta);
+    void AddDirectory(CFileFindWDS& finder, SUBTREEDELTA& delta);
+    void AddFile(const FILEINFO& fi, SUBTREEDELTA& delta);
     void DriveVisualUpdateDuringWork();
     void UpwardDrivePacman();
     void DrivePacman();
+    ULONGLONG GetOwnMemoryUsage() const;
+    void RecurseWriteChildren(CArray<BYTE, BYTE>& data) const;
+    void ReadChildren(const BYTE *&p, const BYTE *end, DWORD count);
 
     ITEMTYPE m_type;            // Indicates our type. See ITEMTYPE.
     ITEMTYPE m_etype;           
@@ -227,13 +283,19 @@ private:
 
     bool m_readJobDone;         // FindFiles() (our own read job) is finished.
     bool m_done;                // Whole Subtree is done.
+    bool m_spilled;             // Our children are in the spill file. See Spill().
     ULONGLONG m_ticksWorked;        // ms time spent on this item.
     ULONGLONG m_readJobs;       // # "read jobs" in subtree.
 
 
     // Our children. When "this" is set to "done", this array is sorted by child size.
+    // Empty while we are spilled.
     CArray<CItem *, CItem *> m_children;
 
+    // While we are scanned: our unfinished children as a heap, the one with the
+    // least ticks worked on top. NULL, if it has to be (re)built.
+    CArray<CItem *, CItem *> *m_schedule;
+
     // For GraphView:
     RECT m_rect;                // Finally, this is our coordinates in the Treemap view.
 };
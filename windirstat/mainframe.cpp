@@ -35,9 +35,11 @@
 #include "pagetreelist.h"
 #include "pagetreemap.h"
 #include "pagegeneral.h"
+#include "scanstatisticsdlg.h"
 
 #include <common/mdexceptions.h>
 #include <common/commonhelpers.h>
+#include <dbt.h>
 
 #include "mainframe.h"
 
@@ -396,6 +398,9 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWnd)
     ON_WM_CLOSE()
     ON_WM_INITMENUPOPUP()
     ON_UPDATE_COMMAND_UI(ID_INDICATOR_MEMORYUSAGE, OnUpdateMemoryUsage)
+#ifdef _DEBUG
+    ON_UPDATE_COMMAND_UI(ID_INDICATOR_PAINTTIME, OnUpdatePaintTime)
+#endif
     ON_WM_SIZE()
     ON_UPDATE_COMMAND_UI(ID_VIEW_SHOWTREEMAP, OnUpdateViewShowtreemap)
     ON_COMMAND(ID_VIEW_SHOWTREEMAP, OnViewShowtreemap)
@@ -404,8 +409,11 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWnd)
     ON_COMMAND(ID_CONFIGURE, OnConfigure)
     ON_WM_DESTROY()
     ON_COMMAND(ID_TREEMAP_HELPABOUTTREEMAPS, OnTreemapHelpabouttreemaps)
+    ON_COMMAND(ID_HELP_SCANSTATISTICS, OnHelpScanStatistics)
     ON_BN_CLICKED(IDC_SUSPEND, OnBnClickedSuspend)
     ON_WM_SYSCOLORCHANGE()
+    ON_REGISTERED_MESSAGE(CIconLookupThread::s_lookupDoneMessage, OnIconLookupDone)
+    ON_WM_DEVICECHANGE()
 #ifdef SUPPORT_W7_TASKBAR
     ON_REGISTERED_MESSAGE(s_taskBarMessage, OnTaskButtonCreated)
 #endif // SUPPORT_W7_TASKBAR
@@ -414,6 +422,9 @@ END_MESSAGE_MAP()
 static UINT indicators[] =
 {
     ID_SEPARATOR,
+#ifdef _DEBUG
+    ID_INDICATOR_PAINTTIME,
+#endif
     ID_INDICATOR_MEMORYUSAGE,
     ID_INDICATOR_CAPS,
     ID_INDICATOR_NUM,
@@ -423,6 +434,9 @@ static UINT indicators[] =
 static UINT indicatorsWithoutMemoryUsage[] =
 {
     ID_SEPARATOR,
+#ifdef _DEBUG
+    ID_INDICATOR_PAINTTIME,
+#endif
     ID_INDICATOR_CAPS,
     ID_INDICATOR_NUM,
     ID_INDICATOR_SCRL,
@@ -882,6 +896,31 @@ LRESULT CMainFrame::OnExitSizeMove(WPARAM, LPARAM)
     return 0;
 }
 
+LRESULT CMainFrame::OnIconLookupDone(WPARAM, LPARAM)
+{
+    if(GetMyImageList()->processLookupResults())
+    {
+        GetDocument()->UpdateAllViews(NULL, HINT_ICONSCHANGED);
+    }
+    return 0;
+}
+
+// Volumes come and go. The mount points are read again, when needed.
+// (Top level windows get the volume notifications without registering.)
+//
+BOOL CMainFrame::OnDeviceChange(UINT nEventType, DWORD_PTR dwData)
+{
+    if(DBT_DEVICEARRIVAL == nEventType || DBT_DEVICEREMOVECOMPLETE == nEventType)
+    {
+        const DEV_BROADCAST_HDR *hdr = (const DEV_BROADCAST_HDR *)dwData;
+        if(hdr != NULL && DBT_DEVTYP_VOLUME == hdr->dbch_devicetype)
+        {
+            GetWDSApp()->InvalidateMountPoints();
+        }
+    }
+    return CFrameWnd::OnDeviceChange(nEventType, dwData);
+}
+
 void CMainFrame::CopyToClipboard(LPCTSTR psz)
 {
     try
@@ -1133,6 +1172,22 @@ void CMainFrame::OnUpdateMemoryUsage(CCmdUI *pCmdUI)
     pCmdUI->SetText(GetWDSApp()->GetCurrentProcessMemoryInfo());
 }
 
+#ifdef _DEBUG
+// Duration of the last list paint, to measure the cost of the owner drawn lists
+void CMainFrame::OnUpdatePaintTime(CCmdUI *pCmdUI)
+{
+    double milliseconds;
+    int rows;
+    COwnerDrawnListControl::GetLastFrameStatistics(milliseconds, rows);
+
+    CString s;
+    s.Format(_T("Paint: %.1f ms, %d rows"), milliseconds, rows);
+
+    pCmdUI->Enable(true);
+    pCmdUI->SetText(s);
+}
+#endif
+
 void CMainFrame::OnSize(UINT nType, int cx, int cy)
 {
     CFrameWnd::OnSize(nType, cx, cy);
@@ -1227,6 +1282,12 @@ void CMainFrame::OnTreemapHelpabouttreemaps()
     GetWDSApp()->DoContextHelp(IDH_Treemap);
 }
 
+void CMainFrame::OnHelpScanStatistics()
+{
+    CScanStatisticsDlg dlg;
+    dlg.DoModal();
+}
+
 void CMainFrame::OnSysColorChange()
 {
     CFrameWnd::OnSysColorChange();
@@ -218,9 +218,14 @@ protected:
     afx_msg int OnCreate(LPCREATESTRUCT lpCreateStruct);
     afx_msg LRESULT OnEnterSizeMove(WPARAM, LPARAM);
     afx_msg LRESULT OnExitSizeMove(WPARAM, LPARAM);
+    afx_msg LRESULT OnIconLookupDone(WPARAM, LPARAM);
+    afx_msg BOOL OnDeviceChange(UINT nEventType, DWORD_PTR dwData);
     afx_msg void OnClose();
     afx_msg void OnInitMenuPopup(CMenu* pPopupMenu, UINT nIndex, BOOL bSysMenu);
     afx_msg void OnUpdateMemoryUsage(CCmdUI *pCmdUI);
+#ifdef _DEBUG
+    afx_msg void OnUpdatePaintTime(CCmdUI *pCmdUI);
+#endif
     afx_msg void OnSize(UINT nType, int cx, int cy);
     afx_msg void OnUpdateViewShowtreemap(CCmdUI *pCmdUI);
     afx_msg void OnViewShowtreemap();
@@ -230,6 +235,7 @@ protected:
     afx_msg void OnDestroy();
     afx_msg void OnBnClickedSuspend();
     afx_msg void OnTreemapHelpabouttreemaps();
+    afx_msg void OnHelpScanStatistics();
 #ifdef SUPPORT_W7_TASKBAR
     afx_msg LRESULT OnTaskButtonCreated(WPARAM, LPARAM);
 #endif // SUPPORT_W7_TASKBAR
@@ -29,14 +29,147 @@
 #define new DEBUG_NEW
 #endif
 
+namespace
+{
+    // Volumes may be mounted into each other. Don't follow cycles forever.
+    const int MAX_MOUNT_DEPTH = 32;
+}
+
+CMountPointTrie::CMountPointTrie()
+{
+    m_root.isPath = false;
+}
+
+CMountPointTrie::~CMountPointTrie()
+{
+    RemoveAll();
+}
+
+void CMountPointTrie::RemoveAll()
+{
+    DeleteChildren(&m_root);
+}
+
+void CMountPointTrie::DeleteChildren(NODE *node)
+{
+    for(int i = 0; i < node->children.GetSize(); i++)
+    {
+        DeleteChildren(node->children[i]);
+        delete node->children[i];
+    }
+    node->children.RemoveAll();
+}
+
+CMountPointTrie::NODE *CMountPointTrie::FindChild(const NODE *node, LPCTSTR name, int length)
+{
+    for(int i = 0; i < node->children.GetSize(); i++)
+    {
+        NODE *child = node->children[i];
+        if(child->name.GetLength() == length && _tcsnicmp(child->name, name, length) == 0)
+        {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+void CMountPointTrie::Add(LPCTSTR path)
+{
+    NODE *node = &m_root;
+
+    for(LPCTSTR p = path; *p != 0; )
+    {
+        LPCTSTR end = _tcschr(p, wds::chrBackslash);
+        const int length = (end == NULL ? lstrlen(p) : int(end - p));
+
+        if(length > 0)
+        {
+            NODE *child = FindChild(node, p, length);
+            if(child == NULL)
+            {
+                child = new NODE;
+                child->name = CString(p, length);
+                child->name.MakeLower();
+                child->isPath = false;
+                node->children.Add(child);
+            }
+            node = child;
+        }
+
+        p += length;
+        if(*p != 0)
+        {
+            p++;
+        }
+    }
+
+    if(node != &m_root)
+    {
+        node->isPath = true;
+    }
+}
+
+bool CMountPointTrie::Contains(LPCTSTR path) const
+{
+    const NODE *node = &m_root;
+
+    for(LPCTSTR p = path; *p != 0; )
+    {
+        LPCTSTR end = _tcschr(p, wds::chrBackslash);
+        const int length = (end == NULL ? lstrlen(p) : int(end - p));
+
+        if(length > 0)
+        {
+            node = FindChild(node, p, length);
+            if(node == NULL)
+            {
+                return false;
+            }
+        }
+
+        p += length;
+        if(*p != 0)
+        {
+            p++;
+        }
+    }
+
+    return node->isPath;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+CReparsePoints::CReparsePoints()
+    : m_initialized(false)
+{
+}
+
 CReparsePoints::~CReparsePoints()
 {
     Clear();
 }
 
+// The volumes or mount points may have changed. They are enumerated
+// again, when they are needed.
+//
+void CReparsePoints::Invalidate()
+{
+    m_initialized = false;
+}
+
+void CReparsePoints::EnsureInitialized()
+{
+    if(!m_initialized)
+    {
+        Initialize();
+    }
+}
+
 void CReparsePoints::Clear()
 {
     m_drive.RemoveAll();
+    m_mountPointPaths.RemoveAll();
 
     POSITION pos = m_volume.GetStartPosition();
     while(pos != NULL)
@@ -53,9 +186,37 @@ void CReparsePoints::Clear()
 void CReparsePoints::Initialize()
 {
     Clear();
+    m_initialized = true;
 
     GetDriveVolumes();
     GetAllMountPoints();
+
+    for(int i = 0; i < m_drive.GetSize(); i++)
+    {
+        if(!m_drive[i].IsEmpty())
+        {
+            CString prefix;
+            prefix.Format(_T("%c:\\"), i + wds::chrSmallA);
+            AddMountPointPaths(prefix, m_drive[i], 0);
+        }
+    }
+}
+
+// Adds the mount points of volume, which is mounted at prefix, recursively.
+void CReparsePoints::AddMountPointPaths(const CString& prefix, const CString& volume, int depth)
+{
+    PointVolumeArray *pva = NULL;
+    if(depth > MAX_MOUNT_DEPTH || !m_volume.Lookup(volume, pva))
+    {
+        return;
+    }
+
+    for(int i = 0; i < pva->GetSize(); i++)
+    {
+        CString path = prefix + (*pva)[i].point;
+        m_mountPointPaths.Add(path);
+        AddMountPointPaths(path, (*pva)[i].volume, depth + 1);
+    }
 }
 
 void CReparsePoints::GetDriveVolumes()
@@ -198,34 +359,22 @@ void CReparsePoints::GetAllMountPoints()
 }
 
 
-bool CReparsePoints::IsVolumeMountPoint(CString path)
+bool CReparsePoints::IsVolumeMountPoint(LPCTSTR path)
 {
-    if(path.GetLength() < 3 || path[1] != wds::chrColon || path[2] != wds::chrBackslash)
+    if(path[0] == 0 || path[1] != wds::chrColon || path[2] != wds::chrBackslash)
     {
         // Don't know how to make out mount points on UNC paths ###
         return false;
     }
 
-    ASSERT(path.GetLength() >= 3);
-    ASSERT(path[1] == wds::chrColon);
-    ASSERT(path[2] == wds::chrBackslash);
-
-    if(path.Right(1) != wds::chrBackslash)
-    {
-        path += _T("\\");
-    }
-
-    path.MakeLower();
+    EnsureInitialized();
 
-    CString volume = m_drive[path[0] - wds::chrSmallA];
-    path = path.Mid(3);
-
-    return IsVolumeMountPoint(volume, path);
+    return m_mountPointPaths.Contains(path);
 }
 
 // Check whether the current item is a junction point but no volume mount point
 // as the latter ones are treated differently (see above).
-bool CReparsePoints::IsFolderJunction(CString path)
+bool CReparsePoints::IsFolderJunction(LPCTSTR path)
 {
     if(IsVolumeMountPoint(path))
     {
@@ -241,38 +390,24 @@ bool CReparsePoints::IsFolderJunction(CString path)
     return ((attr & FILE_ATTRIBUTE_REPARSE_POINT) != 0);
 }
 
-bool CReparsePoints::IsVolumeMountPoint(CString volume, CString path)
+bool CReparsePoints::IsVolumeMountPoint(const CFileFindWDS& finder)
 {
-    while(true)
+    // Volume mount points are reparse points with this tag (as are
+    // junctions). Only for these we need the path.
+    if(finder.GetReparseTag() != IO_REPARSE_TAG_MOUNT_POINT)
     {
-        int i = 0;
-        PointVolumeArray *pva;
-        if(!m_volume.Lookup(volume, pva))
-        {
-            VTRACE(_T("CMountPoints: Volume(%s) unknown!"), volume.GetString());
-            return false;
-        }
-
-        CString point;
-        for(i  =  0; i < pva->GetSize(); i++)
-        {
-            point = (*pva)[i].point;
-            if(path.Left(point.GetLength()) == point)
-            {
-                break;
-            }
-        }
-        if(i >= pva->GetSize())
-        {
-            return false;
-        }
+        return false;
+    }
 
-        if(path.GetLength() == point.GetLength())
-        {
-            return true;
-        }
+    return IsVolumeMountPoint(finder.GetFilePath());
+}
 
-        volume = (*pva)[i].volume;
-        path = path.Mid(point.GetLength());
+bool CReparsePoints::IsFolderJunction(const CFileFindWDS& finder)
+{
+    if((finder.GetAttributes() & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+    {
+        return false;
     }
+
+    return !IsVolumeMountPoint(finder);
 }
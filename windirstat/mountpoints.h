@@ -24,7 +24,43 @@
 #pragma once
 
 #include <common/wds_constants.h>
+#include "FileFindWDS.h"
 
+//
+// CMountPointTrie. A set of paths like "c:\mount\backup\" with one node
+// per path component. A lookup walks the path once, case insensitively,
+// and allocates nothing.
+//
+class CMountPointTrie
+{
+public:
+    CMountPointTrie();
+    ~CMountPointTrie();
+
+    void RemoveAll();
+    void Add(LPCTSTR path);
+    // The trailing backslash is optional.
+    bool Contains(LPCTSTR path) const;
+
+private:
+    struct NODE
+    {
+        CString name;               // Lower case path component
+        bool isPath;                // An added path ends here
+        CArray<NODE *, NODE *> children;
+    };
+
+    static NODE *FindChild(const NODE *node, LPCTSTR name, int length);
+    static void DeleteChildren(NODE *node);
+
+    NODE m_root;
+};
+
+//
+// CReparsePoints. Knows the volume mount points reachable from drive
+// letters. The volumes are enumerated lazily, on the first query after
+// Invalidate() (which the main frame calls on device changes).
+//
 class CReparsePoints
 {
     struct SPointVolume
@@ -37,17 +73,24 @@ class CReparsePoints
     typedef CArray<SPointVolume, SPointVolume&> PointVolumeArray;
 
 public:
+    CReparsePoints();
     ~CReparsePoints();
-    void Initialize();
-    bool IsVolumeMountPoint(CString path);
-    bool IsFolderJunction(CString path);
+    void Invalidate();
+    bool IsVolumeMountPoint(LPCTSTR path);
+    bool IsFolderJunction(LPCTSTR path);
+
+    // Same for a directory just found. Uses the find data and
+    // doesn't issue any further system call.
+    bool IsVolumeMountPoint(const CFileFindWDS& finder);
+    bool IsFolderJunction(const CFileFindWDS& finder);
 
 private:
+    void EnsureInitialized();
+    void Initialize();
     void Clear();
     void GetDriveVolumes();
     void GetAllMountPoints();
-
-    bool IsVolumeMountPoint(CString volume, CString path);
+    void AddMountPointPaths(const CString& prefix, const CString& volume, int depth);
 
     // m_drive contains the volume identifiers of the Drives A:, B: etc.
     // mdrive[0] = Volume identifier of A:\.
@@ -55,6 +98,11 @@ private:
 
     // m_volume maps all volume identifiers to PointVolumeArrays
     CMap<CString, LPCTSTR, PointVolumeArray *, PointVolumeArray *> m_volume;
+
+    // All mount points reachable from drive letters, like "c:\mount\backup\"
+    CMountPointTrie m_mountPointPaths;
+
+    bool m_initialized;     // false after Invalidate()
 };
 
 #endif // __WDS_MOUNTPOINTS_H__
@@ -54,6 +54,7 @@ namespace
     const LPCTSTR entrySelectDrivesFolder   = _T("selectDrivesFolder");
     const LPCTSTR entrySelectDrivesDrives   = _T("selectDrivesDrives");
     const LPCTSTR entryShowDeleteWarning    = _T("showDeleteWarning");
+    const LPCTSTR entryExtensionTypeNames   = _T("extensionTypeNames");
     const LPCTSTR sectionBarState           = _T("persistence\\barstate");
 
     const LPCTSTR entryLanguage             = _T("language");
@@ -80,7 +81,23 @@ namespace
     const LPCTSTR entryFollowMountPoints    = _T("followMountPoints");
     const LPCTSTR entryFollowJunctionPoints = _T("followJunctionPoints");
     const LPCTSTR entrySkipHidden           = _T("skipHidden");
+    const LPCTSTR entryAllocatedSize        = _T("allocatedSize");
+    const LPCTSTR entryCountHardLinksOnce   = _T("countHardLinksOnce");
+    const LPCTSTR entrySpillBudget          = _T("spillBudget");
+    const LPCTSTR entryCleanupConcurrency   = _T("cleanupConcurrency");
+    const LPCTSTR entryCleanupCheckFreshness= _T("cleanupCheckFreshness");
+    const LPCTSTR entryDeleteConcurrency    = _T("deleteConcurrency");
     const LPCTSTR entryUseWdsLocale         = _T("useWdsLocale");
+    const LPCTSTR entryHistoryDatabase      = _T("historyDatabase");
+
+    const LPCTSTR sectionScanFilters        = _T("options\\scanFilters");
+    const LPCTSTR entryRuleD                = _T("rule%02d");
+
+    // Read until the first empty rule, but not more than these
+    const int MAX_SCANFILTERS               = 100;
+
+    // Type names of extensions, which have not been seen for a while, are dropped.
+    const int MAX_EXTENSIONTYPENAMES        = 500;
 
     const LPCTSTR sectionUserDefinedCleanupD= _T("options\\userDefinedCleanup%02d");
     const LPCTSTR entryEnabled              = _T("enabled");
@@ -371,6 +388,60 @@ void CPersistence::SetShowDeleteWarning(bool show)
     getProfileBool(sectionPersistence, entryShowDeleteWarning, show);
 }
 
+// Format: "langid|ext|name|ext|name...", most recently used first
+void CPersistence::GetExtensionTypeNames(CMapStringToString& names, CStringArray& extensions)
+{
+    names.RemoveAll();
+    extensions.RemoveAll();
+    CString s = getProfileString(sectionPersistence, entryExtensionTypeNames);
+
+    // The type names are localized, so they are only valid for the UI language they were stored with.
+    int pos = 0;
+    CString langid = s.Tokenize(_T("|"), pos);
+    if(pos == -1 || (LANGID)_ttoi(langid) != ::GetUserDefaultUILanguage())
+    {
+        return;
+    }
+
+    for(;;)
+    {
+        CString ext = s.Tokenize(_T("|"), pos);
+        if(pos == -1)
+        {
+            break;
+        }
+        CString name = s.Tokenize(_T("|"), pos);
+        if(pos == -1)
+        {
+            break;
+        }
+        names.SetAt(ext, name);
+        extensions.Add(ext);
+    }
+}
+
+void CPersistence::SetExtensionTypeNames(const CStringArray& extensions, const CMapStringToString& names)
+{
+    CString s;
+    s.Format(_T("%u"), ::GetUserDefaultUILanguage());
+
+    int stored = 0;
+    for(int i = 0; i < extensions.GetSize() && stored < MAX_EXTENSIONTYPENAMES; i++)
+    {
+        CString name;
+        names.Lookup(extensions[i], name);
+        // Tokenize() skips empty tokens, so an empty extension or name
+        // would shift all following pairs.
+        if(extensions[i].IsEmpty() || name.IsEmpty() || name.Find(wds::chrPipe) != -1)
+        {
+            continue;
+        }
+        s.AppendFormat(_T("|%s|%s"), extensions[i].GetString(), name.GetString());
+        stored++;
+    }
+    setProfileString(sectionPersistence, entryExtensionTypeNames, s);
+}
+
 void CPersistence::SetArray(LPCTSTR entry, const CArray<int, int>& arr)
 {
     CString value;
@@ -828,6 +899,108 @@ void COptions::SetSkipHidden(bool skip)
     }
 }
 
+bool COptions::IsAllocatedSize()
+{
+    return m_allocatedSize;
+}
+
+void COptions::SetAllocatedSize(bool allocated)
+{
+    if(m_allocatedSize != allocated)
+    {
+        m_allocatedSize = allocated;
+        GetDocument()->RefreshAllItems();
+    }
+}
+
+bool COptions::IsCountHardLinksOnce()
+{
+    return m_countHardLinksOnce;
+}
+
+void COptions::SetCountHardLinksOnce(bool once)
+{
+    if(m_countHardLinksOnce != once)
+    {
+        m_countHardLinksOnce = once;
+        GetDocument()->RefreshAllItems();
+    }
+}
+
+int COptions::GetSpillBudget()
+{
+    return m_spillBudget;
+}
+
+void COptions::SetSpillBudget(int megabytes)
+{
+    m_spillBudget = max(megabytes, 0);
+}
+
+int COptions::GetCleanupConcurrency()
+{
+    if(m_cleanupConcurrency > 0)
+    {
+        return m_cleanupConcurrency;
+    }
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    return max((int)si.dwNumberOfProcessors, 1);
+}
+
+void COptions::SetCleanupConcurrency(int processes)
+{
+    m_cleanupConcurrency = max(processes, 0);
+}
+
+int COptions::GetDeleteConcurrency()
+{
+    if(m_deleteConcurrency > 0)
+    {
+        return m_deleteConcurrency;
+    }
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    return max((int)si.dwNumberOfProcessors, 1);
+}
+
+void COptions::SetDeleteConcurrency(int threads)
+{
+    m_deleteConcurrency = max(threads, 0);
+}
+
+bool COptions::IsCleanupCheckFreshness()
+{
+    return m_cleanupCheckFreshness;
+}
+
+void COptions::SetCleanupCheckFreshness(bool check)
+{
+    m_cleanupCheckFreshness = check;
+}
+
+void COptions::GetScanFilters(CStringArray& rules)
+{
+    rules.Copy(m_scanFilters);
+}
+
+void COptions::SetScanFilters(const CStringArray& rules)
+{
+    m_scanFilters.Copy(rules);
+}
+
+CString COptions::GetHistoryDatabase()
+{
+    return m_historyDatabase;
+}
+
+void COptions::SetHistoryDatabase(LPCTSTR file)
+{
+    m_historyDatabase = file;
+}
+
 CString COptions::GetReportSubject()
 {
     return m_reportSubject;
@@ -893,6 +1066,21 @@ void COptions::SaveToRegistry()
     }
     setProfileBool(sectionOptions, entryHumanFormat, m_humanFormat);
     setProfileBool(sectionOptions, entrySkipHidden, m_skipHidden);
+    setProfileBool(sectionOptions, entryAllocatedSize, m_allocatedSize);
+    setProfileBool(sectionOptions, entryCountHardLinksOnce, m_countHardLinksOnce);
+    setProfileInt(sectionOptions, entrySpillBudget, m_spillBudget);
+    setProfileInt(sectionOptions, entryCleanupConcurrency, m_cleanupConcurrency);
+    setProfileBool(sectionOptions, entryCleanupCheckFreshness, m_cleanupCheckFreshness);
+    setProfileInt(sectionOptions, entryDeleteConcurrency, m_deleteConcurrency);
+    setProfileString(sectionOptions, entryHistoryDatabase, m_historyDatabase);
+
+    // The empty rule after the last one ends the list.
+    for(i = 0; i <= m_scanFilters.GetSize() && i < MAX_SCANFILTERS; i++)
+    {
+        CString entry;
+        entry.Format(entryRuleD, i);
+        setProfileString(sectionScanFilters, entry, i < m_scanFilters.GetSize() ? m_scanFilters[i] : wds::strEmpty);
+    }
     setProfileBool(sectionOptions, entryPacmanAnimation, m_pacmanAnimation);
     setProfileBool(sectionOptions, entryShowTimeSpent, m_showTimeSpent);
     setProfileInt(sectionOptions, entryTreemapHighlightColor, m_treemapHighlightColor);
@@ -948,6 +1136,8 @@ void COptions::SaveToRegistry()
         s = stringPrefix + m_reportSuffix;
     }
     setProfileString(sectionOptions, entryReportSuffix, s);
+
+    flushProfile();
 }
 
 void COptions::LoadFromRegistry()
@@ -967,6 +1157,26 @@ void COptions::LoadFromRegistry()
     }
     m_humanFormat = getProfileBool(sectionOptions, entryHumanFormat, true);
     m_skipHidden = getProfileBool(sectionOptions, entrySkipHidden, false);
+    m_allocatedSize = getProfileBool(sectionOptions, entryAllocatedSize, false);
+    m_countHardLinksOnce = getProfileBool(sectionOptions, entryCountHardLinksOnce, false);
+    SetSpillBudget(getProfileInt(sectionOptions, entrySpillBudget, 0));
+    SetCleanupConcurrency(getProfileInt(sectionOptions, entryCleanupConcurrency, 0));
+    m_cleanupCheckFreshness = getProfileBool(sectionOptions, entryCleanupCheckFreshness, false);
+    SetDeleteConcurrency(getProfileInt(sectionOptions, entryDeleteConcurrency, 0));
+    m_historyDatabase = getProfileString(sectionOptions, entryHistoryDatabase);
+
+    m_scanFilters.RemoveAll();
+    for(i = 0; i < MAX_SCANFILTERS; i++)
+    {
+        CString entry;
+        entry.Format(entryRuleD, i);
+        CString rule = getProfileString(sectionScanFilters, entry);
+        if(rule.IsEmpty())
+        {
+            break;
+        }
+        m_scanFilters.Add(rule);
+    }
     m_pacmanAnimation = getProfileBool(sectionOptions, entryPacmanAnimation, false);
     m_showTimeSpent = getProfileBool(sectionOptions, entryShowTimeSpent, false);
     m_treemapHighlightColor = getProfileInt(sectionOptions, entryTreemapHighlightColor, RGB(255,255,255));
@@ -1133,24 +1343,304 @@ void COptions::SaveTreemapOptions()
 
 /////////////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    //
+    // CONFIGVALUE. A value of the application's registry key.
+    //
+    struct CONFIGVALUE
+    {
+        CString section;
+        CString entry;
+        DWORD type;         // REG_DWORD, REG_SZ, or REG_NONE if deleted
+        int number;
+        CString string;
+        bool dirty;         // Not yet written
+    };
+
+    typedef CMap<CString, LPCTSTR, CONFIGVALUE, CONFIGVALUE&> CConfigValues;
+
+    //
+    // CConfigCache. The copy of the registry key behind CRegistryUser.
+    //
+    class CConfigCache
+    {
+    public:
+        CConfigCache();
+
+        // NULL if there is no such value
+        const CONFIGVALUE *Lookup(LPCTSTR section, LPCTSTR entry);
+        void Set(LPCTSTR section, LPCTSTR entry, DWORD type, int number, LPCTSTR string);
+        void Flush();
+
+        CCriticalSection m_cs;
+
+    private:
+        void EnsureLoaded();
+        void LoadKey(HKEY key, const CString& section);
+        static CString MakeKey(LPCTSTR section, LPCTSTR entry);
+
+        CConfigValues m_values; // Key: lower case "section\entry"
+        bool m_loaded;
+        int m_dirtyCount;
+    };
+
+    CConfigCache _theConfigCache;
+
+    CConfigCache::CConfigCache()
+        : m_loaded(false)
+        , m_dirtyCount(0)
+    {
+    }
+
+    const CONFIGVALUE *CConfigCache::Lookup(LPCTSTR section, LPCTSTR entry)
+    {
+        EnsureLoaded();
+
+        const CConfigValues::CPair *pair = m_values.PLookup(MakeKey(section, entry));
+        if(pair == NULL || REG_NONE == pair->value.type)
+        {
+            return NULL;
+        }
+        return &pair->value;
+    }
+
+    void CConfigCache::Set(LPCTSTR section, LPCTSTR entry, DWORD type, int number, LPCTSTR string)
+    {
+        EnsureLoaded();
+
+        const CString key = MakeKey(section, entry);
+        CConfigValues::CPair *pair = m_values.PLookup(key);
+        if(pair == NULL)
+        {
+            if(REG_NONE == type)
+            {
+                return;
+            }
+            CONFIGVALUE value;
+            value.section = section;
+            value.entry = entry;
+            value.type = REG_NONE;
+            value.number = 0;
+            value.dirty = false;
+            m_values.SetAt(key, value);
+            pair = m_values.PLookup(key);
+        }
+
+        CONFIGVALUE& value = pair->value;
+        if(value.type == type && value.number == number && value.string == string)
+        {
+            return; // Unchanged
+        }
+
+        value.type = type;
+        value.number = number;
+        value.string = string;
+        if(!value.dirty)
+        {
+            value.dirty = true;
+            m_dirtyCount++;
+        }
+    }
+
+    // Each section key is opened once.
+    void CConfigCache::Flush()
+    {
+        if(m_dirtyCount == 0)
+        {
+            return;
+        }
+
+        CMap<CString, LPCTSTR, HKEY, HKEY> keys; // Lower case section
+
+        for(CConfigValues::CPair *pair = m_values.PGetFirstAssoc(); pair != NULL; pair = m_values.PGetNextAssoc(pair))
+        {
+            CONFIGVALUE& value = pair->value;
+            if(!value.dirty)
+            {
+                continue;
+            }
+            value.dirty = false;
+
+            CString section = value.section;
+            section.MakeLower();
+
+            HKEY key;
+            if(!keys.Lookup(section, key))
+            {
+                key = AfxGetApp()->GetSectionKey(value.section); // Creates it
+                keys.SetAt(section, key);
+            }
+            if(key == NULL)
+            {
+                continue;
+            }
+
+            switch (value.type)
+            {
+            case REG_DWORD:
+                {
+                    const DWORD number = (DWORD)value.number;
+                    ::RegSetValueEx(key, value.entry, 0, REG_DWORD, (const BYTE *)&number, sizeof(number));
+                }
+                break;
+
+            case REG_SZ:
+                {
+                    ::RegSetValueEx(key, value.entry, 0, REG_SZ, (const BYTE *)value.string.GetString(), (value.string.GetLength() + 1) * sizeof(TCHAR));
+                }
+                break;
+
+            default:
+                {
+                    ::RegDeleteValue(key, value.entry);
+                }
+            }
+        }
+
+        POSITION pos = keys.GetStartPosition();
+        while(pos != NULL)
+        {
+            CString section;
+            HKEY key;
+            keys.GetNextAssoc(pos, section, key);
+            if(key != NULL)
+            {
+                ::RegCloseKey(key);
+            }
+        }
+
+        m_dirtyCount = 0;
+    }
+
+    // InitInstance() has called SetRegistryKey(), we don't use an INI file.
+    void CConfigCache::EnsureLoaded()
+    {
+        if(m_loaded)
+        {
+            return;
+        }
+        m_loaded = true;
+
+        HKEY key = AfxGetApp()->GetAppRegistryKey();
+        if(key != NULL)
+        {
+            LoadKey(key, CString());
+            ::RegCloseKey(key);
+        }
+    }
+
+    void CConfigCache::LoadKey(HKEY key, const CString& section)
+    {
+        DWORD subkeys = 0;
+        DWORD maxSubkeyLength = 0;
+        DWORD values = 0;
+        DWORD maxNameLength = 0;
+        DWORD maxDataLength = 0;
+        if(::RegQueryInfoKey(key, NULL, NULL, NULL, &subkeys, &maxSubkeyLength, NULL, &values, &maxNameLength, &maxDataLength, NULL, NULL) != ERROR_SUCCESS)
+        {
+            return;
+        }
+
+        CArray<TCHAR, TCHAR> name;
+        name.SetSize(max(maxNameLength, maxSubkeyLength) + 1);
+
+        // Room for a terminating null, which REG_SZ data may lack
+        CArray<BYTE, BYTE> data;
+        data.SetSize(maxDataLength + sizeof(TCHAR));
+
+        for(DWORD i = 0; i < values; i++)
+        {
+            DWORD nameLength = (DWORD)name.GetSize();
+            DWORD dataLength = maxDataLength;
+            DWORD type = REG_NONE;
+            if(::RegEnumValue(key, i, name.GetData(), &nameLength, NULL, &type, data.GetData(), &dataLength) != ERROR_SUCCESS)
+            {
+                continue;
+            }
+
+            CONFIGVALUE value;
+            value.section = section;
+            value.entry = name.GetData();
+            value.type = type;
+            value.number = 0;
+            value.dirty = false;
+
+            if(REG_DWORD == type && dataLength == sizeof(DWORD))
+            {
+                value.number = *(const int *)data.GetData();
+            }
+            else if(REG_SZ == type || REG_EXPAND_SZ == type)
+            {
+                ZeroMemory(data.GetData() + dataLength, sizeof(TCHAR));
+                value.type = REG_SZ;
+                value.string = (LPCTSTR)data.GetData();
+            }
+            else
+            {
+                continue;   // E.g. the binary bar state, which MFC reads itself
+            }
+
+            m_values.SetAt(MakeKey(section, value.entry), value);
+        }
+
+        for(DWORD i = 0; i < subkeys; i++)
+        {
+            DWORD nameLength = (DWORD)name.GetSize();
+            if(::RegEnumKeyEx(key, i, name.GetData(), &nameLength, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
+            {
+                continue;
+            }
+
+            HKEY subkey;
+            if(::RegOpenKeyEx(key, name.GetData(), 0, KEY_READ, &subkey) == ERROR_SUCCESS)
+            {
+                LoadKey(subkey, section.IsEmpty() ? CString(name.GetData()) : section + wds::chrBackslash + name.GetData());
+                ::RegCloseKey(subkey);
+            }
+        }
+    }
+
+    CString CConfigCache::MakeKey(LPCTSTR section, LPCTSTR entry)
+    {
+        CString key = section;
+        key += wds::chrBackslash;
+        key += entry;
+        key.MakeLower();
+        return key;
+    }
+}
+
+void CRegistryUser::flushProfile()
+{
+    CSingleLock lock(&_theConfigCache.m_cs, true);
+    _theConfigCache.Flush();
+}
+
 void CRegistryUser::setProfileString(LPCTSTR section, LPCTSTR entry, LPCTSTR value)
 {
-    AfxGetApp()->WriteProfileString(section, entry, value);
+    CSingleLock lock(&_theConfigCache.m_cs, true);
+    _theConfigCache.Set(section, entry, value != NULL ? REG_SZ : REG_NONE, 0, value != NULL ? value : wds::strEmpty);
 }
 
 CString CRegistryUser::getProfileString(LPCTSTR section, LPCTSTR entry, LPCTSTR defaultValue)
 {
-    return AfxGetApp()->GetProfileString(section, entry, defaultValue);
+    CSingleLock lock(&_theConfigCache.m_cs, true);
+    const CONFIGVALUE *value = _theConfigCache.Lookup(section, entry);
+    return value != NULL && REG_SZ == value->type ? value->string : CString(defaultValue);
 }
 
 void CRegistryUser::setProfileInt(LPCTSTR section, LPCTSTR entry, int value)
 {
-    AfxGetApp()->WriteProfileInt(section, entry, value);
+    CSingleLock lock(&_theConfigCache.m_cs, true);
+    _theConfigCache.Set(section, entry, REG_DWORD, value, wds::strEmpty);
 }
 
 int CRegistryUser::getProfileInt(LPCTSTR section, LPCTSTR entry, int defaultValue)
 {
-    return AfxGetApp()->GetProfileInt(section, entry, defaultValue);
+    CSingleLock lock(&_theConfigCache.m_cs, true);
+    const CONFIGVALUE *value = _theConfigCache.Lookup(section, entry);
+    return value != NULL && REG_DWORD == value->type ? value->number : defaultValue;
 }
 
 void CRegistryUser::setProfileBool(LPCTSTR section, LPCTSTR entry, bool value)
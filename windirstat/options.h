@@ -39,7 +39,7 @@ enum REFRESHPOLICY
     RP_NO_REFRESH,
     RP_REFRESH_THIS_ENTRY,
     RP_REFRESH_THIS_ENTRYS_PARENT,
-    // RP_ASSUME_ENTRY_HAS_BEEN_DELETED, // feature not implemented.
+    RP_ASSUME_ENTRY_HAS_BEEN_DELETED,
     REFRESHPOLICYCOUNT
 };
 
@@ -175,9 +175,19 @@ private:
     std::auto_ptr<ICfgStorage> m_secondaryStore;
 };
 
+//
+// CRegistryUser. Access to the application's registry key. The whole key is
+// read into memory on first use, so the getters are map lookups (some are
+// called on each idle or paint). The setters only change the copy and mark
+// the value; flushProfile() writes the changed values in one pass. It is
+// called when the options are saved, before another instance is started
+// and on exit.
+//
 class CRegistryUser
 {
 public:
+    static void flushProfile();
+
     static void setProfileString(LPCTSTR section, LPCTSTR entry, LPCTSTR value);
     static CString getProfileString(LPCTSTR section, LPCTSTR entry, LPCTSTR defaultValue = wds::strEmpty);
 
@@ -256,6 +266,12 @@ public:
     static bool GetShowDeleteWarning();
     static void SetShowDeleteWarning(bool show);
 
+    // Type names of the icon cache, ".txt" -> "Text Document".
+    // extensions: the stored ones, most recently used first.
+    static void GetExtensionTypeNames(CMapStringToString& names, CStringArray& extensions);
+    // Stores the names of the first MAX_EXTENSIONTYPENAMES of extensions.
+    static void SetExtensionTypeNames(const CStringArray& extensions, const CMapStringToString& names);
+
 private:
     static void SetArray(LPCTSTR entry, const CArray<int, int>& arr);
     static void GetArray(LPCTSTR entry, /* in/out */ CArray<int, int>& arr);
@@ -355,6 +371,46 @@ public:
     bool IsSkipHidden();
     void SetSkipHidden(bool skip);
 
+    // Option to count the space allocated on disk instead of the file length
+    bool IsAllocatedSize();
+    void SetAllocatedSize(bool allocated);
+
+    // Option to count files with several hard links only once
+    bool IsCountHardLinksOnce();
+    void SetCountHardLinksOnce(bool once);
+
+    // Memory budget (MB) for the item tree, 0 = unlimited. Beyond it, cold
+    // subtrees are spilled to disk. Not on a property page (registry only).
+    int GetSpillBudget();
+    void SetSpillBudget(int megabytes);
+
+    // Number of user defined cleanup commands run at the same time.
+    // 0 (the default) = one per processor. Registry only.
+    int GetCleanupConcurrency();
+    void SetCleanupConcurrency(int processes);
+
+    // Number of threads of a permanent deletion. 0 (the default) = one per
+    // processor. Registry only.
+    int GetDeleteConcurrency();
+    void SetDeleteConcurrency(int threads);
+
+    // Whether recursive cleanups, which take the subdirectories from the
+    // tree, check the directories for changes since the scan. Off by
+    // default, as the check costs a GetFileAttributesEx() per directory,
+    // which the tree was meant to save. Registry only.
+    bool IsCleanupCheckFreshness();
+    void SetCleanupCheckFreshness(bool check);
+
+    // Rules, which exclude directory entries from the scan or count them
+    // (see CScanFilter). Registry only, section options\scanFilters.
+    void GetScanFilters(CStringArray& rules);
+    void SetScanFilters(const CStringArray& rules);
+
+    // SQLite database, to which the totals of each completed scan are
+    // added (see CScanHistory). Empty (the default) = none. Registry only.
+    CString GetHistoryDatabase();
+    void SetHistoryDatabase(LPCTSTR file);
+
     void GetUserDefinedCleanups(USERDEFINEDCLEANUP udc[USERDEFINEDCLEANUPCOUNT]);
     void SetUserDefinedCleanups(const USERDEFINEDCLEANUP udc[USERDEFINEDCLEANUPCOUNT]);
 
@@ -396,6 +452,14 @@ private:
     bool m_followJunctionPoints;
     bool m_useWdsLocale;
     bool m_skipHidden;
+    bool m_allocatedSize;
+    bool m_countHardLinksOnce;
+    int m_spillBudget;
+    int m_cleanupConcurrency;
+    bool m_cleanupCheckFreshness;
+    int m_deleteConcurrency;
+    CStringArray m_scanFilters;
+    CString m_historyDatabase;
 
     USERDEFINEDCLEANUP m_userDefinedCleanup[USERDEFINEDCLEANUPCOUNT];
 
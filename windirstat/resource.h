@@ -105,6 +105,22 @@
 #define IDS_LANGUAGERESTARTNOW          277
 #define IDS_ABOUT_AUTHORS               278
 #define IDS_ABOUT_AUTHORSTEXTs          279
+#define IDS_sMOREITEMS                  280
+#define IDS_JSONFILTER                  281
+#define IDS_EXPORTFILTER                282
+#define IDS_CLEANUPPROGRESSddd          283
+#define IDS_CLEANUPDONEddd              284
+#define IDS_CLEANUPCANCELLEDddd         285
+#define IDS_EXITCODEdINs                286
+#define IDS_COULDNOTSTARTINss           287
+#define IDS_CLOSE                       288
+#define IDS_POLICY_ASSUMEDELETED        289
+#define IDS_DELETINGssss                290
+#define IDS_DELETEDssss                 291
+#define IDS_DELETECANCELLEDssss         292
+#define IDS_COULDNOTDELETEss            293
+#define IDS_sSELECTEDITEMS              294
+#define IDS_PERMANENTLYDELETEs          295
 #define IDS_TRANSLATORS                 899
 #define IDR_TEXT1                       900
 #define IDR_AUTHORS                     900
@@ -112,6 +128,9 @@
 
 #define IDB_JUNCTIONPOINT               902
 #define IDD_CHECKFORUPDATE              903
+#define IDD_SCANSTATISTICS              910
+#define IDD_CLEANUPPROGRESS             911
+#define IDD_DELETEPROGRESS              912
 #define IDC_ALLDRIVES                   1000
 #define IDC_GROUPS                      1000
 #define IDC_ALLLOCALDRIVES              1000
@@ -197,6 +216,13 @@
 #define IDC_STATIC_URL                  1227
 #define IDC_STATIC_TEXT                 1228
 #define IDC_BUTTON1                     1229
+#define IDC_STATISTICS                  1230
+#define IDC_SAVEJSON                    1231
+#define IDC_ALLOCATEDSIZE               1232
+#define IDC_HARDLINKSONCE               1233
+#define IDC_CLEANUPSTATUS               1234
+#define IDC_CLEANUPPROGRESS             1235
+#define IDC_FAILURES                    1236
 #define ID_FILE_OPENURL                 32771
 #define ID_FILE_OPENRECENT              32772
 #define ID_FILE_REFRESHALL              32773
@@ -263,15 +289,18 @@
 #define ID_HELP_CHECKFORUPDATES         33024
 #define ID_FILE_RUNWINDIRSTATELEVATED   33025
 #define ID_RUNELEVATED                  33026
+#define ID_HELP_SCANSTATISTICS          33027
+#define ID_REPORT_EXPORT                33028
 #define ID_INDICATOR_MEMORYUSAGE        59142
+#define ID_INDICATOR_PAINTTIME          59143
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        910
-#define _APS_NEXT_COMMAND_VALUE         33027
-#define _APS_NEXT_CONTROL_VALUE         1230
+#define _APS_NEXT_RESOURCE_VALUE        913
+#define _APS_NEXT_COMMAND_VALUE         33029
+#define _APS_NEXT_CONTROL_VALUE         1237
 #define _APS_NEXT_SYMED_VALUE           104
 #endif
 #endif
@@ -0,0 +1,447 @@
+// scanfilter.cpp - Implementation of CScanFilter
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "options.h"
+#include "WDS_Lua_C.h"
+#include "scanfilter.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    CScanFilter _theScanFilter;
+
+    const LPCTSTR SYNTAX = _T("Syntax: <exclude|tag> <name|path|lua>:<pattern>");
+}
+
+CScanFilter *GetScanFilter()
+{
+    return &_theScanFilter;
+}
+
+CScanFilter::CScanFilter()
+    : m_hasExcludeRules(false)
+    , m_needsPath(false)
+    , m_lua(NULL)
+    , m_evaluations(0)
+{
+}
+
+CScanFilter::~CScanFilter()
+{
+    CloseLua();
+}
+
+void CScanFilter::StartScan()
+{
+    CStringArray rules;
+    GetOptions()->GetScanFilters(rules);
+
+    Compile(rules);
+    ResetCounters();
+}
+
+void CScanFilter::Compile(const CStringArray& rules)
+{
+    if(rules.GetSize() == m_rules.GetSize())
+    {
+        int i = 0;
+        while(i < rules.GetSize() && rules[i] == m_rules[i].text)
+        {
+            i++;
+        }
+        if(i == rules.GetSize())
+        {
+            return; // Unchanged
+        }
+    }
+
+    CloseLua();
+    m_rules.RemoveAll();
+    m_hasExcludeRules = false;
+    m_needsPath = false;
+
+    for(int i = 0; i < rules.GetSize(); i++)
+    {
+        SCANFILTERRULE rule;
+        rule.text = rules[i];
+        rule.action = SFA_EXCLUDE;
+        rule.subject = SFS_NAME;
+        rule.form = SFF_EXACT;
+        rule.function = LUA_NOREF;
+        rule.matches = 0;
+        rule.bytes = 0;
+
+        if(!Parse(rules[i], rule))
+        {
+            rule.error = SYNTAX;
+        }
+        else if(SFS_LUA == rule.subject)
+        {
+            CompileLua(rule);
+        }
+
+        if(rule.error.IsEmpty())
+        {
+            m_hasExcludeRules |= (SFA_EXCLUDE == rule.action);
+            m_needsPath |= (rule.subject != SFS_NAME);
+        }
+        else
+        {
+            VTRACE(_T("Scan filter \"%s\": %s"), rule.text.GetString(), rule.error.GetString());
+        }
+
+        m_rules.Add(rule);
+    }
+}
+
+void CScanFilter::ResetCounters()
+{
+    for(int i = 0; i < m_rules.GetSize(); i++)
+    {
+        m_rules[i].matches = 0;
+        m_rules[i].bytes = 0;
+    }
+    m_evaluations = 0;
+}
+
+bool CScanFilter::IsEmpty() const
+{
+    return m_rules.GetSize() == 0;
+}
+
+bool CScanFilter::HasExcludeRules() const
+{
+    return m_hasExcludeRules;
+}
+
+bool CScanFilter::NeedsPath() const
+{
+    return m_needsPath;
+}
+
+void CScanFilter::BeginDirectory(LPCTSTR path)
+{
+    m_directory = path;
+    if(m_directory.Right(1) != wds::chrBackslash)
+    {
+        m_directory += wds::chrBackslash;
+    }
+}
+
+bool CScanFilter::IsExcluded(LPCTSTR name, DWORD attributes, ULONGLONG length)
+{
+    m_evaluations++;
+
+    if(m_needsPath)
+    {
+        m_path = m_directory + name;
+    }
+
+    for(int i = 0; i < m_rules.GetSize(); i++)
+    {
+        SCANFILTERRULE& rule = m_rules[i];
+        if(!rule.error.IsEmpty() || !Matches(rule, name, attributes, length))
+        {
+            continue;
+        }
+
+        rule.matches++;
+        if((attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            rule.bytes += length;
+        }
+        return SFA_EXCLUDE == rule.action;
+    }
+    return false;
+}
+
+int CScanFilter::GetRuleCount() const
+{
+    return (int)m_rules.GetSize();
+}
+
+const SCANFILTERRULE& CScanFilter::GetRule(int i) const
+{
+    return m_rules[i];
+}
+
+ULONGLONG CScanFilter::GetEvaluations() const
+{
+    return m_evaluations;
+}
+
+// "<action> <subject>:<pattern>"
+bool CScanFilter::Parse(const CString& text, SCANFILTERRULE& rule)
+{
+    CString s = text;
+    s.Trim();
+
+    const int space = s.FindOneOf(_T(" \t"));
+    if(space < 0)
+    {
+        return false;
+    }
+
+    const CString action = s.Left(space);
+    if(action.CompareNoCase(_T("exclude")) == 0)
+    {
+        rule.action = SFA_EXCLUDE;
+    }
+    else if(action.CompareNoCase(_T("tag")) == 0)
+    {
+        rule.action = SFA_TAG;
+    }
+    else
+    {
+        return false;
+    }
+
+    s = s.Mid(space + 1);
+    s.TrimLeft();
+
+    const int colon = s.Find(wds::chrColon);
+    if(colon < 0)
+    {
+        return false;
+    }
+
+    const CString subject = s.Left(colon);
+    const CString pattern = s.Mid(colon + 1);
+    if(pattern.IsEmpty())
+    {
+        return false;
+    }
+
+    if(subject.CompareNoCase(_T("lua")) == 0)
+    {
+        rule.subject = SFS_LUA;
+        rule.literal = pattern;
+        return true;
+    }
+
+    if(subject.CompareNoCase(_T("name")) == 0)
+    {
+        rule.subject = SFS_NAME;
+    }
+    else if(subject.CompareNoCase(_T("path")) == 0)
+    {
+        rule.subject = SFS_PATH;
+    }
+    else
+    {
+        return false;
+    }
+
+    CString glob = pattern;
+    glob.MakeLower();
+    rule.form = Classify(glob, rule.literal);
+    return true;
+}
+
+// The globs, which don't need MatchGlob().
+int CScanFilter::Classify(const CString& glob, CString& literal)
+{
+    int stars = 0;
+    for(int i = 0; i < glob.GetLength(); i++)
+    {
+        if(glob[i] == _T('?'))
+        {
+            literal = glob;
+            return SFF_GLOB;
+        }
+        if(glob[i] == _T('*'))
+        {
+            stars++;
+        }
+    }
+
+    if(stars == 0)
+    {
+        literal = glob;
+        return SFF_EXACT;
+    }
+    if(glob == _T("*"))
+    {
+        literal.Empty();
+        return SFF_ANY;
+    }
+    if(stars == 1 && glob[0] == _T('*'))
+    {
+        literal = glob.Mid(1);
+        return SFF_SUFFIX;
+    }
+    if(stars == 1 && glob[glob.GetLength() - 1] == _T('*'))
+    {
+        literal = glob.Left(glob.GetLength() - 1);
+        return SFF_PREFIX;
+    }
+
+    literal = glob;
+    return SFF_GLOB;
+}
+
+// glob is lower case. Iterative, it only backtracks to the last "*".
+bool CScanFilter::MatchGlob(LPCTSTR glob, LPCTSTR s)
+{
+    LPCTSTR star = NULL;
+    LPCTSTR resume = NULL;
+
+    while(*s != 0)
+    {
+        if(*glob == _T('*'))
+        {
+            star = ++glob;
+            resume = s;
+        }
+        else if(*glob == _T('?') || *glob == (TCHAR)_totlower(*s))
+        {
+            glob++;
+            s++;
+        }
+        else if(star != NULL)
+        {
+            glob = star;
+            s = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while(*glob == _T('*'))
+    {
+        glob++;
+    }
+    return *glob == 0;
+}
+
+bool CScanFilter::Matches(SCANFILTERRULE& rule, LPCTSTR name, DWORD attributes, ULONGLONG length)
+{
+    if(SFS_LUA == rule.subject)
+    {
+        return MatchesLua(rule, name, attributes, length);
+    }
+
+    LPCTSTR s = (SFS_PATH == rule.subject ? m_path.GetString() : name);
+
+    switch (rule.form)
+    {
+    case SFF_EXACT:
+        {
+            return _tcsicmp(s, rule.literal) == 0;
+        }
+
+    case SFF_SUFFIX:
+        {
+            const int n = (int)_tcslen(s);
+            return n >= rule.literal.GetLength() && _tcsicmp(s + n - rule.literal.GetLength(), rule.literal) == 0;
+        }
+
+    case SFF_PREFIX:
+        {
+            return _tcsnicmp(s, rule.literal, rule.literal.GetLength()) == 0;
+        }
+
+    case SFF_ANY:
+        {
+            return true;
+        }
+
+    default:
+        {
+            return MatchGlob(rule.literal, s);
+        }
+    }
+}
+
+void CScanFilter::CompileLua(SCANFILTERRULE& rule)
+{
+    if(m_lua == NULL)
+    {
+        m_lua = luaWDS_open();
+        if(m_lua == NULL)
+        {
+            rule.error = _T("Cannot create the Lua state.");
+            return;
+        }
+    }
+
+    // A function, which returns the expression
+    const CStringA chunk = "return function(name, path, attributes, size, isdir) return ("
+        + CStringA(CW2A(rule.literal, CP_UTF8)) + "\n) end";
+
+    int status = luaL_loadbuffer(m_lua, chunk, chunk.GetLength(), "=scan filter");
+    if(status == 0)
+    {
+        status = lua_pcall(m_lua, 0, 1, 0);
+    }
+    if(status != 0)
+    {
+        const char *message = lua_tostring(m_lua, -1);
+        rule.error = CA2W(message != NULL ? message : "(error object is not a string)", CP_UTF8);
+        lua_pop(m_lua, 1);
+        return;
+    }
+
+    rule.function = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+}
+
+bool CScanFilter::MatchesLua(SCANFILTERRULE& rule, LPCTSTR name, DWORD attributes, ULONGLONG length)
+{
+    lua_rawgeti(m_lua, LUA_REGISTRYINDEX, rule.function);
+    lua_pushstring(m_lua, CW2A(name, CP_UTF8));
+    lua_pushstring(m_lua, CW2A(m_path, CP_UTF8));
+    lua_pushnumber(m_lua, attributes);
+    lua_pushnumber(m_lua, (lua_Number)length);
+    lua_pushboolean(m_lua, (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+
+    if(lua_pcall(m_lua, 5, 1, 0) != 0)
+    {
+        // The rule is off for the rest of the scan (and the ones after,
+        // until the rules change).
+        const char *message = lua_tostring(m_lua, -1);
+        rule.error = CA2W(message != NULL ? message : "(error object is not a string)", CP_UTF8);
+        lua_pop(m_lua, 1);
+        VTRACE(_T("Scan filter \"%s\": %s"), rule.text.GetString(), rule.error.GetString());
+
+        luaL_unref(m_lua, LUA_REGISTRYINDEX, rule.function);
+        rule.function = LUA_NOREF;
+        return false;
+    }
+
+    const bool match = (lua_toboolean(m_lua, -1) != 0);
+    lua_pop(m_lua, 1);
+    return match;
+}
+
+void CScanFilter::CloseLua()
+{
+    if(m_lua != NULL)
+    {
+        lua_close(m_lua);
+        m_lua = NULL;
+    }
+}
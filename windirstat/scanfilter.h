@@ -0,0 +1,134 @@
+// scanfilter.h - Declaration of CScanFilter
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_SCANFILTER_H__
+#define __WDS_SCANFILTER_H__
+#pragma once
+
+struct lua_State;
+
+//
+// SCANFILTERRULE. One compiled rule of CScanFilter.
+//
+struct SCANFILTERRULE
+{
+    CString text;       // As configured
+    int action;         // CScanFilter::SFA_*
+    int subject;        // CScanFilter::SFS_*
+    int form;           // CScanFilter::SFF_*, how the glob is matched
+    CString literal;    // The glob (lower case) without the leading or trailing "*", or the Lua expression
+    int function;       // Lua registry reference of the compiled expression, or LUA_NOREF
+    CString error;      // Why the rule doesn't work. Empty if it does.
+    ULONGLONG matches;  // Entries matched during the current scan
+    ULONGLONG bytes;    // Their length (files only)
+};
+
+//
+// CScanFilter. Rules, which CItem::DoSomeWork() applies to each directory
+// entry it finds. Excluded entries never become items, so they cost no
+// memory, and excluded directories are not even enumerated. Tag rules
+// exclude nothing, they only count their matches (see the scan
+// statistics), e.g. to see what an exclusion would save.
+//
+// The rules are COptions::GetScanFilters(), one per string:
+//
+//   exclude name:.git                      Glob over the name
+//   exclude name:*.vhdx
+//   tag path:*\appdata\local\temp\*        Glob over the full path
+//   exclude lua:isdir and size == 0 and name:find("^~")
+//
+// Globs know "*" and "?" and ignore case. A Lua expression (LuaJIT, see
+// luaWDS_open()) sees name, path, attributes, size and isdir; it is
+// compiled into a function once. The first rule, which matches, wins.
+//
+// StartScan() compiles the rules, when a scan starts. As long as they
+// don't change, the compiled ones (and the Lua state) are kept. The usual globs
+// ("name", "*.ext", "prefix*") are then a single string compare, and the
+// path of an entry is only built if a rule needs it.
+//
+class CScanFilter
+{
+public:
+    enum
+    {
+        SFA_EXCLUDE,
+        SFA_TAG
+    };
+
+    enum
+    {
+        SFS_NAME,
+        SFS_PATH,
+        SFS_LUA
+    };
+
+    enum
+    {
+        SFF_EXACT,      // literal
+        SFF_SUFFIX,     // *literal
+        SFF_PREFIX,     // literal*
+        SFF_ANY,        // *
+        SFF_GLOB        // Anything else
+    };
+
+    CScanFilter();
+    ~CScanFilter();
+
+    // Compiles COptions::GetScanFilters() and resets the counters.
+    void StartScan();
+    void Compile(const CStringArray& rules);
+    void ResetCounters();
+
+    bool IsEmpty() const;
+    bool HasExcludeRules() const;
+
+    // path: The directory, which is being enumerated. Only needed (and
+    // only worth building) if NeedsPath().
+    bool NeedsPath() const;
+    void BeginDirectory(LPCTSTR path);
+    // Returns true, if the entry shall not become an item.
+    bool IsExcluded(LPCTSTR name, DWORD attributes, ULONGLONG length);
+
+    int GetRuleCount() const;
+    const SCANFILTERRULE& GetRule(int i) const;
+    ULONGLONG GetEvaluations() const;
+
+private:
+    static bool Parse(const CString& text, SCANFILTERRULE& rule);
+    static int Classify(const CString& glob, CString& literal);
+    static bool MatchGlob(LPCTSTR glob, LPCTSTR s);
+    bool Matches(SCANFILTERRULE& rule, LPCTSTR name, DWORD attributes, ULONGLONG length);
+    void CompileLua(SCANFILTERRULE& rule);
+    bool MatchesLua(SCANFILTERRULE& rule, LPCTSTR name, DWORD attributes, ULONGLONG length);
+    void CloseLua();
+
+    CArray<SCANFILTERRULE, SCANFILTERRULE&> m_rules;
+    bool m_hasExcludeRules;
+    bool m_needsPath;       // A path or Lua rule
+    lua_State *m_lua;       // NULL without Lua rules
+    CString m_directory;    // With trailing backslash
+    CString m_path;         // Of the current entry, if m_needsPath
+    ULONGLONG m_evaluations;
+};
+
+CScanFilter *GetScanFilter();
+
+#endif // __WDS_SCANFILTER_H__
@@ -0,0 +1,561 @@
+// scanhistory.cpp - Implementation of CScanHistory
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "scanstats.h"
+#include "osspecific.h"
+#include <3rdparty/sqlite3/sqlite3.h>
+#include "scanhistory.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    //
+    // The functions of sqlite3.dll, which we use.
+    //
+    class CSqliteApi
+    {
+    public:
+        CSqliteApi()
+            : m_dll(_T("sqlite3.dll"))
+            , open16(m_dll.Handle(), "sqlite3_open16")
+            , close(m_dll.Handle(), "sqlite3_close")
+            , exec(m_dll.Handle(), "sqlite3_exec")
+            , prepare_v2(m_dll.Handle(), "sqlite3_prepare_v2")
+            , step(m_dll.Handle(), "sqlite3_step")
+            , reset(m_dll.Handle(), "sqlite3_reset")
+            , finalize(m_dll.Handle(), "sqlite3_finalize")
+            , bind_int64(m_dll.Handle(), "sqlite3_bind_int64")
+            , bind_text16(m_dll.Handle(), "sqlite3_bind_text16")
+            , column_int64(m_dll.Handle(), "sqlite3_column_int64")
+            , column_text16(m_dll.Handle(), "sqlite3_column_text16")
+            , changes(m_dll.Handle(), "sqlite3_changes")
+            , last_insert_rowid(m_dll.Handle(), "sqlite3_last_insert_rowid")
+            , errmsg16(m_dll.Handle(), "sqlite3_errmsg16")
+        {
+        }
+
+        bool IsSupported()
+        {
+            return open16.IsSupported() && close.IsSupported() && exec.IsSupported() && prepare_v2.IsSupported()
+                && step.IsSupported() && reset.IsSupported() && finalize.IsSupported() && bind_int64.IsSupported()
+                && bind_text16.IsSupported() && column_int64.IsSupported() && column_text16.IsSupported()
+                && changes.IsSupported() && last_insert_rowid.IsSupported() && errmsg16.IsSupported();
+        }
+
+        CDllModule m_dll;
+        CDynamicApi<int (*)(const void *, sqlite3 **)> open16;
+        CDynamicApi<int (*)(sqlite3 *)> close;
+        CDynamicApi<int (*)(sqlite3 *, const char *, int (*)(void *, int, char **, char **), void *, char **)> exec;
+        CDynamicApi<int (*)(sqlite3 *, const char *, int, sqlite3_stmt **, const char **)> prepare_v2;
+        CDynamicApi<int (*)(sqlite3_stmt *)> step;
+        CDynamicApi<int (*)(sqlite3_stmt *)> reset;
+        CDynamicApi<int (*)(sqlite3_stmt *)> finalize;
+        CDynamicApi<int (*)(sqlite3_stmt *, int, sqlite3_int64)> bind_int64;
+        CDynamicApi<int (*)(sqlite3_stmt *, int, const void *, int, void (*)(void *))> bind_text16;
+        CDynamicApi<sqlite3_int64 (*)(sqlite3_stmt *, int)> column_int64;
+        CDynamicApi<const void *(*)(sqlite3_stmt *, int)> column_text16;
+        CDynamicApi<int (*)(sqlite3 *)> changes;
+        CDynamicApi<sqlite3_int64 (*)(sqlite3 *)> last_insert_rowid;
+        CDynamicApi<const void *(*)(sqlite3 *)> errmsg16;
+    };
+
+    // Loaded on first use, not at startup
+    CSqliteApi *Sqlite()
+    {
+        static CSqliteApi api;
+        return &api;
+    }
+
+    const char *const SCHEMA =
+        "PRAGMA journal_mode = WAL;"
+        "PRAGMA synchronous = NORMAL;"
+        "CREATE TABLE IF NOT EXISTS scan(id INTEGER PRIMARY KEY, root TEXT NOT NULL, time INTEGER NOT NULL,"
+        " size INTEGER NOT NULL, files INTEGER NOT NULL, subdirs INTEGER NOT NULL);"
+        "CREATE INDEX IF NOT EXISTS scan_root_time ON scan(root, time);"
+        "CREATE TABLE IF NOT EXISTS path(id INTEGER PRIMARY KEY, parent INTEGER NOT NULL, name TEXT NOT NULL COLLATE NOCASE,"
+        " UNIQUE(parent, name));"
+        "CREATE TABLE IF NOT EXISTS directory(scan INTEGER NOT NULL, path INTEGER NOT NULL, size INTEGER NOT NULL,"
+        " files INTEGER NOT NULL, subdirs INTEGER NOT NULL, lastchange INTEGER NOT NULL, PRIMARY KEY(scan, path)) WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS extension(scan INTEGER NOT NULL, ext TEXT NOT NULL, files INTEGER NOT NULL,"
+        " bytes INTEGER NOT NULL, PRIMARY KEY(scan, ext)) WITHOUT ROWID;";
+
+    // FILETIME ticks between 1601-01-01 and 1970-01-01
+    const ULONGLONG UNIX_EPOCH = 116444736000000000ULL;
+
+    LONGLONG ToUnixTime(const FILETIME& t)
+    {
+        ULARGE_INTEGER u;
+        u.LowPart = t.dwLowDateTime;
+        u.HighPart = t.dwHighDateTime;
+
+        return ((LONGLONG)u.QuadPart - (LONGLONG)UNIX_EPOCH) / 10000000;
+    }
+}
+
+CScanHistory::CScanHistory()
+    : m_db(NULL)
+    , m_insertPath(NULL)
+    , m_selectPath(NULL)
+    , m_insertDirectory(NULL)
+    , m_recordedRows(0)
+    , m_recordTime(0)
+{
+}
+
+CScanHistory::~CScanHistory()
+{
+    Close();
+}
+
+bool CScanHistory::Open(LPCTSTR file)
+{
+    Close();
+
+    if(!Sqlite()->IsSupported())
+    {
+        m_error = _T("sqlite3.dll not found.");
+        return false;
+    }
+
+    if(Sqlite()->open16.pfnFct(file, &m_db) != SQLITE_OK)
+    {
+        Fail();
+        Close();
+        return false;
+    }
+
+    if(!Execute(SCHEMA))
+    {
+        Close();
+        return false;
+    }
+
+    m_insertPath = Prepare("INSERT OR IGNORE INTO path(parent, name) VALUES(?, ?)");
+    m_selectPath = Prepare("SELECT id FROM path WHERE parent = ? AND name = ?");
+    m_insertDirectory = Prepare("INSERT INTO directory VALUES(?, ?, ?, ?, ?, ?)");
+    if(m_insertPath == NULL || m_selectPath == NULL || m_insertDirectory == NULL)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void CScanHistory::Close()
+{
+    Finalize(m_insertPath);
+    Finalize(m_selectPath);
+    Finalize(m_insertDirectory);
+
+    if(m_db != NULL)
+    {
+        // Even if open16() failed, there is a handle.
+        Sqlite()->close.pfnFct(m_db);
+        m_db = NULL;
+    }
+}
+
+CString CScanHistory::GetLastError() const
+{
+    return m_error;
+}
+
+LONGLONG CScanHistory::GetUnixTime()
+{
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    return ToUnixTime(now);
+}
+
+// Takes what Record() writes from the tree. This is quick and doesn't
+// read spilled subtrees back (see CItem::GetSpilledDirectories()), so the
+// UI thread can do it and leave Record() to a worker thread.
+void CScanHistory::Snapshot(CItem *root, const CExtensionData *extensionData, HISTORYSNAPSHOT& snapshot)
+{
+    snapshot.root = root->GetPath();
+    snapshot.size = root->GetSize();
+    snapshot.files = root->GetFilesCount();
+    snapshot.subdirs = root->GetSubdirsCount();
+
+    snapshot.directories.RemoveAll();
+    SnapshotDirectory(root, -1, snapshot);
+
+    snapshot.extensions.RemoveAll();
+    POSITION pos = extensionData->GetStartPosition();
+    while(pos != NULL)
+    {
+        HISTORYEXTENSION extension;
+        SExtensionRecord r;
+        extensionData->GetNextAssoc(pos, extension.ext, r);
+        extension.files = r.files;
+        extension.bytes = r.bytes;
+        snapshot.extensions.Add(extension);
+    }
+}
+
+// Drives and directories, with the files in their totals.
+void CScanHistory::SnapshotDirectory(CItem *item, int parent, HISTORYSNAPSHOT& snapshot)
+{
+    int index = parent;
+
+    if(IT_DRIVE == item->GetType() || IT_DIRECTORY == item->GetType())
+    {
+        DIRECTORYTOTALS directory;
+        directory.parent = parent;
+        if(parent == -1)
+        {
+            // "C:", "C:\Windows" or "\\server\share"
+            directory.name = item->GetPath();
+            if(directory.name.Right(1) == wds::chrBackslash)
+            {
+                directory.name = directory.name.Left(directory.name.GetLength() - 1);
+            }
+        }
+        else
+        {
+            directory.name = item->GetName();
+        }
+        directory.size = item->GetSize();
+        directory.files = item->GetFilesCount();
+        directory.subdirs = item->GetSubdirsCount();
+        directory.lastChange = item->GetLastChange();
+        index = (int)snapshot.directories.Add(directory);
+    }
+    else if(item->GetType() != IT_MYCOMPUTER)
+    {
+        return;
+    }
+
+    if(item->IsSpilled())
+    {
+        item->GetSpilledDirectories(snapshot.directories, index);
+        return;
+    }
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        SnapshotDirectory(item->GetChild(i), index, snapshot);
+    }
+}
+
+LONGLONG CScanHistory::Record(const HISTORYSNAPSHOT& snapshot)
+{
+    ASSERT(m_db != NULL);
+    CSqliteApi *api = Sqlite();
+
+    const ULONGLONG start = CScanStatistics::Now();
+    m_recordedRows = 0;
+
+    if(!Execute("BEGIN"))
+    {
+        return 0;
+    }
+
+    LONGLONG scan = 0;
+    sqlite3_stmt *stmt = Prepare("INSERT INTO scan(root, time, size, files, subdirs) VALUES(?, ?, ?, ?, ?)");
+    if(stmt != NULL)
+    {
+        api->bind_text16.pfnFct(stmt, 1, snapshot.root.GetString(), -1, SQLITE_STATIC);
+        api->bind_int64.pfnFct(stmt, 2, GetUnixTime());
+        api->bind_int64.pfnFct(stmt, 3, snapshot.size);
+        api->bind_int64.pfnFct(stmt, 4, snapshot.files);
+        api->bind_int64.pfnFct(stmt, 5, snapshot.subdirs);
+        if(api->step.pfnFct(stmt) == SQLITE_DONE)
+        {
+            scan = api->last_insert_rowid.pfnFct(m_db);
+        }
+        else
+        {
+            Fail();
+        }
+        Finalize(stmt);
+    }
+
+    bool ok = (scan != 0 && RecordDirectories(snapshot.directories, scan));
+
+    if(ok)
+    {
+        stmt = Prepare("INSERT INTO extension VALUES(?, ?, ?, ?)");
+        ok = (stmt != NULL);
+
+        for(int i = 0; ok && i < snapshot.extensions.GetSize(); i++)
+        {
+            const HISTORYEXTENSION& extension = snapshot.extensions[i];
+
+            api->bind_int64.pfnFct(stmt, 1, scan);
+            api->bind_text16.pfnFct(stmt, 2, extension.ext.GetString(), -1, SQLITE_STATIC);
+            api->bind_int64.pfnFct(stmt, 3, extension.files);
+            api->bind_int64.pfnFct(stmt, 4, extension.bytes);
+            ok = (api->step.pfnFct(stmt) == SQLITE_DONE) || Fail();
+            api->reset.pfnFct(stmt);
+            if(ok)
+            {
+                m_recordedRows++;
+            }
+        }
+        Finalize(stmt);
+    }
+
+    if(!ok)
+    {
+        const CString error = m_error;
+        Execute("ROLLBACK");
+        m_error = error;
+        return 0;
+    }
+
+    if(!Execute("COMMIT"))
+    {
+        return 0;
+    }
+
+    m_recordTime = CScanStatistics::Now() - start;
+    return scan;
+}
+
+ULONGLONG CScanHistory::GetRecordedRows() const
+{
+    return m_recordedRows;
+}
+
+ULONGLONG CScanHistory::GetRecordTime() const
+{
+    return m_recordTime;
+}
+
+// The directories come in pre-order, so the parent's path id is known.
+bool CScanHistory::RecordDirectories(const CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&>& directories, LONGLONG scan)
+{
+    CSqliteApi *api = Sqlite();
+
+    CArray<LONGLONG, LONGLONG> pathIds;
+    pathIds.SetSize(directories.GetSize());
+
+    for(int i = 0; i < directories.GetSize(); i++)
+    {
+        const DIRECTORYTOTALS& directory = directories[i];
+        ASSERT(directory.parent < i);
+
+        const LONGLONG path = GetPathId(directory.parent == -1 ? 0 : pathIds[directory.parent], directory.name);
+        if(path == 0)
+        {
+            return false;
+        }
+        pathIds[i] = path;
+
+        api->bind_int64.pfnFct(m_insertDirectory, 1, scan);
+        api->bind_int64.pfnFct(m_insertDirectory, 2, path);
+        api->bind_int64.pfnFct(m_insertDirectory, 3, directory.size);
+        api->bind_int64.pfnFct(m_insertDirectory, 4, directory.files);
+        api->bind_int64.pfnFct(m_insertDirectory, 5, directory.subdirs);
+        api->bind_int64.pfnFct(m_insertDirectory, 6, ToUnixTime(directory.lastChange));
+        const bool done = (api->step.pfnFct(m_insertDirectory) == SQLITE_DONE);
+        api->reset.pfnFct(m_insertDirectory);
+        if(!done)
+        {
+            return Fail();
+        }
+        m_recordedRows++;
+    }
+    return true;
+}
+
+// Returns 0 on failure.
+LONGLONG CScanHistory::GetPathId(LONGLONG parent, const CString& name)
+{
+    CSqliteApi *api = Sqlite();
+
+    api->bind_int64.pfnFct(m_insertPath, 1, parent);
+    api->bind_text16.pfnFct(m_insertPath, 2, name.GetString(), -1, SQLITE_STATIC);
+    const int rc = api->step.pfnFct(m_insertPath);
+    api->reset.pfnFct(m_insertPath);
+    if(rc != SQLITE_DONE)
+    {
+        Fail();
+        return 0;
+    }
+
+    // New in this scan
+    if(api->changes.pfnFct(m_db) > 0)
+    {
+        return api->last_insert_rowid.pfnFct(m_db);
+    }
+
+    // Seen before
+    LONGLONG id = 0;
+    api->bind_int64.pfnFct(m_selectPath, 1, parent);
+    api->bind_text16.pfnFct(m_selectPath, 2, name.GetString(), -1, SQLITE_STATIC);
+    if(api->step.pfnFct(m_selectPath) == SQLITE_ROW)
+    {
+        id = api->column_int64.pfnFct(m_selectPath, 0);
+    }
+    else
+    {
+        Fail();
+    }
+    api->reset.pfnFct(m_selectPath);
+    return id;
+}
+
+bool CScanHistory::GetGrowth(LONGLONG scan, LONGLONG since, int count, LONGLONG& baselineTime, CArray<HISTORYGROWTH, HISTORYGROWTH&>& growth)
+{
+    ASSERT(m_db != NULL);
+    CSqliteApi *api = Sqlite();
+
+    growth.RemoveAll();
+    baselineTime = 0;
+
+    // Uses scan_root_time
+    sqlite3_stmt *stmt = Prepare("SELECT id, time FROM scan WHERE root = (SELECT root FROM scan WHERE id = ?1)"
+        " AND id <> ?1 AND time <= ?2 ORDER BY time DESC LIMIT 1");
+    if(stmt == NULL)
+    {
+        return false;
+    }
+
+    LONGLONG baseline = 0;
+    api->bind_int64.pfnFct(stmt, 1, scan);
+    api->bind_int64.pfnFct(stmt, 2, since);
+    const int rc = api->step.pfnFct(stmt);
+    if(rc == SQLITE_ROW)
+    {
+        baseline = api->column_int64.pfnFct(stmt, 0);
+        baselineTime = api->column_int64.pfnFct(stmt, 1);
+    }
+    else if(rc != SQLITE_DONE)
+    {
+        Fail();
+    }
+    Finalize(stmt);
+
+    if(rc != SQLITE_ROW)
+    {
+        return rc == SQLITE_DONE;
+    }
+
+    // Uses the primary key of directory for the join. Directories, which
+    // are new, grew by their whole size.
+    stmt = Prepare("SELECT d1.path, d1.size, d1.size - IFNULL(d0.size, 0) AS growth"
+        " FROM directory d1 LEFT JOIN directory d0 ON d0.scan = ?2 AND d0.path = d1.path"
+        " WHERE d1.scan = ?1 ORDER BY growth DESC LIMIT ?3");
+    if(stmt == NULL)
+    {
+        return false;
+    }
+
+    api->bind_int64.pfnFct(stmt, 1, scan);
+    api->bind_int64.pfnFct(stmt, 2, baseline);
+    api->bind_int64.pfnFct(stmt, 3, count);
+
+    CArray<LONGLONG, LONGLONG> ids;
+    int step;
+    while((step = api->step.pfnFct(stmt)) == SQLITE_ROW)
+    {
+        HISTORYGROWTH g;
+        g.size = api->column_int64.pfnFct(stmt, 1);
+        g.growth = api->column_int64.pfnFct(stmt, 2);
+        growth.Add(g);
+        ids.Add(api->column_int64.pfnFct(stmt, 0));
+    }
+    Finalize(stmt);
+
+    if(step != SQLITE_DONE)
+    {
+        return Fail();
+    }
+
+    for(int i = 0; i < ids.GetSize(); i++)
+    {
+        growth[i].path = GetPathName(ids[i]);
+    }
+    return true;
+}
+
+CString CScanHistory::GetPathName(LONGLONG id)
+{
+    CSqliteApi *api = Sqlite();
+
+    sqlite3_stmt *stmt = Prepare("SELECT parent, name FROM path WHERE id = ?");
+    if(stmt == NULL)
+    {
+        return CString();
+    }
+
+    CString path;
+    while(id != 0)
+    {
+        api->bind_int64.pfnFct(stmt, 1, id);
+        if(api->step.pfnFct(stmt) != SQLITE_ROW)
+        {
+            break;
+        }
+        const CString name = (LPCWSTR)api->column_text16.pfnFct(stmt, 1);
+        path = path.IsEmpty() ? name : name + wds::chrBackslash + path;
+        id = api->column_int64.pfnFct(stmt, 0);
+        api->reset.pfnFct(stmt);
+    }
+    Finalize(stmt);
+
+    // "C:" alone is the current directory on C:
+    if(path.GetLength() == 2 && path[1] == wds::chrColon)
+    {
+        path += wds::chrBackslash;
+    }
+    return path;
+}
+
+bool CScanHistory::Execute(const char *sql)
+{
+    return Sqlite()->exec.pfnFct(m_db, sql, NULL, NULL, NULL) == SQLITE_OK || Fail();
+}
+
+sqlite3_stmt *CScanHistory::Prepare(const char *sql)
+{
+    sqlite3_stmt *stmt = NULL;
+    if(Sqlite()->prepare_v2.pfnFct(m_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        Fail();
+        return NULL;
+    }
+    return stmt;
+}
+
+void CScanHistory::Finalize(sqlite3_stmt *&stmt)
+{
+    if(stmt != NULL)
+    {
+        Sqlite()->finalize.pfnFct(stmt);
+        stmt = NULL;
+    }
+}
+
+// Keeps the message of the last error. Always returns false.
+bool CScanHistory::Fail()
+{
+    m_error = m_db != NULL ? (LPCWSTR)Sqlite()->errmsg16.pfnFct(m_db) : L"";
+    return false;
+}
@@ -0,0 +1,128 @@
+// scanhistory.h - Declaration of CScanHistory
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_SCANHISTORY_H__
+#define __WDS_SCANHISTORY_H__
+#pragma once
+
+#include "dirstatdoc.h" // CExtensionData
+#include "item.h"       // DIRECTORYTOTALS
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+//
+// HISTORYGROWTH. A directory and how much it grew between two scans.
+//
+struct HISTORYGROWTH
+{
+    CString path;
+    ULONGLONG size;     // In the newer scan
+    LONGLONG growth;    // Bytes, negative if it shrank
+};
+
+//
+// HISTORYEXTENSION. A row of the extension table.
+//
+struct HISTORYEXTENSION
+{
+    CString ext;
+    ULONGLONG files;
+    ULONGLONG bytes;
+};
+
+//
+// HISTORYSNAPSHOT. What CScanHistory::Record() writes, taken from the tree
+// by CScanHistory::Snapshot().
+//
+struct HISTORYSNAPSHOT
+{
+    CString root;
+    ULONGLONG size;
+    ULONGLONG files;
+    ULONGLONG subdirs;
+    CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&> directories;  // Pre-order
+    CArray<HISTORYEXTENSION, const HISTORYEXTENSION&> extensions;
+};
+
+//
+// CScanHistory. Keeps the directory totals of completed scans in an SQLite
+// database, so that "what grew the most since last week" is an indexed
+// query instead of a second scan.
+//
+//   scan(id, root, time, size, files, subdirs)
+//   path(id, parent, name)     Each directory once. Parent 0: a root.
+//   directory(scan, path, size, files, subdirs, lastchange)
+//   extension(scan, ext, files, bytes)
+//
+// Times are seconds since 1970-01-01 (UTC). Record() writes a whole scan
+// in one transaction with prepared statements, which are only rebound for
+// each row. It only needs the snapshot, not the tree, so it can run in a
+// worker thread.
+//
+// 3rdparty/sqlite3 has only the headers, so sqlite3.dll is loaded at run
+// time. Without it, Open() fails and there is no history.
+//
+class CScanHistory
+{
+public:
+    CScanHistory();
+    ~CScanHistory();
+
+    bool Open(LPCTSTR file);
+    void Close();
+    CString GetLastError() const;
+
+    // Seconds since 1970-01-01 (UTC)
+    static LONGLONG GetUnixTime();
+
+    static void Snapshot(CItem *root, const CExtensionData *extensionData, HISTORYSNAPSHOT& snapshot);
+
+    // Returns the scan id, or 0 on failure.
+    LONGLONG Record(const HISTORYSNAPSHOT& snapshot);
+    ULONGLONG GetRecordedRows() const;
+    ULONGLONG GetRecordTime() const;    // Performance counter ticks
+
+    // The count directories of the scan, which grew most since the latest
+    // scan of the same root at or before the time since. baselineTime: the
+    // time of that scan, 0 if there is none.
+    bool GetGrowth(LONGLONG scan, LONGLONG since, int count, LONGLONG& baselineTime, CArray<HISTORYGROWTH, HISTORYGROWTH&>& growth);
+
+private:
+    bool Execute(const char *sql);
+    sqlite3_stmt *Prepare(const char *sql);
+    void Finalize(sqlite3_stmt *&stmt);
+    bool Fail();
+    static void SnapshotDirectory(CItem *item, int parent, HISTORYSNAPSHOT& snapshot);
+    bool RecordDirectories(const CArray<DIRECTORYTOTALS, const DIRECTORYTOTALS&>& directories, LONGLONG scan);
+    LONGLONG GetPathId(LONGLONG parent, const CString& name);
+    CString GetPathName(LONGLONG id);
+
+    sqlite3 *m_db;
+    CString m_error;
+    sqlite3_stmt *m_insertPath;
+    sqlite3_stmt *m_selectPath;
+    sqlite3_stmt *m_insertDirectory;
+    ULONGLONG m_recordedRows;
+    ULONGLONG m_recordTime;
+};
+
+#endif // __WDS_SCANHISTORY_H__
@@ -0,0 +1,467 @@
+// scanstats.cpp - Implementation of CScanStatistics
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "scanstats.h"
+#include "fileidentity.h"
+#include "spillfile.h"
+#include "scanfilter.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    CScanStatistics _theScanStatistics;
+
+    // Number of slowest directories kept
+    const int MAX_SLOW_DIRECTORIES = 10;
+
+    // Directories taking longer than this (ms) to enumerate count as stalls.
+    const double STALL_THRESHOLD = 1000.0;
+
+    // Items per second
+    ULONGLONG Rate(ULONGLONG count, ULONGLONG ticks)
+    {
+        const double ms = CScanStatistics::ToMilliseconds(ticks);
+        if(ms <= 0)
+        {
+            return 0;
+        }
+        return (ULONGLONG)(count * 1000.0 / ms);
+    }
+
+    // We write whole microseconds to JSON, so that the user's
+    // locale (decimal separator) can't produce invalid numbers.
+    ULONGLONG Microseconds(ULONGLONG ticks)
+    {
+        return (ULONGLONG)(CScanStatistics::ToMilliseconds(ticks) * 1000.0);
+    }
+
+    CString JsonString(LPCTSTR s)
+    {
+        CString json = _T("\"");
+        for(; *s != 0; s++)
+        {
+            switch(*s)
+            {
+            case _T('"'):
+                json += _T("\\\"");
+                break;
+            case _T('\\'):
+                json += _T("\\\\");
+                break;
+            case _T('\n'):
+                json += _T("\\n");
+                break;
+            case _T('\r'):
+                json += _T("\\r");
+                break;
+            case _T('\t'):
+                json += _T("\\t");
+                break;
+            default:
+                if((unsigned)*s < 0x20)
+                {
+                    CString escaped;
+                    escaped.Format(_T("\\u%04x"), (unsigned)*s);
+                    json += escaped;
+                }
+                else
+                {
+                    json += *s;
+                }
+            }
+        }
+        json += _T("\"");
+        return json;
+    }
+}
+
+CScanStatistics *GetScanStatistics()
+{
+    return &_theScanStatistics;
+}
+
+CScanStatistics::CScanStatistics()
+{
+    Reset();
+}
+
+void CScanStatistics::Reset()
+{
+    scheduleSteps = 0;
+    scheduleTime = 0;
+    entries = 0;
+    syscalls = 0;
+    directories = 0;
+    files = 0;
+    enumerationTime = 0;
+    insertionTime = 0;
+    identityTime = 0;
+    hardLinks = 0;
+    hardLinkBytes = 0;
+    filtered = 0;
+    filterTime = 0;
+    visualUpdates = 0;
+    visualUpdateTime = 0;
+    stalls = 0;
+    pendingReadJobs = 0;
+    maxPendingReadJobs = 0;
+    itemMemory = 0;
+    maxItemMemory = 0;
+    spilledSubtrees = 0;
+    rehydratedSubtrees = 0;
+
+    m_startTime = Now();
+    m_endTime = 0;
+    m_volumes.RemoveAll();
+    m_currentVolume = -1;
+    m_slowDirectories.RemoveAll();
+}
+
+void CScanStatistics::Finish()
+{
+    m_endTime = Now();
+    pendingReadJobs = 0;
+}
+
+bool CScanStatistics::IsFinished() const
+{
+    return m_endTime != 0;
+}
+
+ULONGLONG CScanStatistics::GetElapsedTime() const
+{
+    return (IsFinished() ? m_endTime : Now()) - m_startTime;
+}
+
+ULONGLONG CScanStatistics::Now()
+{
+    LARGE_INTEGER now;
+    ::QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+double CScanStatistics::ToMilliseconds(ULONGLONG ticks)
+{
+    static LARGE_INTEGER frequency;
+    if(frequency.QuadPart == 0)
+    {
+        ::QueryPerformanceFrequency(&frequency);
+    }
+    return (double)ticks * 1000.0 / (double)frequency.QuadPart;
+}
+
+void CScanStatistics::SetCurrentVolume(LPCTSTR name)
+{
+    if(m_currentVolume >= 0 && m_volumes[m_currentVolume].name.CompareNoCase(name) == 0)
+    {
+        return;
+    }
+
+    for(int i = 0; i < m_volumes.GetSize(); i++)
+    {
+        if(m_volumes[i].name.CompareNoCase(name) == 0)
+        {
+            m_currentVolume = i;
+            return;
+        }
+    }
+
+    SCANVOLUME volume;
+    volume.name = name;
+    volume.entries = 0;
+    volume.syscalls = 0;
+    volume.directories = 0;
+    volume.files = 0;
+    volume.enumerationTime = 0;
+    m_currentVolume = (int)m_volumes.Add(volume);
+}
+
+void CScanStatistics::RecordDirectory(const SCANDIRECTORY& dir)
+{
+    entries += dir.entries;
+    syscalls += dir.syscalls;
+    directories += dir.directories;
+    files += dir.files;
+    enumerationTime += dir.enumerationTime;
+    insertionTime += dir.insertionTime;
+    identityTime += dir.identityTime;
+    hardLinks += dir.hardLinks;
+    hardLinkBytes += dir.hardLinkBytes;
+    filtered += dir.filtered;
+    filterTime += dir.filterTime;
+
+    if(ToMilliseconds(dir.enumerationTime) > STALL_THRESHOLD)
+    {
+        stalls++;
+    }
+
+    if(m_currentVolume >= 0)
+    {
+        SCANVOLUME& volume = m_volumes[m_currentVolume];
+        volume.entries += dir.entries;
+        volume.syscalls += dir.syscalls;
+        volume.directories += dir.directories;
+        volume.files += dir.files;
+        volume.enumerationTime += dir.enumerationTime;
+    }
+}
+
+// Cheap check, so that the caller needs to build the path
+// only for directories, which make it into the list.
+bool CScanStatistics::IsSlowDirectory(ULONGLONG enumerationTime) const
+{
+    return m_slowDirectories.GetSize() < MAX_SLOW_DIRECTORIES
+        || enumerationTime > m_slowDirectories[m_slowDirectories.GetSize() - 1].enumerationTime;
+}
+
+void CScanStatistics::AddSlowDirectory(LPCTSTR path, const SCANDIRECTORY& dir)
+{
+    SLOWDIRECTORY slow;
+    slow.path = path;
+    slow.entries = dir.entries;
+    slow.enumerationTime = dir.enumerationTime;
+
+    int i = 0;
+    while(i < m_slowDirectories.GetSize() && m_slowDirectories[i].enumerationTime >= slow.enumerationTime)
+    {
+        i++;
+    }
+    m_slowDirectories.InsertAt(i, slow);
+
+    if(m_slowDirectories.GetSize() > MAX_SLOW_DIRECTORIES)
+    {
+        m_slowDirectories.SetSize(MAX_SLOW_DIRECTORIES);
+    }
+}
+
+void CScanStatistics::SamplePendingReadJobs(ULONGLONG readJobs)
+{
+    pendingReadJobs = readJobs;
+    if(readJobs > maxPendingReadJobs)
+    {
+        maxPendingReadJobs = readJobs;
+    }
+}
+
+void CScanStatistics::SampleItemMemory(ULONGLONG bytes)
+{
+    itemMemory = bytes;
+    if(bytes > maxItemMemory)
+    {
+        maxItemMemory = bytes;
+    }
+}
+
+int CScanStatistics::GetVolumeCount() const
+{
+    return (int)m_volumes.GetSize();
+}
+
+const SCANVOLUME& CScanStatistics::GetVolume(int i) const
+{
+    return m_volumes[i];
+}
+
+int CScanStatistics::GetSlowDirectoryCount() const
+{
+    return (int)m_slowDirectories.GetSize();
+}
+
+const SLOWDIRECTORY& CScanStatistics::GetSlowDirectory(int i) const
+{
+    return m_slowDirectories[i];
+}
+
+CString CScanStatistics::FormatReport() const
+{
+    const ULONGLONG elapsed = GetElapsedTime();
+
+    CString report;
+    CString line;
+
+    line.Format(_T("Elapsed time:       %.1f ms (%s)\r\n"), ToMilliseconds(elapsed), IsFinished() ? _T("finished") : _T("scanning"));
+    report += line;
+    line.Format(_T("Directories:        %I64u (%I64u/s)\r\n"), directories, Rate(directories, elapsed));
+    report += line;
+    line.Format(_T("Files:              %I64u (%I64u/s)\r\n"), files, Rate(files, elapsed));
+    report += line;
+    line.Format(_T("Entries:            %I64u (%I64u/s)\r\n"), entries, Rate(entries, elapsed));
+    report += line;
+    line.Format(_T("System calls:       %I64u (%I64u/s)\r\n"), syscalls, Rate(syscalls, elapsed));
+    report += line;
+    line.Format(_T("Pending read jobs:  %I64u (max. %I64u)\r\n"), pendingReadJobs, maxPendingReadJobs);
+    report += line;
+    line.Format(_T("Stalls (> %.0f ms): %I64u\r\n"), STALL_THRESHOLD, stalls);
+    report += line;
+    report += _T("\r\n");
+    line.Format(_T("Enumeration:        %.1f ms\r\n"), ToMilliseconds(enumerationTime));
+    report += line;
+    line.Format(_T("Tree insertion:     %.1f ms\r\n"), ToMilliseconds(insertionTime));
+    report += line;
+    line.Format(_T("UI updates:         %.1f ms (%I64u updates)\r\n"), ToMilliseconds(visualUpdateTime), visualUpdates);
+    report += line;
+    line.Format(_T("Scheduling:         %.1f ms (%I64u steps)\r\n"), ToMilliseconds(scheduleTime), scheduleSteps);
+    report += line;
+
+    const CFileIdentitySet *identities = GetFileIdentities();
+    if(identities->GetCount() > 0)
+    {
+        report += _T("\r\n");
+        line.Format(_T("Hard links:         %I64u further links, %I64u bytes not counted again\r\n"), hardLinks, hardLinkBytes);
+        report += line;
+        line.Format(_T("File identities:    %I64u (%I64u KB), %.1f ms to query\r\n"),
+            identities->GetCount(), identities->GetMemoryUsage() / 1024, ToMilliseconds(identityTime));
+        report += line;
+    }
+
+    const CScanFilter *filter = GetScanFilter();
+    if(filter->GetRuleCount() > 0)
+    {
+        const ULONGLONG evaluations = filter->GetEvaluations();
+        report += _T("\r\n");
+        line.Format(_T("Scan filter:        %I64u entries excluded, %I64u evaluated in %.1f ms (%.0f ns/entry)\r\n"),
+            filtered, evaluations, ToMilliseconds(filterTime), evaluations > 0 ? ToMilliseconds(filterTime) * 1000000.0 / evaluations : 0.0);
+        report += line;
+        for(int i = 0; i < filter->GetRuleCount(); i++)
+        {
+            const SCANFILTERRULE& rule = filter->GetRule(i);
+            line.Format(_T("  %10I64u matches %16I64u bytes  %s\r\n"), rule.matches, rule.bytes, rule.text.GetString());
+            report += line;
+            if(!rule.error.IsEmpty())
+            {
+                line.Format(_T("  Rule disabled: %s\r\n"), rule.error.GetString());
+                report += line;
+            }
+        }
+    }
+
+    if(maxItemMemory > 0)
+    {
+        report += _T("\r\n");
+        line.Format(_T("Item memory:        %I64u KB (max. %I64u KB)\r\n"), itemMemory / 1024, maxItemMemory / 1024);
+        report += line;
+    }
+    if(spilledSubtrees > 0)
+    {
+        line.Format(_T("Spilled subtrees:   %I64u (%I64u read back), spill file %I64u KB\r\n"),
+            spilledSubtrees, rehydratedSubtrees, GetSpillFile()->GetFileSize() / 1024);
+        report += line;
+    }
+
+    if(m_volumes.GetSize() > 0)
+    {
+        report += _T("\r\nVolumes:\r\n");
+        for(int i = 0; i < m_volumes.GetSize(); i++)
+        {
+            const SCANVOLUME& volume = m_volumes[i];
+            line.Format(_T("  %s: %I64u directories, %I64u files, %I64u system calls, %.1f ms (%I64u entries/s)\r\n"),
+                volume.name.GetString(), volume.directories, volume.files, volume.syscalls,
+                ToMilliseconds(volume.enumerationTime), Rate(volume.entries, volume.enumerationTime));
+            report += line;
+        }
+    }
+
+    if(m_slowDirectories.GetSize() > 0)
+    {
+        report += _T("\r\nSlowest directories:\r\n");
+        for(int i = 0; i < m_slowDirectories.GetSize(); i++)
+        {
+            const SLOWDIRECTORY& slow = m_slowDirectories[i];
+            line.Format(_T("  %10.1f ms %8I64u entries  %s\r\n"), ToMilliseconds(slow.enumerationTime), slow.entries, slow.path.GetString());
+            report += line;
+        }
+    }
+
+    return report;
+}
+
+CString CScanStatistics::ToJson() const
+{
+    const ULONGLONG elapsed = GetElapsedTime();
+
+    CString json;
+    CString s;
+
+    json += _T("{\n");
+    s.Format(_T("  \"finished\": %s,\n"), IsFinished() ? _T("true") : _T("false"));
+    json += s;
+    s.Format(_T("  \"elapsedUs\": %I64u,\n"), Microseconds(elapsed));
+    json += s;
+    s.Format(_T("  \"directories\": %I64u,\n  \"directoriesPerSecond\": %I64u,\n"), directories, Rate(directories, elapsed));
+    json += s;
+    s.Format(_T("  \"files\": %I64u,\n  \"filesPerSecond\": %I64u,\n"), files, Rate(files, elapsed));
+    json += s;
+    s.Format(_T("  \"entries\": %I64u,\n  \"entriesPerSecond\": %I64u,\n"), entries, Rate(entries, elapsed));
+    json += s;
+    s.Format(_T("  \"syscalls\": %I64u,\n"), syscalls);
+    json += s;
+    s.Format(_T("  \"pendingReadJobs\": %I64u,\n  \"maxPendingReadJobs\": %I64u,\n"), pendingReadJobs, maxPendingReadJobs);
+    json += s;
+    s.Format(_T("  \"stalls\": %I64u,\n  \"stallThresholdUs\": %I64u,\n"), stalls, (ULONGLONG)(STALL_THRESHOLD * 1000));
+    json += s;
+    s.Format(_T("  \"enumerationUs\": %I64u,\n  \"insertionUs\": %I64u,\n"), Microseconds(enumerationTime), Microseconds(insertionTime));
+    json += s;
+    s.Format(_T("  \"visualUpdates\": %I64u,\n  \"visualUpdateUs\": %I64u,\n"), visualUpdates, Microseconds(visualUpdateTime));
+    json += s;
+    s.Format(_T("  \"scheduleSteps\": %I64u,\n  \"scheduleUs\": %I64u,\n"), scheduleSteps, Microseconds(scheduleTime));
+    json += s;
+    s.Format(_T("  \"hardLinks\": %I64u,\n  \"hardLinkBytes\": %I64u,\n"), hardLinks, hardLinkBytes);
+    json += s;
+    s.Format(_T("  \"itemMemory\": %I64u,\n  \"maxItemMemory\": %I64u,\n"), itemMemory, maxItemMemory);
+    json += s;
+    s.Format(_T("  \"spilledSubtrees\": %I64u,\n  \"rehydratedSubtrees\": %I64u,\n  \"spillFileBytes\": %I64u,\n"),
+        spilledSubtrees, rehydratedSubtrees, GetSpillFile()->GetFileSize());
+    json += s;
+    s.Format(_T("  \"fileIdentities\": %I64u,\n  \"fileIdentityBytes\": %I64u,\n  \"identityUs\": %I64u,\n"),
+        GetFileIdentities()->GetCount(), GetFileIdentities()->GetMemoryUsage(), Microseconds(identityTime));
+    json += s;
+    s.Format(_T("  \"filteredEntries\": %I64u,\n  \"filterEvaluations\": %I64u,\n  \"filterUs\": %I64u,\n"),
+        filtered, GetScanFilter()->GetEvaluations(), Microseconds(filterTime));
+    json += s;
+
+    json += _T("  \"volumes\": [");
+    for(int i = 0; i < m_volumes.GetSize(); i++)
+    {
+        const SCANVOLUME& volume = m_volumes[i];
+        s.Format(_T("%s\n    { \"name\": %s, \"entries\": %I64u, \"directories\": %I64u, \"files\": %I64u, \"syscalls\": %I64u, \"enumerationUs\": %I64u, \"entriesPerSecond\": %I64u }"),
+            i > 0 ? _T(",") : _T(""), JsonString(volume.name).GetString(), volume.entries, volume.directories, volume.files,
+            volume.syscalls, Microseconds(volume.enumerationTime), Rate(volume.entries, volume.enumerationTime));
+        json += s;
+    }
+    json += m_volumes.GetSize() > 0 ? _T("\n  ],\n") : _T("],\n");
+
+    json += _T("  \"slowestDirectories\": [");
+    for(int i = 0; i < m_slowDirectories.GetSize(); i++)
+    {
+        const SLOWDIRECTORY& slow = m_slowDirectories[i];
+        s.Format(_T("%s\n    { \"path\": %s, \"entries\": %I64u, \"enumerationUs\": %I64u }"),
+            i > 0 ? _T(",") : _T(""), JsonString(slow.path).GetString(), slow.entries, Microseconds(slow.enumerationTime));
+        json += s;
+    }
+    json += m_slowDirectories.GetSize() > 0 ? _T("\n  ]\n") : _T("]\n");
+
+    json += _T("}\n");
+    return json;
+}
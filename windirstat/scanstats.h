@@ -0,0 +1,134 @@
+// scanstats.h - Declaration of CScanStatistics
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_SCANSTATS_H__
+#define __WDS_SCANSTATS_H__
+#pragma once
+
+//
+// SCANDIRECTORY. What the scanner found in one directory (one read job).
+//
+struct SCANDIRECTORY
+{
+    ULONGLONG entries;          // Directory entries found (without "." and "..")
+    ULONGLONG syscalls;         // File system calls made to find and classify them
+    ULONGLONG directories;
+    ULONGLONG files;
+    ULONGLONG enumerationTime;  // Time spent in FindFile()/FindNextFile()
+    ULONGLONG insertionTime;    // Time spent creating and linking the child items
+    ULONGLONG identityTime;     // Time spent identifying files (hard links)
+    ULONGLONG hardLinks;        // Further links to files counted before
+    ULONGLONG hardLinkBytes;    // Their size, which was not counted again
+    ULONGLONG filtered;         // Entries excluded by the scan filter
+    ULONGLONG filterTime;       // Time spent in the scan filter
+};
+
+//
+// SCANVOLUME. Totals per volume (drive or UNC share).
+//
+struct SCANVOLUME
+{
+    CString name;
+    ULONGLONG entries;
+    ULONGLONG syscalls;
+    ULONGLONG directories;
+    ULONGLONG files;
+    ULONGLONG enumerationTime;
+};
+
+//
+// SLOWDIRECTORY. One of the directories, which took longest to enumerate.
+//
+struct SLOWDIRECTORY
+{
+    CString path;
+    ULONGLONG entries;
+    ULONGLONG enumerationTime;
+};
+
+//
+// CScanStatistics. Counters, which the scanner (CItem::DoSomeWork())
+// updates cheaply while it works. They are reset when a new scan starts.
+// Times are in performance counter ticks (see Now() and ToMilliseconds()).
+// The Scan Statistics dialog shows them, and they can be saved as JSON.
+//
+class CScanStatistics
+{
+public:
+    CScanStatistics();
+    void Reset();
+    void Finish();
+    bool IsFinished() const;
+    ULONGLONG GetElapsedTime() const;
+
+    static ULONGLONG Now();
+    static double ToMilliseconds(ULONGLONG ticks);
+
+    // The volume, to which following RecordDirectory() calls are attributed
+    void SetCurrentVolume(LPCTSTR name);
+    void RecordDirectory(const SCANDIRECTORY& dir);
+    bool IsSlowDirectory(ULONGLONG enumerationTime) const;
+    void AddSlowDirectory(LPCTSTR path, const SCANDIRECTORY& dir);
+    void SamplePendingReadJobs(ULONGLONG readJobs);
+    void SampleItemMemory(ULONGLONG bytes);
+
+    int GetVolumeCount() const;
+    const SCANVOLUME& GetVolume(int i) const;
+    int GetSlowDirectoryCount() const;
+    const SLOWDIRECTORY& GetSlowDirectory(int i) const;
+
+    CString FormatReport() const;
+    CString ToJson() const;
+
+    ULONGLONG scheduleSteps;    // Children picked to work on next
+    ULONGLONG scheduleTime;     // Time spent picking them
+    ULONGLONG entries;          // Directory entries found (without "." and "..")
+    ULONGLONG syscalls;         // File system calls made to find and classify them
+    ULONGLONG directories;      // Directories found
+    ULONGLONG files;            // Files found
+    ULONGLONG enumerationTime;  // Time spent enumerating directories
+    ULONGLONG insertionTime;    // Time spent inserting the found items into the tree
+    ULONGLONG identityTime;     // Time spent identifying files (part of enumerationTime)
+    ULONGLONG hardLinks;        // Further links to files counted before
+    ULONGLONG hardLinkBytes;    // Their size, which was not counted again
+    ULONGLONG filtered;         // Entries excluded by the scan filter
+    ULONGLONG filterTime;       // Time spent in the scan filter (part of enumerationTime)
+    ULONGLONG visualUpdates;    // UI updates (paint, pacmen) during the scan
+    ULONGLONG visualUpdateTime; // Time spent on them
+    ULONGLONG stalls;           // Directories, which took longer than STALL_THRESHOLD ms
+    ULONGLONG pendingReadJobs;  // Read jobs (directories) still to be enumerated
+    ULONGLONG maxPendingReadJobs;
+    ULONGLONG itemMemory;       // See CItem::GetMemoryUsage()
+    ULONGLONG maxItemMemory;
+    ULONGLONG spilledSubtrees;  // Written to the spill file (see CItem::Spill())
+    ULONGLONG rehydratedSubtrees; // Read back from it
+
+private:
+    ULONGLONG m_startTime;
+    ULONGLONG m_endTime;        // 0 while scanning
+    CArray<SCANVOLUME, SCANVOLUME&> m_volumes;
+    int m_currentVolume;        // -1 if none
+    CArray<SLOWDIRECTORY, SLOWDIRECTORY&> m_slowDirectories; // slowest first
+};
+
+CScanStatistics *GetScanStatistics();
+
+#endif // __WDS_SCANSTATS_H__
@@ -0,0 +1,249 @@
+// spillfile.cpp - Implementation of CSpillFile
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include <common/tracer.h>
+#include "spillfile.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    CSpillFile _theSpillFile;
+}
+
+CSpillFile *GetSpillFile()
+{
+    return &_theSpillFile;
+}
+
+CSpillFile::CSpillFile()
+    : m_file(INVALID_HANDLE_VALUE)
+    , m_fileSize(0)
+{
+    // Every directory item looks itself up, when it is deleted.
+    m_records.InitHashTable(4099);
+}
+
+CSpillFile::~CSpillFile()
+{
+    Reset();
+}
+
+// Creates the file in the temp directory. It is deleted, when we close
+// it (or when we crash).
+bool CSpillFile::Open()
+{
+    TCHAR folder[_MAX_PATH];
+    TCHAR path[_MAX_PATH];
+    if(::GetTempPath(_countof(folder), folder) == 0 || ::GetTempFileName(folder, _T("wds"), 0, path) == 0)
+    {
+        VTRACE(_T("Cannot create a spill file name: GetLastError returns %u"), ::GetLastError());
+        return false;
+    }
+
+    m_file = ::CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if(m_file == INVALID_HANDLE_VALUE)
+    {
+        VTRACE(_T("CreateFile(%s) failed: GetLastError returns %u"), path, ::GetLastError());
+        ::DeleteFile(path);
+        return false;
+    }
+    m_fileSize = 0;
+    return true;
+}
+
+// FNV-1a
+ULONGLONG CSpillFile::Checksum(const CArray<BYTE, BYTE>& data)
+{
+    ULONGLONG checksum = 14695981039346656037ui64;
+    const BYTE *p = data.GetData();
+    for(INT_PTR i = 0; i < data.GetSize(); i++)
+    {
+        checksum ^= p[i];
+        checksum *= 1099511628211ui64;
+    }
+    return checksum;
+}
+
+bool CSpillFile::Store(const void *key, const CArray<BYTE, BYTE>& data)
+{
+    ASSERT(data.GetSize() > 0);
+
+    const DWORD length = (DWORD)data.GetSize();
+    const ULONGLONG checksum = Checksum(data);
+
+    RECORD record;
+    if(m_records.Lookup(key, record))
+    {
+        // Read back and not changed since
+        if(record.length == length && record.checksum == checksum)
+        {
+            return true;
+        }
+        Discard(key);
+    }
+
+    if(m_file == INVALID_HANDLE_VALUE && !Open())
+    {
+        return false;
+    }
+
+    record.offset = Allocate(length);
+    record.length = length;
+    record.checksum = checksum;
+
+    LARGE_INTEGER offset;
+    offset.QuadPart = record.offset;
+    DWORD written = 0;
+    if(!::SetFilePointerEx(m_file, offset, NULL, FILE_BEGIN)
+        || !::WriteFile(m_file, data.GetData(), length, &written, NULL)
+        || written != length)
+    {
+        VTRACE(_T("Writing the spill file failed: GetLastError returns %u"), ::GetLastError());
+        Free(record.offset, length);
+        return false;
+    }
+
+    m_records.SetAt(key, record);
+    return true;
+}
+
+// First fit. Otherwise the record goes to the end.
+ULONGLONG CSpillFile::Allocate(DWORD length)
+{
+    for(int i = 0; i < m_holes.GetSize(); i++)
+    {
+        HOLE& hole = m_holes[i];
+        if(hole.length >= length)
+        {
+            const ULONGLONG offset = hole.offset;
+            hole.offset += length;
+            hole.length -= length;
+            if(hole.length == 0)
+            {
+                m_holes.RemoveAt(i);
+            }
+            return offset;
+        }
+    }
+
+    const ULONGLONG offset = m_fileSize;
+    m_fileSize += length;
+    return offset;
+}
+
+void CSpillFile::Free(ULONGLONG offset, ULONGLONG length)
+{
+    int i = 0;
+    while(i < m_holes.GetSize() && m_holes[i].offset < offset)
+    {
+        i++;
+    }
+
+    HOLE hole;
+    hole.offset = offset;
+    hole.length = length;
+
+    // Merge with the holes before and after
+    if(i > 0 && m_holes[i - 1].offset + m_holes[i - 1].length == hole.offset)
+    {
+        i--;
+        hole.offset = m_holes[i].offset;
+        hole.length += m_holes[i].length;
+        m_holes.RemoveAt(i);
+    }
+    if(i < m_holes.GetSize() && hole.offset + hole.length == m_holes[i].offset)
+    {
+        hole.length += m_holes[i].length;
+        m_holes.RemoveAt(i);
+    }
+
+    if(hole.offset + hole.length == m_fileSize)
+    {
+        // The file keeps its size, but the next record goes here.
+        m_fileSize = hole.offset;
+    }
+    else
+    {
+        m_holes.InsertAt(i, hole);
+    }
+}
+
+bool CSpillFile::Load(const void *key, CArray<BYTE, BYTE>& data)
+{
+    RECORD record;
+    if(!m_records.Lookup(key, record))
+    {
+        ASSERT(0);
+        return false;
+    }
+
+    data.SetSize(record.length);
+
+    LARGE_INTEGER offset;
+    offset.QuadPart = record.offset;
+    DWORD read = 0;
+    if(!::SetFilePointerEx(m_file, offset, NULL, FILE_BEGIN)
+        || !::ReadFile(m_file, data.GetData(), record.length, &read, NULL)
+        || read != record.length)
+    {
+        VTRACE(_T("Reading the spill file failed: GetLastError returns %u"), ::GetLastError());
+        data.RemoveAll();
+        return false;
+    }
+    return true;
+}
+
+void CSpillFile::Discard(const void *key)
+{
+    RECORD record;
+    if(m_records.Lookup(key, record))
+    {
+        Free(record.offset, record.length);
+        m_records.RemoveKey(key);
+    }
+}
+
+void CSpillFile::Reset()
+{
+    m_records.RemoveAll();
+    m_holes.RemoveAll();
+    if(m_file != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(m_file); // --> deletes the file
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_fileSize = 0;
+}
+
+ULONGLONG CSpillFile::GetFileSize() const
+{
+    return m_fileSize;
+}
+
+ULONGLONG CSpillFile::GetRecordCount() const
+{
+    return m_records.GetCount();
+}
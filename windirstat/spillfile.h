@@ -0,0 +1,80 @@
+// spillfile.h - Declaration of CSpillFile
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_SPILLFILE_H__
+#define __WDS_SPILLFILE_H__
+#pragma once
+
+//
+// CSpillFile. A temporary file, to which CItem writes ("spills") the
+// children of cold subtrees, when the tree exceeds the memory budget
+// (COptions::GetSpillBudget()). Records are keyed by the spilled item.
+//
+// A record stays, when it is read back, so that spilling the same,
+// unchanged subtree again costs no write (walks over the whole tree read
+// back and spill again every subtree). A discarded or outgrown record
+// leaves a hole, which later records reuse.
+//
+class CSpillFile
+{
+public:
+    CSpillFile();
+    ~CSpillFile();
+
+    // Return false on I/O errors. Then the caller keeps the data in memory.
+    // Store() only writes, if the data differ from the key's record.
+    bool Store(const void *key, const CArray<BYTE, BYTE>& data);
+    bool Load(const void *key, CArray<BYTE, BYTE>& data);
+    void Discard(const void *key);
+    void Reset();
+
+    ULONGLONG GetFileSize() const;
+    ULONGLONG GetRecordCount() const;
+
+private:
+    struct RECORD
+    {
+        ULONGLONG offset;
+        DWORD length;
+        ULONGLONG checksum;
+    };
+
+    struct HOLE
+    {
+        ULONGLONG offset;
+        ULONGLONG length;
+    };
+
+    static ULONGLONG Checksum(const CArray<BYTE, BYTE>& data);
+
+    bool Open();
+    ULONGLONG Allocate(DWORD length);
+    void Free(ULONGLONG offset, ULONGLONG length);
+
+    HANDLE m_file;          // INVALID_HANDLE_VALUE until the first Store()
+    ULONGLONG m_fileSize;   // Up to the end of the last record
+    CMap<const void *, const void *, RECORD, const RECORD&> m_records;
+    CArray<HOLE, const HOLE&> m_holes;   // Sorted by offset, not adjacent
+};
+
+CSpillFile *GetSpillFile();
+
+#endif // __WDS_SPILLFILE_H__
@@ -0,0 +1,389 @@
+// treeexporter.cpp - Implementation of CTreeExporter
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "scanstats.h"
+#include "treeexporter.h"
+#include <winioctl.h>   // FSCTL_SET_COMPRESSION
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    // Output is written in chunks of this size.
+    const int BUFFER_SIZE = 4 * 1024 * 1024;
+
+    // Room for the longest line without the path
+    const int MAX_LINE_WITHOUT_PATH = 256;
+}
+
+CTreeExporter::CTreeExporter(FORMAT format)
+    : m_format(format)
+    , m_buffer(NULL)
+    , m_used(0)
+    , m_itemCount(0)
+    , m_byteCount(0)
+    , m_time(0)
+{
+}
+
+CTreeExporter::~CTreeExporter()
+{
+    delete[] m_buffer;
+}
+
+CTreeExporter::FORMAT CTreeExporter::FormatFromFileName(LPCTSTR fileName)
+{
+    CString name = fileName;
+    return name.Right(6).CompareNoCase(_T(".jsonl")) == 0 ? FORMAT_JSONL : FORMAT_CSV;
+}
+
+void CTreeExporter::Export(CItem *root, LPCTSTR fileName, bool compress)
+{
+    const ULONGLONG start = CScanStatistics::Now();
+
+    if(m_buffer == NULL)
+    {
+        m_buffer = new char[BUFFER_SIZE];
+    }
+    m_used = 0;
+    m_path.SetSize(0, 4096);
+    m_itemCount = 0;
+    m_byteCount = 0;
+
+    CFileException *pe = new CFileException;
+    if(!m_file.Open(fileName, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite, pe))
+    {
+        throw pe;
+    }
+    pe->Delete();
+
+    if(compress)
+    {
+        // Fails on file systems without compression. We export anyway.
+        USHORT format = COMPRESSION_FORMAT_DEFAULT;
+        DWORD returned;
+        if(!::DeviceIoControl(m_file.m_hFile, FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &returned, NULL))
+        {
+            VTRACE(_T("FSCTL_SET_COMPRESSION failed: %u"), ::GetLastError());
+        }
+    }
+
+    if(m_format == FORMAT_CSV)
+    {
+        Append("path,type,size,files,subdirs,lastchange,attributes\r\n");
+    }
+
+    // We start with the root's own path, not with its name.
+    if(root->GetType() != IT_MYCOMPUTER)
+    {
+        CString path = root->GetPath();
+        if(path.Right(1) == wds::chrBackslash)
+        {
+            path = path.Left(path.GetLength() - 1);
+        }
+        PushName(path, false);
+    }
+    RecurseExport(root);
+
+    Flush();
+    m_file.Close();
+
+    m_time = CScanStatistics::Now() - start;
+}
+
+ULONGLONG CTreeExporter::GetItemCount() const
+{
+    return m_itemCount;
+}
+
+ULONGLONG CTreeExporter::GetByteCount() const
+{
+    return m_byteCount;
+}
+
+ULONGLONG CTreeExporter::GetTime() const
+{
+    return m_time;
+}
+
+// m_path holds our own path on entry. Our children push and pop their names.
+void CTreeExporter::RecurseExport(CItem *item)
+{
+    switch(item->GetType())
+    {
+    case IT_MYCOMPUTER:
+    case IT_FILESFOLDER:
+        // No lines, no path components
+        break;
+
+    case IT_DRIVE:
+        WriteItem(item, "drive", true);
+        break;
+
+    case IT_DIRECTORY:
+        WriteItem(item, "dir", false);
+        break;
+
+    case IT_FILE:
+        WriteItem(item, "file", false);
+        return;
+
+    default:
+        // <Free Space>, <Unknown>
+        return;
+    }
+
+    // Don't load all spilled subtrees at once
+    const bool spilled = item->IsSpilled();
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        CItem *child = item->GetChild(i);
+
+        const INT_PTR length = m_path.GetSize();
+        switch(child->GetType())
+        {
+        case IT_DRIVE:
+            {
+                CString path = child->GetPath();
+                PushName(path.Left(path.GetLength() - 1), false);
+            }
+            break;
+
+        case IT_DIRECTORY:
+        case IT_FILE:
+            PushName(child->GetName(), true);
+            break;
+
+        default:
+            break;
+        }
+
+        RecurseExport(child);
+
+        m_path.SetSize(length);
+    }
+
+    if(spilled)
+    {
+        item->Spill();
+    }
+}
+
+void CTreeExporter::WriteItem(const CItem *item, LPCSTR type, bool trailingBackslash)
+{
+    if(m_used + m_path.GetSize() + MAX_LINE_WITHOUT_PATH > BUFFER_SIZE)
+    {
+        Flush();
+    }
+
+    if(m_format == FORMAT_CSV)
+    {
+        Append("\"");
+        Append(m_path.GetData(), (int)m_path.GetSize());
+        Append(trailingBackslash ? "\\\"," : "\",");
+        Append(type);
+        Append(",");
+        AppendNumber(item->GetSize());
+        Append(",");
+        AppendNumber(item->GetFilesCount());
+        Append(",");
+        AppendNumber(item->GetSubdirsCount());
+        Append(",");
+        AppendTime(item->GetLastChange());
+        Append(",");
+        AppendNumber(item->GetAttributes());
+        Append("\r\n");
+    }
+    else
+    {
+        Append("{\"path\":\"");
+        Append(m_path.GetData(), (int)m_path.GetSize());
+        Append(trailingBackslash ? "\\\\\",\"type\":\"" : "\",\"type\":\"");
+        Append(type);
+        Append("\",\"size\":");
+        AppendNumber(item->GetSize());
+        Append(",\"files\":");
+        AppendNumber(item->GetFilesCount());
+        Append(",\"subdirs\":");
+        AppendNumber(item->GetSubdirsCount());
+        Append(",\"lastChange\":\"");
+        AppendTime(item->GetLastChange());
+        Append("\",\"attributes\":");
+        AppendNumber(item->GetAttributes());
+        Append("}\n");
+    }
+
+    m_itemCount++;
+}
+
+// Appends a backslash (if separator) and name to m_path,
+// encoded as UTF-8 and escaped for the output format.
+void CTreeExporter::PushName(LPCTSTR name, bool separator)
+{
+    if(separator)
+    {
+        if(m_format == FORMAT_JSONL)
+        {
+            m_path.Add('\\');
+        }
+        m_path.Add('\\');
+    }
+
+    for(LPCTSTR p = name; *p != 0; p++)
+    {
+        UINT c = (UINT)(WORD)*p;
+
+        // Surrogate pair
+        if(c >= 0xD800 && c <= 0xDBFF && p[1] >= 0xDC00 && p[1] <= 0xDFFF)
+        {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((UINT)(WORD)p[1] - 0xDC00);
+            p++;
+        }
+
+        if(c < 0x80)
+        {
+            if(m_format == FORMAT_CSV && c == '"')
+            {
+                m_path.Add('"');
+            }
+            else if(m_format == FORMAT_JSONL && (c == '"' || c == '\\'))
+            {
+                m_path.Add('\\');
+            }
+            else if(m_format == FORMAT_JSONL && c < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                m_path.Add('\\');
+                m_path.Add('u');
+                m_path.Add('0');
+                m_path.Add('0');
+                m_path.Add(hex[c >> 4]);
+                c = hex[c & 0xF];
+            }
+            m_path.Add((char)c);
+        }
+        else if(c < 0x800)
+        {
+            m_path.Add((char)(0xC0 | (c >> 6)));
+            m_path.Add((char)(0x80 | (c & 0x3F)));
+        }
+        else if(c < 0x10000)
+        {
+            m_path.Add((char)(0xE0 | (c >> 12)));
+            m_path.Add((char)(0x80 | ((c >> 6) & 0x3F)));
+            m_path.Add((char)(0x80 | (c & 0x3F)));
+        }
+        else
+        {
+            m_path.Add((char)(0xF0 | (c >> 18)));
+            m_path.Add((char)(0x80 | ((c >> 12) & 0x3F)));
+            m_path.Add((char)(0x80 | ((c >> 6) & 0x3F)));
+            m_path.Add((char)(0x80 | (c & 0x3F)));
+        }
+    }
+}
+
+void CTreeExporter::Append(LPCSTR s, int length)
+{
+    // Only a path longer than the whole buffer can get here.
+    if(m_used + length > BUFFER_SIZE)
+    {
+        Flush();
+        m_file.Write(s, length);
+        m_byteCount += length;
+        return;
+    }
+    memcpy(m_buffer + m_used, s, length);
+    m_used += length;
+}
+
+void CTreeExporter::Append(LPCSTR s)
+{
+    while(*s != 0)
+    {
+        m_buffer[m_used++] = *s++;
+    }
+}
+
+void CTreeExporter::AppendNumber(ULONGLONG n)
+{
+    char digits[20];
+    int i = 0;
+    do
+    {
+        digits[i++] = (char)('0' + n % 10);
+        n /= 10;
+    } while(n > 0);
+
+    while(i > 0)
+    {
+        m_buffer[m_used++] = digits[--i];
+    }
+}
+
+void CTreeExporter::AppendDigits(UINT n, int width)
+{
+    for(int i = width - 1; i >= 0; i--)
+    {
+        m_buffer[m_used + i] = (char)('0' + n % 10);
+        n /= 10;
+    }
+    m_used += width;
+}
+
+// ISO 8601, e.g. 2017-11-22T19:04:00Z. Empty, if there is no valid time.
+void CTreeExporter::AppendTime(const FILETIME& t)
+{
+    SYSTEMTIME st;
+    if((t.dwLowDateTime == 0 && t.dwHighDateTime == 0) || !::FileTimeToSystemTime(&t, &st))
+    {
+        return;
+    }
+
+    AppendDigits(st.wYear, 4);
+    Append("-");
+    AppendDigits(st.wMonth, 2);
+    Append("-");
+    AppendDigits(st.wDay, 2);
+    Append("T");
+    AppendDigits(st.wHour, 2);
+    Append(":");
+    AppendDigits(st.wMinute, 2);
+    Append(":");
+    AppendDigits(st.wSecond, 2);
+    Append("Z");
+}
+
+void CTreeExporter::Flush()
+{
+    if(m_used > 0)
+    {
+        m_file.Write(m_buffer, m_used);
+        m_byteCount += m_used;
+        m_used = 0;
+    }
+}
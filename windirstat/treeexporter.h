@@ -0,0 +1,79 @@
+// treeexporter.h - Declaration of CTreeExporter
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_TREEEXPORTER_H__
+#define __WDS_TREEEXPORTER_H__
+#pragma once
+
+class CItem;
+
+//
+// CTreeExporter. Writes the whole tree (depth-first, one line per file,
+// folder and drive) as CSV or JSON Lines, for inventories of big volumes.
+// Columns: path, type, size, files, subdirs, last change (UTC), attributes.
+//
+// Lines are formatted as UTF-8 straight into a large buffer. The path is
+// kept on a stack of already encoded and escaped bytes, so that no path
+// strings are built per item (CItem::GetPath() is expensive).
+//
+class CTreeExporter
+{
+public:
+    enum FORMAT
+    {
+        FORMAT_CSV,
+        FORMAT_JSONL
+    };
+
+    CTreeExporter(FORMAT format);
+    ~CTreeExporter();
+
+    static FORMAT FormatFromFileName(LPCTSTR fileName);
+
+    // Throws CFileException. compress: let NTFS compress the file while we write it.
+    void Export(CItem *root, LPCTSTR fileName, bool compress);
+
+    ULONGLONG GetItemCount() const;
+    ULONGLONG GetByteCount() const;
+    ULONGLONG GetTime() const;  // performance counter ticks, see CScanStatistics
+
+protected:
+    void RecurseExport(CItem *item);
+    void WriteItem(const CItem *item, LPCSTR type, bool trailingBackslash);
+    void PushName(LPCTSTR name, bool separator);
+    void Append(LPCSTR s, int length);
+    void Append(LPCSTR s);
+    void AppendNumber(ULONGLONG n);
+    void AppendDigits(UINT n, int width);
+    void AppendTime(const FILETIME& t);
+    void Flush();
+
+    FORMAT m_format;
+    CFile m_file;
+    char *m_buffer;
+    int m_used;                         // Bytes in m_buffer
+    CArray<char, char> m_path;          // Escaped UTF-8 path of the current item
+    ULONGLONG m_itemCount;
+    ULONGLONG m_byteCount;
+    ULONGLONG m_time;
+};
+
+#endif // __WDS_TREEEXPORTER_H__
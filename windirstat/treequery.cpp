@@ -0,0 +1,464 @@
+// treequery.cpp - Implementation of CTreeQuery
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "scanstats.h"
+#include "WDS_Lua_C.h"
+#include "treequery.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    // Runs before the script. Must match TREEQUERYNODE.
+    const char PRELUDE[] =
+        "local ffi = require('ffi')\n"
+        "ffi.cdef[[\n"
+        "typedef struct wds_node\n"
+        "{\n"
+        "    uint64_t size;\n"
+        "    uint64_t files;\n"
+        "    uint64_t subdirs;\n"
+        "    double mtime;\n"
+        "    uint32_t attributes;\n"
+        "    int32_t type;\n"
+        "    int32_t parent;\n"
+        "    int32_t extension;\n"
+        "} wds_node;\n"
+        "]]\n"
+        "wds.node = ffi.cast('const wds_node *', wds.nodes)\n";
+
+    struct TYPENAME
+    {
+        const char *name;
+        int type;
+    };
+
+    const TYPENAME TYPENAMES[] =
+    {
+        { "IT_MYCOMPUTER",  IT_MYCOMPUTER },
+        { "IT_DRIVE",       IT_DRIVE },
+        { "IT_DIRECTORY",   IT_DIRECTORY },
+        { "IT_FILE",        IT_FILE },
+        { "IT_FILESFOLDER", IT_FILESFOLDER },
+        { "IT_FREESPACE",   IT_FREESPACE },
+        { "IT_UNKNOWN",     IT_UNKNOWN }
+    };
+
+    // FILETIME ticks between 1601-01-01 and 1970-01-01
+    const ULONGLONG UNIX_EPOCH = 116444736000000000ULL;
+
+    double ToUnixTime(const FILETIME& t)
+    {
+        ULARGE_INTEGER u;
+        u.LowPart = t.dwLowDateTime;
+        u.HighPart = t.dwHighDateTime;
+
+        return ((double)u.QuadPart - (double)UNIX_EPOCH) / 10000000.0;
+    }
+
+    CString WithoutTrailingBackslash(const CString& path)
+    {
+        if(path.Right(1) == wds::chrBackslash)
+        {
+            return path.Left(path.GetLength() - 1);
+        }
+        return path;
+    }
+}
+
+CTreeQuery::CTreeQuery()
+    : m_snapshotTime(0)
+    , m_runTime(0)
+{
+}
+
+void CTreeQuery::Snapshot(CItem *root)
+{
+    const ULONGLONG start = CScanStatistics::Now();
+
+    m_nodes.RemoveAll();
+    m_names.RemoveAll();
+    m_extensions.RemoveAll();
+    m_extensionIndex.RemoveAll();
+
+    const ULONGLONG count = root->GetItemsCount() + 1;
+    m_nodes.SetSize(0, (INT_PTR)min(count, (ULONGLONG)INT_MAX));
+    m_names.SetSize(0, (INT_PTR)min(count, (ULONGLONG)INT_MAX));
+
+    RecurseSnapshot(root, -1);
+
+    m_snapshotTime = CScanStatistics::Now() - start;
+}
+
+void CTreeQuery::RecurseSnapshot(CItem *item, int parent)
+{
+    TREEQUERYNODE node;
+    node.size = item->GetSize();
+    node.files = item->GetFilesCount();
+    node.subdirs = item->GetSubdirsCount();
+    node.mtime = ToUnixTime(item->GetLastChange());
+    node.attributes = item->GetAttributes();
+    node.type = item->GetType();
+    node.parent = parent;
+    node.extension = (IT_FILE == item->GetType() ? GetExtensionIndex(item->GetExtension()) : -1);
+
+    const int index = (int)m_nodes.Add(node);
+
+    // The path components, from which GetPath() builds the path like
+    // CItem::GetPath() does. The pseudo items have none.
+    switch (item->GetType())
+    {
+    case IT_DRIVE:
+        {
+            m_names.Add(WithoutTrailingBackslash(item->GetPath()));
+        }
+        break;
+
+    case IT_DIRECTORY:
+    case IT_FILE:
+        {
+            // CString shares the buffer, the name is not copied.
+            m_names.Add(parent == -1 ? WithoutTrailingBackslash(item->GetPath()) : item->GetName());
+        }
+        break;
+
+    default:
+        {
+            m_names.Add(CString());
+        }
+    }
+
+    // Don't load all spilled subtrees at once
+    const bool spilled = item->IsSpilled();
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        RecurseSnapshot(item->GetChild(i), index);
+    }
+
+    if(spilled)
+    {
+        item->Spill();
+    }
+}
+
+int CTreeQuery::GetExtensionIndex(const CString& ext)
+{
+    int i;
+    if(!m_extensionIndex.Lookup(ext, i))
+    {
+        i = (int)m_extensions.Add(ext);
+        m_extensionIndex.SetAt(ext, i);
+    }
+    return i;
+}
+
+CString CTreeQuery::GetPath(int i) const
+{
+    CString path;
+    for(int k = i; k != -1; k = m_nodes[k].parent)
+    {
+        if(m_names[k].IsEmpty())
+        {
+            continue;
+        }
+        path = path.IsEmpty() ? m_names[k] : m_names[k] + wds::chrBackslash + path;
+    }
+
+    const int type = m_nodes[i].type;
+    const int parent = m_nodes[i].parent;
+    if(IT_DRIVE == type || IT_FILESFOLDER == type && parent != -1 && IT_DRIVE == m_nodes[parent].type)
+    {
+        path += wds::chrBackslash;
+    }
+    return path;
+}
+
+int CTreeQuery::GetNodeCount() const
+{
+    return (int)m_nodes.GetSize();
+}
+
+ULONGLONG CTreeQuery::GetSnapshotTime() const
+{
+    return m_snapshotTime;
+}
+
+ULONGLONG CTreeQuery::GetRunTime() const
+{
+    return m_runTime;
+}
+
+bool CTreeQuery::Run(LPCTSTR scriptFile, CString& output)
+{
+    m_output.Empty();
+
+    CStringA script;
+    try
+    {
+        CFile file(scriptFile, CFile::modeRead | CFile::shareDenyWrite);
+        const UINT length = (UINT)file.GetLength();
+        file.Read(script.GetBuffer(length), length);
+        script.ReleaseBuffer(length);
+    }
+    catch (CException *pe)
+    {
+        TCHAR message[1024];
+        pe->GetErrorMessage(message, _countof(message));
+        pe->Delete();
+        output = message;
+        return false;
+    }
+
+    lua_State *L = luaWDS_open();
+    if(L == NULL)
+    {
+        output = _T("Cannot create the Lua state.");
+        return false;
+    }
+
+    // luaWDS_open() doesn't open the LuaJIT specific libraries.
+    const luaL_Reg jitlibs[] =
+    {
+        { LUA_BITLIBNAME, luaopen_bit },
+        { LUA_JITLIBNAME, luaopen_jit },
+        { LUA_FFILIBNAME, luaopen_ffi }
+    };
+    for(int i = 0; i < _countof(jitlibs); i++)
+    {
+        lua_pushcfunction(L, jitlibs[i].func);
+        lua_pushstring(L, jitlibs[i].name);
+        lua_call(L, 1, 0);
+    }
+
+    Register(L);
+
+    const ULONGLONG start = CScanStatistics::Now();
+
+    lua_pushcfunction(L, _traceback);
+    const int traceback = lua_gettop(L);
+
+    int status = luaL_loadbuffer(L, PRELUDE, strlen(PRELUDE), "=prelude");
+    if(status == 0)
+    {
+        status = lua_pcall(L, 0, 0, traceback);
+    }
+    if(status == 0)
+    {
+        CStringA chunkname = "@" + CStringA(CW2A(scriptFile, CP_UTF8));
+        status = luaL_loadbuffer(L, script, script.GetLength(), chunkname);
+    }
+    if(status == 0)
+    {
+        status = lua_pcall(L, 0, 0, traceback);
+    }
+    if(status != 0)
+    {
+        const char *message = lua_tostring(L, -1);
+        m_output += (message != NULL ? message : "(error object is not a string)");
+        m_output += "\r\n";
+    }
+
+    m_runTime = CScanStatistics::Now() - start;
+
+    lua_close(L);
+
+    output = CA2W(m_output, CP_UTF8);
+    m_output.Empty();
+
+    return status == 0;
+}
+
+void CTreeQuery::Register(lua_State *L)
+{
+    lua_newtable(L);
+
+    lua_pushlightuserdata(L, m_nodes.GetData());
+    lua_setfield(L, -2, "nodes");
+
+    lua_pushinteger(L, m_nodes.GetSize());
+    lua_setfield(L, -2, "count");
+
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    lua_pushnumber(L, ToUnixTime(now));
+    lua_setfield(L, -2, "now");
+
+    for(int i = 0; i < _countof(TYPENAMES); i++)
+    {
+        lua_pushinteger(L, TYPENAMES[i].type);
+        lua_setfield(L, -2, TYPENAMES[i].name);
+    }
+
+    const luaL_Reg functions[] =
+    {
+        { "path",       _path },
+        { "name",       _name },
+        { "extension",  _extension },
+        { "totable",    _totable }
+    };
+    for(int i = 0; i < _countof(functions); i++)
+    {
+        lua_pushlightuserdata(L, this);
+        lua_pushcclosure(L, functions[i].func, 1);
+        lua_setfield(L, -2, functions[i].name);
+    }
+
+    lua_setglobal(L, "wds");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, _print, 1);
+    lua_setglobal(L, "print");
+}
+
+CTreeQuery *CTreeQuery::GetThis(lua_State *L)
+{
+    return (CTreeQuery *)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+int CTreeQuery::_path(lua_State *L)
+{
+    CTreeQuery *query = GetThis(L);
+    const int i = luaL_checkint(L, 1);
+    luaL_argcheck(L, i >= 0 && i < query->m_nodes.GetSize(), 1, "node index out of range");
+
+    lua_pushstring(L, CW2A(query->GetPath(i), CP_UTF8));
+    return 1;
+}
+
+int CTreeQuery::_name(lua_State *L)
+{
+    CTreeQuery *query = GetThis(L);
+    const int i = luaL_checkint(L, 1);
+    luaL_argcheck(L, i >= 0 && i < query->m_nodes.GetSize(), 1, "node index out of range");
+
+    lua_pushstring(L, CW2A(query->m_names[i], CP_UTF8));
+    return 1;
+}
+
+int CTreeQuery::_extension(lua_State *L)
+{
+    CTreeQuery *query = GetThis(L);
+    const int i = luaL_checkint(L, 1);
+
+    if(i < 0 || i >= query->m_extensions.GetSize())
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushstring(L, CW2A(query->m_extensions[i], CP_UTF8));
+    }
+    return 1;
+}
+
+// The node as a table, with name and path. What a script would get without
+// FFI. The Lua numbers are doubles, exact up to 2^53 bytes.
+int CTreeQuery::_totable(lua_State *L)
+{
+    CTreeQuery *query = GetThis(L);
+    const int i = luaL_checkint(L, 1);
+    luaL_argcheck(L, i >= 0 && i < query->m_nodes.GetSize(), 1, "node index out of range");
+
+    const TREEQUERYNODE& node = query->m_nodes[i];
+
+    lua_createtable(L, 0, 10);
+    lua_pushnumber(L, (lua_Number)node.size);
+    lua_setfield(L, -2, "size");
+    lua_pushnumber(L, (lua_Number)node.files);
+    lua_setfield(L, -2, "files");
+    lua_pushnumber(L, (lua_Number)node.subdirs);
+    lua_setfield(L, -2, "subdirs");
+    lua_pushnumber(L, node.mtime);
+    lua_setfield(L, -2, "mtime");
+    lua_pushnumber(L, node.attributes);
+    lua_setfield(L, -2, "attributes");
+    lua_pushinteger(L, node.type);
+    lua_setfield(L, -2, "type");
+    lua_pushinteger(L, node.parent);
+    lua_setfield(L, -2, "parent");
+    lua_pushinteger(L, node.extension);
+    lua_setfield(L, -2, "extension");
+    lua_pushstring(L, CW2A(query->m_names[i], CP_UTF8));
+    lua_setfield(L, -2, "name");
+    lua_pushstring(L, CW2A(query->GetPath(i), CP_UTF8));
+    lua_setfield(L, -2, "path");
+    return 1;
+}
+
+// Like the print() of Lua, but into m_output.
+int CTreeQuery::_print(lua_State *L)
+{
+    CTreeQuery *query = GetThis(L);
+    const int n = lua_gettop(L);
+
+    lua_getglobal(L, "tostring");
+    for(int i = 1; i <= n; i++)
+    {
+        lua_pushvalue(L, -1);
+        lua_pushvalue(L, i);
+        lua_call(L, 1, 1);
+
+        const char *s = lua_tostring(L, -1);
+        if(s == NULL)
+        {
+            return luaL_error(L, "'tostring' must return a string to 'print'");
+        }
+        if(i > 1)
+        {
+            query->m_output += '\t';
+        }
+        query->m_output += s;
+        lua_pop(L, 1);
+    }
+    query->m_output += "\r\n";
+    return 0;
+}
+
+int CTreeQuery::_traceback(lua_State *L)
+{
+    if(!lua_isstring(L, 1))
+    {
+        return 1;   // Keep the error object
+    }
+
+    lua_getfield(L, LUA_GLOBALSINDEX, "debug");
+    if(!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return 1;
+    }
+    lua_getfield(L, -1, "traceback");
+    if(!lua_isfunction(L, -1))
+    {
+        lua_pop(L, 2);
+        return 1;
+    }
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 2);
+    lua_call(L, 2, 1);
+    return 1;
+}
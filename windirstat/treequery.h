@@ -0,0 +1,102 @@
+// treequery.h - Declaration of CTreeQuery
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_TREEQUERY_H__
+#define __WDS_TREEQUERY_H__
+#pragma once
+
+class CItem;
+struct lua_State;
+
+//
+// TREEQUERYNODE. One item of the snapshot, which CTreeQuery hands to Lua.
+// Mirrored by the ffi.cdef in treequery.cpp (wds_node), so the layout
+// must not change on its own.
+//
+struct TREEQUERYNODE
+{
+    ULONGLONG size;
+    ULONGLONG files;
+    ULONGLONG subdirs;
+    double mtime;       // Last change, seconds since 1970-01-01 (UTC)
+    DWORD attributes;
+    int type;           // ITEMTYPE
+    int parent;         // Index of the parent, -1 for the root
+    int extension;      // Index of the extension (files only), else -1
+};
+
+//
+// CTreeQuery. Runs a Lua script (LuaJIT) over the scanned tree, for
+// custom reports like "folders over 10 GB untouched for a year".
+//
+// The tree is copied once into a flat array of TREEQUERYNODEs in pre-order
+// (parents before their children). The script gets the array itself as an
+// FFI pointer, wds.node[0 .. wds.count - 1], so iterating it creates no
+// Lua objects at all. Names and paths are fetched on demand:
+//
+//   wds.path(i), wds.name(i), wds.extension(wds.node[i].extension)
+//   wds.totable(i)  -- The node as a Lua table. Slow; for comparison.
+//   wds.now         -- Current time, like mtime
+//   wds.IT_DRIVE, wds.IT_DIRECTORY, wds.IT_FILE, ...
+//
+// print() writes to the output of Run().
+//
+class CTreeQuery
+{
+public:
+    CTreeQuery();
+
+    // Takes the snapshot. Spilled subtrees are loaded one at a time.
+    void Snapshot(CItem *root);
+
+    // Return: false, if the script failed. output: what the script
+    // printed, and the error message, if any.
+    bool Run(LPCTSTR scriptFile, CString& output);
+
+    int GetNodeCount() const;
+    ULONGLONG GetSnapshotTime() const;  // performance counter ticks, see CScanStatistics
+    ULONGLONG GetRunTime() const;
+
+private:
+    void RecurseSnapshot(CItem *item, int parent);
+    int GetExtensionIndex(const CString& ext);
+    CString GetPath(int i) const;
+    void Register(lua_State *L);
+
+    static CTreeQuery *GetThis(lua_State *L);
+    static int _path(lua_State *L);
+    static int _name(lua_State *L);
+    static int _extension(lua_State *L);
+    static int _totable(lua_State *L);
+    static int _print(lua_State *L);
+    static int _traceback(lua_State *L);
+
+    CArray<TREEQUERYNODE, TREEQUERYNODE&> m_nodes;
+    CStringArray m_names;       // Path component of each node, may be empty
+    CStringArray m_extensions;
+    CMap<CString, LPCTSTR, int, int> m_extensionIndex;
+
+    CStringA m_output;          // UTF-8, collected by print()
+    ULONGLONG m_snapshotTime;
+    ULONGLONG m_runTime;
+};
+
+#endif // __WDS_TREEQUERY_H__
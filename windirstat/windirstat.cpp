@@ -33,6 +33,7 @@
 #include "osspecific.h"
 #include "globalhelpers.h"
 #include "WorkLimiter.h"
+#include "headlessscan.h"
 #pragma warning(push)
 #pragma warning(disable : 4091)
 #include <Dbghelp.h> // for mini dumps
@@ -86,9 +87,94 @@ END_MESSAGE_MAP()
 
 CDirstatApp _theApp;
 
+CWDSCommandLineInfo::CWDSCommandLineInfo()
+    : m_headless(false)
+    , m_topCount(20)
+    , m_compressExport(false)
+    , m_spillBudget(-1)
+    , m_growthDays(-1)
+{
+}
+
+void CWDSCommandLineInfo::ParseParam(LPCTSTR pszParam, BOOL bFlag, BOOL bLast)
+{
+    if(bFlag)
+    {
+        CString param = pszParam;
+        if(param.CompareNoCase(_T("headless")) == 0)
+        {
+            m_headless = true;
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(7).CompareNoCase(_T("report:")) == 0)
+        {
+            m_reportFile = param.Mid(7);
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(7).CompareNoCase(_T("export:")) == 0)
+        {
+            m_exportFile = param.Mid(7);
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(7).CompareNoCase(_T("script:")) == 0)
+        {
+            m_scriptFile = param.Mid(7);
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(8).CompareNoCase(_T("history:")) == 0)
+        {
+            m_historyFile = param.Mid(8);
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(7).CompareNoCase(_T("growth:")) == 0)
+        {
+            const int days = _ttoi(param.Mid(7));
+            if(days >= 0)
+            {
+                m_growthDays = days;
+            }
+            ParseLast(bLast);
+            return;
+        }
+        if(param.CompareNoCase(_T("compress")) == 0)
+        {
+            m_compressExport = true;
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(4).CompareNoCase(_T("top:")) == 0)
+        {
+            const int topCount = _ttoi(param.Mid(4));
+            if(topCount > 0)
+            {
+                m_topCount = topCount;
+            }
+            ParseLast(bLast);
+            return;
+        }
+        if(param.Left(7).CompareNoCase(_T("budget:")) == 0)
+        {
+            const int budget = _ttoi(param.Mid(7));
+            if(budget >= 0)
+            {
+                m_spillBudget = budget;
+            }
+            ParseLast(bLast);
+            return;
+        }
+    }
+    CCommandLineInfo::ParseParam(pszParam, bFlag, bLast);
+}
+
 CDirstatApp::CDirstatApp()
     : Inherited()
     , m_pDocTemplate(0)
+    , m_headlessExitCode(-1)
     , m_langid(0)
     , m_workingSet(0)
     , m_pageFaults(0)
@@ -238,6 +324,7 @@ void CDirstatApp::RestartApplication()
     // like column widths an so on are saved before the new instance is resumed.
     // This will post a WM_QUIT message.
     GetMainFrame()->SendMessage(WM_CLOSE);
+    CRegistryUser::flushProfile();
 
     DWORD dw = ::ResumeThread(pi.hThread);
     if(dw != 1)
@@ -410,21 +497,31 @@ bool CDirstatApp::IsCorrectResourceDll(LPCTSTR path)
     return true;
 }
 
-void CDirstatApp::ReReadMountPoints()
+void CDirstatApp::InvalidateMountPoints()
 {
-    m_mountPoints.Initialize();
+    m_mountPoints.Invalidate();
 }
 
-bool CDirstatApp::IsVolumeMountPoint(CString path)
+bool CDirstatApp::IsVolumeMountPoint(LPCTSTR path)
 {
     return m_mountPoints.IsVolumeMountPoint(path);
 }
 
-bool CDirstatApp::IsFolderJunction(CString path)
+bool CDirstatApp::IsFolderJunction(LPCTSTR path)
 {
     return m_mountPoints.IsFolderJunction(path);
 }
 
+bool CDirstatApp::IsVolumeMountPoint(const CFileFindWDS& finder)
+{
+    return m_mountPoints.IsVolumeMountPoint(finder);
+}
+
+bool CDirstatApp::IsFolderJunction(const CFileFindWDS& finder)
+{
+    return m_mountPoints.IsFolderJunction(finder);
+}
+
 // Get the alternative colors for compressed and encrypted files/folders.
 // This function uses either the value defined in the Explorer configuration
 // or the default color values.
@@ -517,6 +614,23 @@ BOOL CDirstatApp::InitInstance()
     VERIFY(AfxInitRichEdit2());     // On NT, this helps.
     Inherited::EnableHtmlHelp();
 
+#if SUPPORT_ELEVATION
+    //check for an elevation event
+    m_ElevationEvent = ::OpenEvent(SYNCHRONIZE, FALSE, m_ElevationEventName);
+
+    if (m_ElevationEvent)
+    {
+        //and if so, wait for it, so previous instance can store its config, before we read any of it
+        ::WaitForSingleObject(m_ElevationEvent, 20 * 1000);
+        ::CloseHandle(m_ElevationEvent);
+        m_ElevationEvent = NULL;
+    }
+    else
+    {
+        VTRACE(_T("OpenEvent failed with %d"), GetLastError());
+    }
+#endif // SUPPORT_ELEVATION
+
     Inherited::SetRegistryKey(_T("Seifert"));
     Inherited::LoadStdProfileSettings(4);
 
@@ -546,24 +660,19 @@ BOOL CDirstatApp::InitInstance()
         CLanguageOptions::SetLanguage(m_langid);
     }
 
-#if SUPPORT_ELEVATION
-    //check for an elevation event
-    m_ElevationEvent = ::OpenEvent(SYNCHRONIZE, FALSE, m_ElevationEventName);
+    GetOptions()->LoadFromRegistry();
 
-    if (m_ElevationEvent)
-    {
-        //and if so, wait for it, so previous instance can store its config that we reload next
-        ::WaitForSingleObject(m_ElevationEvent, 20 * 1000);
-        ::CloseHandle(m_ElevationEvent);
-        m_ElevationEvent = NULL;
-    }
-    else
+    CWDSCommandLineInfo cmdInfo;
+    ParseCommandLine(cmdInfo);
+
+    if(cmdInfo.m_headless)
     {
-        VTRACE(_T("OpenEvent failed with %d"), GetLastError());
+        // No window, no message loop. As we return FALSE,
+        // MFC goes straight to ExitInstance().
+        CHeadlessScan scan(cmdInfo);
+        m_headlessExitCode = scan.Run(cmdInfo.m_strFileName);
+        return FALSE;
     }
-#endif // SUPPORT_ELEVATION
-
-    GetOptions()->LoadFromRegistry();
 
     m_pDocTemplate = new CSingleDocTemplate(
         IDR_MAINFRAME,
@@ -576,9 +685,6 @@ BOOL CDirstatApp::InitInstance()
     }
     AddDocTemplate(m_pDocTemplate);
 
-    CCommandLineInfo cmdInfo;
-    ParseCommandLine(cmdInfo);
-
     m_nCmdShow = SW_HIDE;
     if(!ProcessShellCommand(cmdInfo))
     {
@@ -604,7 +710,10 @@ BOOL CDirstatApp::InitInstance()
 
 int CDirstatApp::ExitInstance()
 {
-    return Inherited::ExitInstance();
+    m_myImageList.shutdown();
+    CRegistryUser::flushProfile();
+    const int exitCode = Inherited::ExitInstance();
+    return m_headlessExitCode >= 0 ? m_headlessExitCode : exitCode;
 }
 
 LANGID CDirstatApp::GetLangid()
@@ -738,6 +847,7 @@ void CDirstatApp::OnRunElevated()
         //TODO: Store configurations for the new app
         
         GetMainFrame()->SendMessage(WM_CLOSE);
+        CRegistryUser::flushProfile();
         ::SetEvent(m_ElevationEvent); //Tell other process that we finished saving data (it waits only 20s)
 
         ::CloseHandle(m_ElevationEvent);
@@ -51,6 +51,28 @@ CString GetWinDirStatHomepage();
 #   define WINDIRSTAT_EVENT_NAME_FMT L"WinDirStat_ElevationEvent_{72D223E3-1539-461D-980E-0863FE480E84}.%s.%s"
 #endif // SUPPORT_ELEVATION
 
+//
+// CWDSCommandLineInfo. The MFC command line plus our own switches:
+// /headless <path> [/report:<file>] [/top:<n>] [/export:<file> [/compress]]
+// [/script:<file>] [/history:<file> [/growth:<days>]] (see CHeadlessScan).
+//
+class CWDSCommandLineInfo : public CCommandLineInfo
+{
+public:
+    CWDSCommandLineInfo();
+    virtual void ParseParam(LPCTSTR pszParam, BOOL bFlag, BOOL bLast);
+
+    bool m_headless;
+    CString m_reportFile;
+    int m_topCount;
+    CString m_exportFile;   // CSV or JSON Lines, see CTreeExporter
+    bool m_compressExport;
+    int m_spillBudget;      // MB, -1 if not given
+    CString m_scriptFile;   // Lua, see CTreeQuery
+    CString m_historyFile;  // SQLite, see CScanHistory
+    int m_growthDays;       // -1 if not given
+};
+
 //
 // CDirstatApp. The MFC application object.
 // Knows about RAM Usage, Mount points, Help files and the CMyImageList.
@@ -69,9 +91,11 @@ public:
     LANGID GetLangid();             // Language as selected in PageGeneral
     LANGID GetEffectiveLangid();    // Language to be used for date/time and number formatting
 
-    void ReReadMountPoints();
-    bool IsVolumeMountPoint(CString path);
-    bool IsFolderJunction(CString path);
+    void InvalidateMountPoints();
+    bool IsVolumeMountPoint(LPCTSTR path);
+    bool IsFolderJunction(LPCTSTR path);
+    bool IsVolumeMountPoint(const CFileFindWDS& finder);
+    bool IsFolderJunction(const CFileFindWDS& finder);
 
     COLORREF AltColor();                    // Coloring of compressed items
     COLORREF AltEncryptionColor();          // Coloring of encrypted items
@@ -112,6 +136,7 @@ protected:
 #endif // SUPPORT_ELEVATION
 
     CSingleDocTemplate* m_pDocTemplate;     // MFC voodoo.
+    int m_headlessExitCode;                 // -1, or the result of a headless scan
 
     LANGID m_langid;                        // Language we are running
     CReparsePoints m_mountPoints;           // Mount point information